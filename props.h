@@ -18,13 +18,53 @@
 #ifndef _LV2_PROPS_H_
 #define _LV2_PROPS_H_
 
+#ifdef __cplusplus
+#	include <atomic>
+
+	// what C++23's <stdatomic.h> does, but as macros that are undefined again
+	// at the end of this header, so nothing leaks into the global namespace
+#	ifndef _Atomic
+#		define _PROPS_CXX_KEYWORDS
+#		define _Atomic(T) std::atomic<T>
+#		define _Alignas(A) alignas(A)
+#		define _Alignof(T) alignof(T)
+#	endif
+#	define atomic_bool std::atomic_bool
+#	define atomic_int std::atomic_int
+#	define atomic_uint std::atomic_uint
+#	define atomic_size_t std::atomic_size_t
+#	define memory_order std::memory_order
+#	define memory_order_relaxed std::memory_order_relaxed
+#	define memory_order_acquire std::memory_order_acquire
+#	define memory_order_release std::memory_order_release
+#	define memory_order_acq_rel std::memory_order_acq_rel
+#	define memory_order_seq_cst std::memory_order_seq_cst
+#	define atomic_init std::atomic_init
+#	define atomic_load std::atomic_load
+#	define atomic_load_explicit std::atomic_load_explicit
+#	define atomic_store std::atomic_store
+#	define atomic_store_explicit std::atomic_store_explicit
+#	define atomic_exchange std::atomic_exchange
+#	define atomic_exchange_explicit std::atomic_exchange_explicit
+#	define atomic_fetch_add std::atomic_fetch_add
+#	define atomic_fetch_add_explicit std::atomic_fetch_add_explicit
+#	define atomic_fetch_sub std::atomic_fetch_sub
+#	define atomic_fetch_sub_explicit std::atomic_fetch_sub_explicit
+#	define atomic_compare_exchange_strong_explicit std::atomic_compare_exchange_strong_explicit
+#	define atomic_compare_exchange_weak_explicit std::atomic_compare_exchange_weak_explicit
+#	define atomic_thread_fence std::atomic_thread_fence
+#else
+#	include <stdatomic.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #include <stdlib.h>
-#include <stdatomic.h>
 #include <stdio.h>
+#include <sched.h>
+#include <time.h>
 
 #include <lv2/lv2plug.in/ns/lv2core/lv2.h>
 #include <lv2/lv2plug.in/ns/ext/urid/urid.h>
@@ -37,10 +77,30 @@ extern "C" {
  * API START
  *****************************************************************************/
 
+#define LV2_PROPS_URI    "http://open-music-kontrollers.ch/lv2/props"
+#define LV2_PROPS_PREFIX LV2_PROPS_URI "#"
+
+#define LV2_PROPS__index LV2_PROPS_PREFIX "index" // element(s) of array properties
+#define LV2_PROPS__defaults LV2_PROPS_PREFIX "defaults" // sync relative to defaults
+#define LV2_PROPS__subscription LV2_PROPS_PREFIX "subscription" // properties notified
+
 // structures
 typedef struct _props_def_t props_def_t;
+typedef struct _props_sync_t props_sync_t;
 typedef struct _props_impl_t props_impl_t;
+typedef struct _props_shape_t props_shape_t;
 typedef struct _props_dyn_t props_dyn_t;
+typedef struct _props_cache_buf_t props_cache_buf_t;
+typedef struct _props_cache_slot_t props_cache_slot_t;
+typedef struct _props_cache_t props_cache_t;
+typedef struct _props_gen_t props_gen_t;
+typedef struct _props_slot_t props_slot_t;
+typedef struct _props_ref_t props_ref_t;
+typedef struct _props_pool_blk_t props_pool_blk_t;
+typedef struct _props_pool_t props_pool_t;
+typedef struct _props_request_t props_request_t;
+typedef struct _props_change_t props_change_t;
+typedef struct _props_history_t props_history_t;
 typedef struct _props_t props_t;
 
 typedef enum _props_dyn_ev_t {
@@ -49,12 +109,37 @@ typedef enum _props_dyn_ev_t {
 	PROPS_DYN_EV_SET
 } props_dyn_ev_t;
 
+typedef enum _props_flag_t {
+	PROPS_FLAG_HIDDEN   = 0,
+	PROPS_FLAG_READABLE = 1, // access is patch:readable
+	PROPS_FLAG_EVENT    = 2, // has event_cb
+	PROPS_FLAG_POOLED   = 3,
+	PROPS_FLAG_MUTED    = 4, // not subscribed by the listener
+	PROPS_FLAG_NUMERIC  = 5, // Int, Long, Float, Double, array of Float or Vector
+	PROPS_FLAG_MORPHED  = 6, // changed by props_morph, to be sent on
+	PROPS_FLAG_STALE    = 7, // derived, to be recomputed by props_derive
+	PROPS_FLAG_STASHING = 8, // stash deferred, to be retried by props_idle
+
+	PROPS_FLAG_MAX
+} props_flag_t;
+
+typedef enum _props_request_status_t {
+	PROPS_REQUEST_ACK,     // patch:Ack to a patch:Set
+	PROPS_REQUEST_VALUE,   // patch:Set in reply to a patch:Get, already applied
+	PROPS_REQUEST_ERROR,   // patch:Error
+	PROPS_REQUEST_TIMEOUT  // no reply in time
+} props_request_status_t;
+
 // function callbacks
 typedef void (*props_event_cb_t)(
 	void *data,
 	int64_t frames,
 	props_impl_t *impl);
 
+typedef void (*props_derive_cb_t)(
+	void *data,
+	props_impl_t *impl);
+
 typedef void (*props_dyn_prop_cb_t)(
 	void *data,
 	props_dyn_ev_t ev,
@@ -62,6 +147,12 @@ typedef void (*props_dyn_prop_cb_t)(
 	LV2_URID prop,
 	const LV2_Atom *body);
 
+typedef void (*props_request_cb_t)(
+	void *data,
+	int32_t sequence_num,
+	LV2_URID property,
+	props_request_status_t status);
+
 struct _props_def_t {
 	const char *property;
 	const char *type;
@@ -71,8 +162,45 @@ struct _props_def_t {
 
 	uint32_t max_size;
 	props_event_cb_t event_cb;
+
+	bool pooled; // stored out-of-line, offset points to a props_ref_t
+
+	uint32_t count; // array of fixed-size elements, 0 for a plain property
+	uint32_t stride; // bytes between elements, 0 for densely packed
+
+	props_derive_cb_t derive; // writes the value from the ones it depends on
+	const char *const *depends; // NULL-terminated property URIs
+};
+
+// define PROPS_CACHE_LINE (power of 2) to give each property's lock and
+// version words a cache line of their own, at PROPS_CACHE_LINE bytes per
+// property; packed, they still share no line with the impls
+struct _props_sync_t {
+#if defined(PROPS_CACHE_LINE)
+	_Alignas(PROPS_CACHE_LINE)
+#endif
+	atomic_int state;
+	atomic_uint version;
 };
 
+#define PROPS_BITS(N) (((N) + 31) / 32)
+
+#if !defined(PROPS_MORPH_THRESHOLD)
+#	define PROPS_MORPH_THRESHOLD 0.5f // ratio at which non-numeric properties switch over
+#endif
+
+#if !defined(PROPS_DUMP_MAX)
+#	define PROPS_DUMP_MAX 0 // maximal properties per cycle of a dump (0: unlimited)
+#endif
+
+#if !defined(PROPS_ARRAY_MAX)
+#	define PROPS_ARRAY_MAX 64 // maximal count of array properties
+#endif
+
+#if !defined(PROPS_SNAPSHOT_TIMEOUT)
+#	define PROPS_SNAPSHOT_TIMEOUT 100 // ms props_save waits for the dsp to close an epoch
+#endif
+
 struct _props_impl_t {
 	LV2_URID property;
 	LV2_URID type;
@@ -89,14 +217,136 @@ struct _props_impl_t {
 
 	const props_def_t *def;
 
-	atomic_int state;
-	bool stashing;
+	props_sync_t *sync; // cross-thread words live apart from the impls
+};
+
+// cold per-property metadata, lives apart from the impls like the sync words
+struct _props_shape_t {
+	uint64_t stamp; // last change
+	uint32_t max_size; // resolved at init
+	uint32_t count; // arrays: value/stash point to element 0, size is per element
+	uint32_t stride;
+	uint32_t group; // history group current at the time of the change
+	uint8_t cls; // props_class_t, resolved at init
 };
 
 struct _props_dyn_t {
 	props_dyn_prop_cb_t prop;
 };
 
+// threading policy, select with -DPROPS_THREADING=...
+#define PROPS_THREADING_SPIN     0 // save/restore may run concurrently to run
+#define PROPS_THREADING_LOCKFREE 1 // always stash-less, save may run concurrently
+#define PROPS_THREADING_SINGLE   2 // save/restore are called from the audio thread
+
+#ifndef PROPS_THREADING
+#	define PROPS_THREADING PROPS_THREADING_SPIN
+#endif
+
+#ifndef PROPS_CACHE_SLOTS
+#	define PROPS_CACHE_SLOTS 8
+#endif
+
+#ifndef PROPS_CACHE_PATH_MAX
+#	define PROPS_CACHE_PATH_MAX 1024
+#endif
+
+struct _props_cache_buf_t {
+	char path [PROPS_CACHE_PATH_MAX];
+	uint32_t size;
+	uint8_t *body; // NULL if loading failed
+};
+
+struct _props_cache_slot_t {
+	char path [PROPS_CACHE_PATH_MAX]; // owned by worker while requested/busy
+
+	atomic_int state;
+	_Atomic(props_cache_buf_t *) pending; // worker -> dsp
+	_Atomic(props_cache_buf_t *) retired; // dsp -> worker
+
+	props_cache_buf_t *current; // dsp only
+	uint64_t stamp; // dsp only
+};
+
+struct _props_cache_t {
+	atomic_bool working;
+	uint64_t clock;
+
+	props_cache_slot_t slots [PROPS_CACHE_SLOTS];
+};
+
+#ifndef PROPS_POOL_CLASSES
+#	define PROPS_POOL_CLASSES 16
+#endif
+
+#define PROPS_POOL_MIN 16
+#define PROPS_POOL_MAX (PROPS_POOL_MIN << (PROPS_POOL_CLASSES - 1))
+
+struct _props_ref_t {
+	uint32_t size;
+	void *body;
+};
+
+struct _props_pool_blk_t {
+	atomic_uint next;
+	uint32_t cls;
+};
+
+struct _props_pool_t {
+	uint8_t *base;
+	size_t size;
+	atomic_size_t used;
+
+	// tagged free list heads per size class: (tag << 32) | (offset/8 + 1)
+	_Atomic(uint64_t) heads [PROPS_POOL_CLASSES];
+};
+
+struct _props_gen_t {
+	void *base; // same layout as value_base
+	uint64_t stamp;
+	atomic_uint readers;
+};
+
+struct _props_slot_t {
+	void *base; // same layout as value_base
+	uint32_t *sizes; // indexed like impls, NULL: variable-sized values are left out
+	bool stored;
+};
+
+#define PROPS_HISTORY_NONE UINT32_MAX
+
+// entry of the change log, followed by the old and the new value, each padded
+// to 8 bytes
+struct _props_change_t {
+	uint32_t prev; // offsets into the log, PROPS_HISTORY_NONE: none
+	uint32_t next;
+	uint32_t group; // changes undone and redone together
+	uint32_t idx; // indexed like impls
+	uint32_t elem; // arrays: element
+	uint32_t old_size;
+	uint32_t new_size;
+	uint32_t pad;
+};
+
+struct _props_history_t {
+	uint8_t *buf; // ring of variable-sized changes, 8-byte aligned
+	uint32_t size;
+	uint32_t first; // oldest change
+	uint32_t last; // newest change
+	uint32_t cursor; // newest change not undone
+	uint32_t group;
+	bool paused; // changes are not logged, e.g. while they are replayed
+};
+
+struct _props_request_t {
+	int32_t sequence_num; // 0: free
+	LV2_URID property;
+	LV2_URID otype; // patch:Set or patch:Get
+	int64_t deadline; // in frames of props_tick
+	props_request_cb_t cb;
+	void *data;
+};
+
 struct _props_t {
 	struct {
 		LV2_URID subject;
@@ -118,6 +368,10 @@ struct _props_t {
 		LV2_URID patch_error;
 		LV2_URID patch_ack;
 
+		LV2_URID props_index;
+		LV2_URID props_defaults;
+		LV2_URID props_subscription;
+
 		LV2_URID atom_int;
 		LV2_URID atom_long;
 		LV2_URID atom_float;
@@ -127,6 +381,7 @@ struct _props_t {
 		LV2_URID atom_path;
 		LV2_URID atom_literal;
 		LV2_URID atom_vector;
+		LV2_URID atom_tuple;
 		LV2_URID atom_object;
 		LV2_URID atom_sequence;
 
@@ -135,37 +390,196 @@ struct _props_t {
 
 	void *data;
 
+	bool stashless;
 	bool stashing;
 	atomic_bool restoring;
+	bool sweeping; // restore sweep of props_idle_budget in progress
+	unsigned cursor;
+	bool dumping; // wildcard patch:Get in progress
+	bool dump_defaults; // skip properties at their defaults
+	unsigned dump;
+	int32_t dump_seq;
+
+	atomic_uint epoch;
+	unsigned transactions;
+	bool inconsistent;
 
 	uint32_t max_size;
+	uint32_t sum_size;
 
 	const props_dyn_t *dyn;
+	props_cache_t *cache;
+	props_pool_t *pool;
+
+	void *value_base;
+	void *stash_base;
+	const void *defaults_base;
+
+	uint64_t stamp;
+	props_gen_t *gens;
+	unsigned ngens;
+	_Atomic(props_gen_t *) gen;
+
+	props_slot_t *slots;
+	unsigned nslots;
+	atomic_int select; // slot to be recalled in props_idle, -1: none
+	bool morphed; // properties are left to be sent on
+
+	props_history_t history;
+
+	props_request_t *reqs;
+	unsigned nreqs;
+	int32_t sequence_num;
+	int64_t frames;
 
 	unsigned nimpls;
-	props_impl_t impls [1];
+	props_shape_t *shapes; // indexed like impls
+	uint32_t *dirty; // elements changed since last notification, PROPS_BITS(PROPS_ARRAY_MAX) per impl
+	const LV2_URID *keys; // sorted property URIDs, dense for lookup
+	uint32_t *flags [PROPS_FLAG_MAX]; // bitsets, indexed like impls
+	uint32_t *order; // derived properties in topological order
+	uint32_t *derived; // derived properties, indexed like dependents' bits
+	unsigned nderived;
+	uint32_t *dependents; // bitsets of transitive dependents, indexed like impls
+	bool stale; // derived properties are left to be recomputed
+	props_impl_t impls [1]; // followed by syncs, shapes, dirty bits, keys and flags, see PROPS_T
 };
 
+#define PROPS_INDEX_SIZE(N) \
+	( ((N) + 1)*sizeof(props_sync_t) \
+	+ (N)*(sizeof(props_shape_t) + sizeof(LV2_URID)) \
+	+ (N)*PROPS_BITS(PROPS_ARRAY_MAX)*sizeof(uint32_t) \
+	+ PROPS_FLAG_MAX*PROPS_BITS(N)*sizeof(uint32_t) )
+
+// bytes of a props_graph buffer for N properties of which D are derived
+#define PROPS_GRAPH_SIZE(N, D) \
+	( (2*(D) + (N)*PROPS_BITS(D))*sizeof(uint32_t) )
+
 #define PROPS_T(PROPS, MAX_NIMPLS) \
-	props_t (PROPS); \
-	props_impl_t _impls [MAX_NIMPLS]
+	props_t PROPS; \
+	props_impl_t _impls [MAX_NIMPLS]; \
+	uint8_t _index [PROPS_INDEX_SIZE(MAX_NIMPLS)]
 
-// rt-safe
+// rt-safe, stash-less mode with stash_base == NULL (or PROPS_THREADING_LOCKFREE):
+// restore must not be called concurrently to run and values must only be
+// changed via props
 static inline int
 props_init(props_t *props, const char *subject,
 	const props_def_t *defs, int nimpls,
 	void *value_base, void *stash_base,
 	LV2_URID_Map *map, void *data);
 
+// rt-safe, bytes needed by props_init_in for nimpls properties
+static inline size_t
+props_size(int nimpls);
+
+// rt-safe, places props_t with its impls and index into a caller's arena of
+// at least props_size(nimpls) bytes, e.g. allocated at instantiate
+static inline props_t *
+props_init_in(void *buffer, size_t size, const char *subject,
+	const props_def_t *defs, int nimpls,
+	void *value_base, void *stash_base,
+	LV2_URID_Map *map, void *data);
+
 // rt-safe
 static inline void
 props_dyn(props_t *props, const props_dyn_t *dyn);
 
+// non-rt
+static inline void
+props_cache_init(props_cache_t *cache);
+
+// non-rt
+static inline void
+props_cache_deinit(props_cache_t *cache);
+
+// rt-safe
+static inline void
+props_cache(props_t *props, props_cache_t *cache);
+
+// rt-safe
+static inline const props_cache_buf_t *
+props_cache_get(props_t *props, const char *path);
+
+// rt-safe
+static inline bool
+props_cache_pending(props_t *props);
+
+// non-rt, e.g. from LV2_Worker_Interface.work
+static inline void
+props_cache_work(props_cache_t *cache);
+
+// rt-safe
+static inline void
+props_pool_init(props_pool_t *pool, void *buffer, size_t size);
+
+// rt-safe
+static inline int
+props_pool(props_t *props, props_pool_t *pool);
+
+// rt-safe
+static inline void *
+props_reserve(props_t *props, LV2_URID property, uint32_t size);
+
+// rt-safe, defaults_base has the same layout as value_base and must outlive
+// props. A wildcard patch:Get with props:defaults true then is answered with a
+// patch:Set of props:defaults as marker and only the properties that differ
+// from their defaults. Variable-sized values match when their default starts
+// with the same bytes, e.g. NUL-terminated strings, pooled values never do
+static inline void
+props_defaults(props_t *props, const void *defaults_base);
+
+// rt-safe
+static inline bool
+props_default(props_t *props, LV2_URID property);
+
+// rt-safe, unsubscribed properties are not sent on when changed by
+// props_set, patch:Set/Put or restore, but still answer patch:Get. A listener
+// subscribes with a patch:Set of props:subscription to an atom:Vector of
+// URIDs or to atom:Bool true/false for all/none, all are subscribed at init
+static inline void
+props_subscribe(props_t *props, LV2_URID property, bool subscribed);
+
+// rt-safe
+static inline bool
+props_subscribed(props_t *props, LV2_URID property);
+
 // rt-safe
 static inline void
 props_idle(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	LV2_Atom_Forge_Ref *ref);
 
+// rt-safe, like props_idle, but stops restoring after max_props properties
+// or max_bytes of values (0: unlimited) and resumes where it stopped on the
+// next call, returns true when no restore work is left
+static inline bool
+props_idle_budget(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	unsigned max_props, uint32_t max_bytes, LV2_Atom_Forge_Ref *ref);
+
+// non-rt, after props_init, resolves the dependencies of derived properties
+// into buffer of at least PROPS_GRAPH_SIZE(nimpls, nderived) bytes, derived
+// properties are not recomputed without it, fails for unknown dependencies,
+// cycles and a too small buffer
+static inline int
+props_graph(props_t *props, void *buffer, size_t size);
+
+// rt-safe, at the end of each run after all events, recomputes each stale
+// derived property once in topological order and sends it on, derived values
+// are not logged in the history, returns their count, see props_idle(_budget)
+static inline unsigned
+props_derive(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Ref *ref);
+
+// rt-safe, properties left to be visited by props_idle(_budget)
+static inline unsigned
+props_idle_pending(props_t *props);
+
+// rt-safe, properties left to be sent on for a wildcard patch:Get, a dump only
+// forges as many properties as fit into the forge's buffer and resumes in
+// props_idle(_budget)
+static inline unsigned
+props_dump_pending(props_t *props);
+
 // rt-safe
 static inline int
 props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
@@ -181,10 +595,121 @@ static inline void
 props_get(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
 	LV2_URID property, LV2_Atom_Forge_Ref *ref);
 
+// rt-safe, stashes all given properties and sends them on in one patch:Set
+static inline void
+props_set_bulk(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	const LV2_URID *properties, unsigned nproperties, LV2_Atom_Forge_Ref *ref);
+
+// rt-safe, requests all given properties in one patch:Get
+static inline void
+props_get_bulk(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	const LV2_URID *properties, unsigned nproperties, LV2_Atom_Forge_Ref *ref);
+
 // rt-safe
 static inline void
 props_stash(props_t *props, LV2_URID property);
 
+// rt-safe, table of outstanding requests for props_request_set/get
+static inline void
+props_requests(props_t *props, props_request_t *reqs, unsigned nreqs);
+
+// rt-safe, like props_set, but with a (negative) sequence number whose
+// patch:Ack or patch:Error is reported to cb, returns 0 if the table is full
+static inline int32_t
+props_request_set(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_URID property, uint32_t timeout, props_request_cb_t cb, void *data,
+	LV2_Atom_Forge_Ref *ref);
+
+// rt-safe, like props_get, but with a (negative) sequence number whose
+// patch:Set or patch:Error is reported to cb, returns 0 if the table is full
+static inline int32_t
+props_request_get(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_URID property, uint32_t timeout, props_request_cb_t cb, void *data,
+	LV2_Atom_Forge_Ref *ref);
+
+// rt-safe, at the end of each run, times out requests older than their
+// timeout in frames
+static inline void
+props_tick(props_t *props, uint32_t nframes);
+
+// rt-safe, marks an element of an array property as changed, the next
+// props_set only sends the marked elements
+static inline void
+props_dirty(props_t *props, LV2_URID property, uint32_t index);
+
+// rt-safe, O(1) access to an element of an array property
+static inline void *
+props_element(props_t *props, LV2_URID property, uint32_t index);
+
+// rt-safe
+static inline void
+props_generations(props_t *props, props_gen_t *gens, unsigned ngens);
+
+// rt-safe, writer
+static inline bool
+props_publish(props_t *props);
+
+// rt-safe, reader
+static inline const void *
+props_acquire(props_t *props, props_gen_t **gen);
+
+// rt-safe, reader
+static inline void
+props_release(props_t *props, props_gen_t *gen);
+
+// rt-safe, preset bank of nslots caller-allocated snapshots
+static inline void
+props_bank(props_t *props, props_slot_t *slots, unsigned nslots);
+
+// rt-safe, writer, stores the current values to a slot
+static inline bool
+props_bank_store(props_t *props, unsigned slot);
+
+// rt-safe, writer, recalls a stored slot right away without going through
+// props_restore, only properties that differ are changed and sent on,
+// returns their count
+static inline unsigned
+props_bank_recall(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	unsigned slot, LV2_Atom_Forge_Ref *ref);
+
+// thread-safe, the slot is recalled by the next props_idle(_budget)
+static inline void
+props_bank_select(props_t *props, unsigned slot);
+
+// rt-safe, writer, morphs between two stored slots at ratio 0..1, numeric
+// properties are interpolated, all others switch over at PROPS_MORPH_THRESHOLD,
+// changed properties are sent on once per props_idle(_budget) and are not
+// logged in the history, returns their count
+static inline unsigned
+props_morph(props_t *props, uint32_t frames, unsigned from, unsigned to,
+	float ratio);
+
+// rt-safe, undo history in a caller-allocated ring of size bytes, changes are
+// logged as they are stashed, hence not in stash-less mode, changes within an
+// epoch are undone and redone together, buf == NULL: none
+static inline void
+props_history(props_t *props, void *buf, uint32_t size);
+
+// rt-safe, writer, undoes the newest group of changes, changed properties are
+// sent on, returns the number of changes undone
+static inline unsigned
+props_undo(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Ref *ref);
+
+// rt-safe, writer, redoes the oldest group of undone changes, returns the
+// number of changes redone
+static inline unsigned
+props_redo(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Ref *ref);
+
+// rt-safe
+static inline void
+props_epoch_begin(props_t *props);
+
+// rt-safe
+static inline void
+props_epoch_end(props_t *props);
+
 // rt-safe
 static inline LV2_URID
 props_map(props_t *props, const char *property);
@@ -193,7 +718,8 @@ props_map(props_t *props, const char *property);
 static inline const char *
 props_unmap(props_t *props, LV2_URID property);
 
-// non-rt
+// non-rt, saves the values as of their last stash when the dsp keeps an epoch
+// open for PROPS_SNAPSHOT_TIMEOUT
 static inline LV2_State_Status
 props_save(props_t *props, LV2_State_Store_Function store,
 	LV2_State_Handle state, uint32_t flags, const LV2_Feature *const *features);
@@ -214,372 +740,1778 @@ typedef enum _props_state_t {
 	PROP_STATE_RESTORE = 2
 } props_state_t;
 
-static inline void
-_props_impl_spin_lock(props_impl_t *impl, int from, int to)
-{
-	int expected = from;
-	const int desired = to;
+typedef enum _props_cache_state_t {
+	PROP_CACHE_IDLE    = 0,
+	PROP_CACHE_REQUEST = 1,
+	PROP_CACHE_BUSY    = 2
+} props_cache_state_t;
 
-	while(!atomic_compare_exchange_strong_explicit(&impl->state, &expected, desired,
-		memory_order_acquire, memory_order_acquire))
-	{
-		// spin
-	}
-}
+typedef enum _props_class_t {
+	PROP_CLASS_VAR     = 0, // variable size
+	PROP_CLASS_32      = 1, // Int, Float, Bool, URID
+	PROP_CLASS_64      = 2  // Long, Double
+} props_class_t;
 
 static inline bool
-_props_impl_try_lock(props_impl_t *impl, int from, int to)
+_props_flag(props_t *props, unsigned idx, props_flag_t flag)
 {
-	int expected = from;
-	const int desired = to;
+	return props->flags[flag][idx / 32] & (1U << (idx % 32));
+}
 
-	return atomic_compare_exchange_strong_explicit(&impl->state, &expected, desired,
-		memory_order_acquire, memory_order_acquire);
+static inline bool
+_props_impl_flag(props_t *props, const props_impl_t *impl, props_flag_t flag)
+{
+	return _props_flag(props, impl - props->impls, flag);
 }
 
 static inline void
-_props_impl_unlock(props_impl_t *impl, int to)
+_props_impl_flag_set(props_t *props, const props_impl_t *impl, props_flag_t flag,
+	bool on)
 {
-	atomic_store_explicit(&impl->state, to, memory_order_release);
+	const unsigned idx = impl - props->impls;
+	const uint32_t mask = 1U << (idx % 32);
+
+	if(on)
+		props->flags[flag][idx / 32] |= mask;
+	else
+		props->flags[flag][idx / 32] &= ~mask;
 }
 
+// changes are sent on for visible and subscribed properties only
 static inline bool
-_props_restoring_get(props_t *props)
+_props_impl_notify(props_t *props, const props_impl_t *impl)
 {
-	return atomic_exchange_explicit(&props->restoring, false, memory_order_acquire);
+	return !_props_impl_flag(props, impl, PROPS_FLAG_HIDDEN)
+		&& !_props_impl_flag(props, impl, PROPS_FLAG_MUTED);
 }
 
-static inline void
-_props_restoring_set(props_t *props)
+static inline props_shape_t *
+_props_impl_shape(props_t *props, const props_impl_t *impl)
 {
-	atomic_store_explicit(&props->restoring, true, memory_order_release);
+	return &props->shapes[impl - props->impls];
 }
 
+// fixed-size copies get inlined as plain register moves
 static inline void
-_props_qsort(props_impl_t *A, int n)
+_props_impl_copy(props_t *props, const props_impl_t *impl, void *dst,
+	const void *src, uint32_t size)
 {
-	if(n < 2)
-		return;
+	switch((props_class_t)_props_impl_shape(props, impl)->cls)
+	{
+		case PROP_CLASS_32:
+			if(size == sizeof(uint32_t))
+			{
+				memcpy(dst, src, sizeof(uint32_t));
+				return;
+			}
+			break;
+		case PROP_CLASS_64:
+			if(size == sizeof(uint64_t))
+			{
+				memcpy(dst, src, sizeof(uint64_t));
+				return;
+			}
+			break;
+		case PROP_CLASS_VAR:
+			break;
+	}
 
-	const props_impl_t *p = A;
+	memcpy(dst, src, size);
+}
 
-	int i = -1;
-	int j = n;
+static inline void *
+_props_impl_elem(props_t *props, const props_impl_t *impl, void *body, uint32_t idx)
+{
+	return (uint8_t *)body + idx*_props_impl_shape(props, impl)->stride;
+}
 
-	while(true)
-	{
-		do {
-			i += 1;
-		} while(A[i].property < p->property);
+// strided to strided, e.g. value to stash
+static inline void
+_props_impl_copy_array(props_t *props, const props_impl_t *impl, void *dst,
+	const void *src)
+{
+	const uint32_t count = _props_impl_shape(props, impl)->count;
 
-		do {
-			j -= 1;
-		} while(A[j].property > p->property);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		_props_impl_copy(props, impl, _props_impl_elem(props, impl, dst, i),
+			_props_impl_elem(props, impl, (void *)src, i), impl->value.size);
+	}
+}
 
-		if(i >= j)
-			break;
+// strided to densely packed, e.g. for state:save
+static inline void
+_props_impl_gather(props_t *props, const props_impl_t *impl, void *dst,
+	const void *src)
+{
+	const uint32_t count = _props_impl_shape(props, impl)->count;
 
-		const props_impl_t tmp = A[i];
-		A[i] = A[j];
-		A[j] = tmp;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		_props_impl_copy(props, impl, (uint8_t *)dst + i*impl->value.size,
+			_props_impl_elem(props, impl, (void *)src, i), impl->value.size);
 	}
-
-	_props_qsort(A, j + 1);
-	_props_qsort(A + j + 1, n - j - 1);
 }
 
-static inline props_impl_t *
-_props_impl_get(props_t *props, LV2_URID property)
+// densely packed to strided, e.g. from state:restore
+static inline void
+_props_impl_scatter(props_t *props, const props_impl_t *impl, void *dst,
+	const void *src, uint32_t n)
 {
-	props_impl_t *base = props->impls;
-
-	for(int N = props->nimpls, half; N > 1; N -= half)
+	for(uint32_t i = 0; i < n; i++)
 	{
-		half = N/2;
-		props_impl_t *dst = &base[half];
-		base = (dst->property > property) ? base : dst;
+		_props_impl_copy(props, impl, _props_impl_elem(props, impl, dst, i),
+			(const uint8_t *)src + i*impl->value.size, impl->value.size);
 	}
+}
 
-	return (base->property == property) ? base : NULL;
+static inline uint32_t *
+_props_impl_dirty(props_t *props, const props_impl_t *impl)
+{
+	return &props->dirty[(impl - props->impls)*PROPS_BITS(PROPS_ARRAY_MAX)];
 }
 
-static inline LV2_Atom_Forge_Ref
-_props_patch_set(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
-	props_impl_t *impl, int32_t sequence_num)
+static inline void
+_props_impl_mark(props_t *props, const props_impl_t *impl, uint32_t idx)
 {
-	LV2_Atom_Forge_Frame obj_frame;
+	_props_impl_dirty(props, impl)[idx / 32] |= 1U << (idx % 32);
+}
 
-	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+static inline void
+_props_impl_clean(props_t *props, const props_impl_t *impl)
+{
+	memset(_props_impl_dirty(props, impl), 0x0,
+		PROPS_BITS(PROPS_ARRAY_MAX)*sizeof(uint32_t));
+}
 
-	if(ref)
-		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.patch_set);
-	{
-		if(props->urid.subject) // is optional
-		{
-			if(ref)
-				ref = lv2_atom_forge_key(forge, props->urid.patch_subject);
-			if(ref)
-				ref = lv2_atom_forge_urid(forge, props->urid.subject);
-		}
+static inline bool
+_props_impl_marked(props_t *props, const props_impl_t *impl, uint32_t idx)
+{
+	return _props_impl_dirty(props, impl)[idx / 32] & (1U << (idx % 32));
+}
 
-		if(sequence_num) // is optional
-		{
-			if(ref)
-				ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
-			if(ref)
-				ref = lv2_atom_forge_int(forge, sequence_num);
-		}
+// only the spin policy has concurrent writers, the others get away with
+// plain loads and stores instead of read-modify-write operations
+static inline void
+_props_atomic_add(atomic_uint *obj, unsigned inc, memory_order order)
+{
+#if PROPS_THREADING == PROPS_THREADING_SPIN
+	atomic_fetch_add_explicit(obj, inc, order);
+#else
+	atomic_store_explicit(obj,
+		atomic_load_explicit(obj, memory_order_relaxed) + inc, order);
+#endif
+}
 
-		if(ref)
-			ref = lv2_atom_forge_key(forge, props->urid.patch_property);
-		if(ref)
-			ref = lv2_atom_forge_urid(forge, impl->property);
+static inline void
+_props_fence(memory_order order)
+{
+#if PROPS_THREADING == PROPS_THREADING_SINGLE
+	(void)order;
+#else
+	atomic_thread_fence(order);
+#endif
+}
 
-		if(ref)
-			lv2_atom_forge_key(forge, props->urid.patch_value);
-		if(ref)
-			ref = lv2_atom_forge_atom(forge, impl->value.size, impl->type);
-		if(ref)
-			ref = lv2_atom_forge_write(forge, impl->value.body, impl->value.size);
-	}
-	if(ref)
-		lv2_atom_forge_pop(forge, &obj_frame);
+static inline bool
+_props_impl_cas_weak(props_impl_t *impl, int from, int to)
+{
+#if PROPS_THREADING == PROPS_THREADING_SPIN
+	int expected = from; // reset per attempt, a failed CAS overwrites it
 
-	if(ref)
-		ref = lv2_atom_forge_frame_time(forge, frames);
-	if(ref)
-		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.state_StateChanged);
-	if(ref)
-		lv2_atom_forge_pop(forge, &obj_frame);
+	return atomic_compare_exchange_weak_explicit(&impl->sync->state, &expected, to,
+		memory_order_acquire, memory_order_relaxed);
+#else
+	if(atomic_load_explicit(&impl->sync->state, memory_order_relaxed) != from)
+		return false;
 
-	return ref;
+	atomic_store_explicit(&impl->sync->state, to, memory_order_relaxed);
+	return true;
+#endif
 }
 
-static inline LV2_Atom_Forge_Ref
-_props_patch_get(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
-	props_impl_t *impl, int32_t sequence_num)
+// takes the lock out of either unlocked state, returns the one it was taken
+// from, so a pending restore can be kept (or superseded) by the caller
+static inline int
+_props_impl_spin_lock(props_impl_t *impl, int to)
 {
-	LV2_Atom_Forge_Frame obj_frame;
-
-	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
-
-	if(ref)
-		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.patch_get);
+	while(true)
 	{
-		if(props->urid.subject) // is optional
-		{
-			if(ref)
-				ref = lv2_atom_forge_key(forge, props->urid.patch_subject);
-			if(ref)
-				ref = lv2_atom_forge_urid(forge, props->urid.subject);
-		}
+		if(_props_impl_cas_weak(impl, PROP_STATE_NONE, to))
+			return PROP_STATE_NONE;
 
-		if(sequence_num) // is optional
-		{
-			if(ref)
-				ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
-			if(ref)
-				ref = lv2_atom_forge_int(forge, sequence_num);
-		}
+		if(_props_impl_cas_weak(impl, PROP_STATE_RESTORE, to))
+			return PROP_STATE_RESTORE;
 
-		if(ref)
-			ref = lv2_atom_forge_key(forge, props->urid.patch_property);
-		if(ref)
-			ref = lv2_atom_forge_urid(forge, impl->property);
+		sched_yield(); // the dsp holds it, back off
 	}
-	if(ref)
-		lv2_atom_forge_pop(forge, &obj_frame);
-
-	return ref;
 }
 
-static inline LV2_Atom_Forge_Ref
-_props_patch_error(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
-	int32_t sequence_num)
+static inline bool
+_props_impl_try_lock(props_impl_t *impl, int from, int to)
 {
-	LV2_Atom_Forge_Frame obj_frame;
-
-	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+#if PROPS_THREADING == PROPS_THREADING_SPIN
+	int expected = from;
+	const int desired = to;
 
-	if(ref)
-		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.patch_error);
-	{
-		if(ref)
-			ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
-		if(ref)
-			ref = lv2_atom_forge_int(forge, sequence_num);
-	}
-	if(ref)
-		lv2_atom_forge_pop(forge, &obj_frame);
+	return atomic_compare_exchange_strong_explicit(&impl->sync->state, &expected, desired,
+		memory_order_acquire, memory_order_acquire);
+#else
+	if(atomic_load_explicit(&impl->sync->state, memory_order_relaxed) != from)
+		return false;
 
-	return ref;
+	atomic_store_explicit(&impl->sync->state, to, memory_order_relaxed);
+	return true;
+#endif
 }
 
-static inline LV2_Atom_Forge_Ref
-_props_patch_ack(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
-	int32_t sequence_num)
+static inline void
+_props_impl_unlock(props_impl_t *impl, int to)
 {
-	LV2_Atom_Forge_Frame obj_frame;
-
-	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+	atomic_store_explicit(&impl->sync->state, to, memory_order_release);
+}
 
-	if(ref)
-		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.patch_ack);
-	{
-		if(ref)
-			ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
-		if(ref)
-			ref = lv2_atom_forge_int(forge, sequence_num);
-	}
-	if(ref)
-		lv2_atom_forge_pop(forge, &obj_frame);
+static inline bool
+_props_restoring_get(props_t *props)
+{
+#if PROPS_THREADING == PROPS_THREADING_SPIN
+	return atomic_exchange_explicit(&props->restoring, false, memory_order_acquire);
+#else
+	if(!atomic_load_explicit(&props->restoring, memory_order_relaxed))
+		return false;
 
-	return ref;
+	atomic_store_explicit(&props->restoring, false, memory_order_relaxed);
+	return true;
+#endif
 }
 
 static inline void
-_props_impl_stash(props_t *props, props_impl_t *impl)
+_props_restoring_set(props_t *props)
 {
-	if(_props_impl_try_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK))
-	{
-		impl->stashing = false;
-		impl->stash.size = impl->value.size;
-		memcpy(impl->stash.body, impl->value.body, impl->value.size);
+	atomic_store_explicit(&props->restoring, true, memory_order_release);
+}
 
-		_props_impl_unlock(impl, PROP_STATE_NONE);
-	}
-	else
+static inline void
+_props_epoch_open(props_t *props)
+{
+	if(!props->inconsistent)
 	{
-		impl->stashing = true; // try again later
-		props->stashing = true;
+		props->inconsistent = true;
+		_props_atomic_add(&props->epoch, 1, memory_order_seq_cst); // odd: stash is being updated
 	}
 }
 
 static inline void
-_props_impl_restore(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
-	props_impl_t *impl, LV2_Atom_Forge_Ref *ref)
+_props_epoch_close(props_t *props)
 {
-	if(_props_impl_try_lock(impl, PROP_STATE_RESTORE, PROP_STATE_LOCK))
+	// deferred stashes keep their last value, catching up opens an epoch of its own
+	if(props->inconsistent)
 	{
-		impl->stashing = false; // makes no sense to stash a recently restored value
-		impl->value.size = impl->stash.size;
-		memcpy(impl->value.body, impl->stash.body, impl->stash.size);
+		props->inconsistent = false;
+		_props_atomic_add(&props->epoch, 1, memory_order_seq_cst); // even: stash is consistent
+	}
+}
 
-		_props_impl_unlock(impl, PROP_STATE_NONE);
+static inline void
+_props_epoch_begin(props_t *props)
+{
+	if(props->transactions++ == 0)
+		props->history.group++; // changes of an epoch are undone together
 
-		if(*ref && !impl->def->hidden)
-			*ref = _props_patch_set(props, forge, frames, impl, 0);
+	// epoch is opened lazily on first stash
+}
 
-		const props_def_t *def = impl->def;
-		if(def->event_cb)
-			def->event_cb(props->data, 0, impl);
-	}
+static inline void
+_props_epoch_end(props_t *props)
+{
+	if(props->transactions && (--props->transactions == 0))
+		_props_epoch_close(props);
 }
 
 static inline void
-_props_impl_set(props_t *props, props_impl_t *impl, LV2_URID type,
-	uint32_t size, const void *body)
+_props_cache_sync(props_cache_t *cache, props_cache_slot_t *slot)
 {
-	if(  (impl->type == type)
-		&& ( (impl->def->max_size == 0) || (size <= impl->def->max_size)) )
+	// a new buffer can only be swapped in after the last retired one was reclaimed
+	if(slot->current && atomic_load_explicit(&slot->retired, memory_order_acquire))
+		return;
+
+	props_cache_buf_t *buf = atomic_exchange_explicit(&slot->pending, NULL,
+		memory_order_acquire);
+
+	if(buf)
 	{
-		impl->value.size = size;
-		memcpy(impl->value.body, body, size);
+		if(slot->current)
+		{
+			atomic_store_explicit(&slot->retired, slot->current, memory_order_release);
+			atomic_store_explicit(&cache->working, true, memory_order_release);
+		}
 
-		_props_impl_stash(props, impl);
+		slot->current = buf;
 	}
 }
 
-static inline int
-_props_impl_init(props_t *props, props_impl_t *impl, const props_def_t *def,
-	void *value_base, void *stash_base, LV2_URID_Map *map)
+static inline const props_cache_buf_t *
+_props_cache_get(props_cache_t *cache, const char *path)
 {
-	if(!def->property || !def->type)
-		return 0;
+	props_cache_slot_t *victim = NULL;
 
-	const LV2_URID type = map->map(map->handle, def->type);
-	const LV2_URID property = map->map(map->handle, def->property);
-	const LV2_URID access = def->access
-		? map->map(map->handle, def->access)
-		: map->map(map->handle, LV2_PATCH__writable);
+	if(strlen(path) >= PROPS_CACHE_PATH_MAX)
+		return NULL; // too long to be cached
 
-	if(!type || !property || !access)
-		return 0;
+	for(unsigned i = 0; i < PROPS_CACHE_SLOTS; i++)
+	{
+		props_cache_slot_t *slot = &cache->slots[i];
 
-	impl->property = property;
-	impl->access = access;
-	impl->def = def;
-	impl->value.body = (uint8_t *)value_base + def->offset;
-	impl->stash.body = (uint8_t *)stash_base + def->offset;
+		_props_cache_sync(cache, slot);
 
-	uint32_t size;
-	if(  (type == props->urid.atom_int)
-		|| (type == props->urid.atom_float)
-		|| (type == props->urid.atom_bool)
-		|| (type == props->urid.atom_urid) )
-	{
-		size = 4;
-	}
-	else if((type == props->urid.atom_long)
-		|| (type == props->urid.atom_double) )
-	{
-		size = 8;
-	}
-	else if(type == props->urid.atom_literal)
-	{
-		size = sizeof(LV2_Atom_Literal_Body);
-	}
-	else if(type == props->urid.atom_vector)
-	{
-		size = sizeof(LV2_Atom_Vector_Body);
-	}
-	else if(type == props->urid.atom_object)
-	{
-		size = sizeof(LV2_Atom_Object_Body);
+		if(slot->current && !strcmp(slot->current->path, path))
+		{
+			slot->stamp = ++cache->clock;
+
+			return slot->current->body ? slot->current : NULL; // cache hit
+		}
+
+		if(  (atomic_load_explicit(&slot->state, memory_order_acquire) != PROP_CACHE_IDLE)
+			|| atomic_load_explicit(&slot->pending, memory_order_acquire) )
+		{
+			if(!strcmp(slot->path, path))
+				return NULL; // already in flight
+
+			continue; // cannot evict a slot the worker still owns
+		}
+
+		if(slot->current && atomic_load_explicit(&slot->retired, memory_order_acquire))
+			continue; // cannot retire yet another buffer
+
+		if(!victim || (slot->stamp < victim->stamp))
+			victim = slot;
 	}
-	else if(type == props->urid.atom_sequence)
+
+	if(victim)
 	{
-		size = sizeof(LV2_Atom_Sequence_Body);
+		if(victim->current)
+		{
+			atomic_store_explicit(&victim->retired, victim->current, memory_order_release);
+			victim->current = NULL;
+		}
+
+		strcpy(victim->path, path);
+		victim->stamp = ++cache->clock;
+
+		atomic_store_explicit(&victim->state, PROP_CACHE_REQUEST, memory_order_release);
+		atomic_store_explicit(&cache->working, true, memory_order_release);
 	}
-	else
+
+	return NULL; // cache miss
+}
+
+static inline void
+_props_cache_request(props_t *props, props_impl_t *impl)
+{
+	const char *path = (const char *)impl->value.body;
+
+	if(  props->cache
+		&& (impl->type == props->urid.atom_path)
+		&& impl->value.size
+		&& (path[impl->value.size - 1] == '\0') )
 	{
-		size = 0; // assume everything else as having size 0
+		_props_cache_get(props->cache, path);
 	}
+}
 
-	impl->type = type;
-	impl->value.size = size;
-	impl->stash.size = size;
+static inline props_cache_buf_t *
+_props_cache_load(const char *path)
+{
+	props_cache_buf_t *buf = (props_cache_buf_t *)calloc(1, sizeof(props_cache_buf_t));
+	if(!buf)
+		return NULL;
 
-	atomic_init(&impl->state, PROP_STATE_NONE);
+	strcpy(buf->path, path);
 
-	// update maximal value size
-	const uint32_t max_size = def->max_size
-		? def->max_size
-		: size;
+	const char *file = strstr(path, "file://") == path
+		? path + 7 // skip "file://"
+		: path;
 
-	if(max_size > props->max_size)
+	FILE *f = fopen(file, "rb");
+	if(!f)
+		return buf; // cache failure, too
+
+	if(!fseek(f, 0, SEEK_END))
 	{
-		props->max_size = max_size;
+		const long size = ftell(f);
+
+		if( (size >= 0) && (size < UINT32_MAX) && !fseek(f, 0, SEEK_SET) )
+		{
+			buf->body = (uint8_t *)malloc(size + 1);
+
+			if(buf->body)
+			{
+				if(fread(buf->body, 1, size, f) == (size_t)size)
+				{
+					buf->body[size] = '\0'; // for convenience
+					buf->size = size;
+				}
+				else
+				{
+					free(buf->body);
+					buf->body = NULL;
+				}
+			}
+		}
 	}
 
-	return 1;
+	fclose(f);
+
+	return buf;
 }
 
-static inline int
-props_init(props_t *props, const char *subject,
-	const props_def_t *defs, int nimpls,
-	void *value_base, void *stash_base,
-	LV2_URID_Map *map, void *data)
+static inline void
+_props_cache_free(props_cache_buf_t *buf)
 {
-	if(!props || !defs || !value_base || !stash_base || !map)
-		return 0;
+	if(buf)
+	{
+		free(buf->body);
+		free(buf);
+	}
+}
 
-	props->nimpls = nimpls;
-	props->data = data;
+static inline void *
+_props_pool_alloc(props_pool_t *pool, uint32_t size)
+{
+	unsigned cls = 0;
+	while( (cls < PROPS_POOL_CLASSES) && ((uint32_t)(PROPS_POOL_MIN << cls) < size) )
+		cls++;
 
-	props->urid.subject = subject ? map->map(map->handle, subject) : 0;
+	if(cls == PROPS_POOL_CLASSES)
+		return NULL; // too big
 
-	props->urid.patch_get = map->map(map->handle, LV2_PATCH__Get);
+	// try to recycle a block of this class first
+	uint64_t head = atomic_load_explicit(&pool->heads[cls], memory_order_acquire);
+	while(head & UINT32_MAX)
+	{
+		props_pool_blk_t *blk = (props_pool_blk_t *)(pool->base
+			+ ((head & UINT32_MAX) - 1) * 8);
+		const uint64_t next = ( ((head >> 32) + 1) << 32)
+			| atomic_load_explicit(&blk->next, memory_order_relaxed);
+
+		if(atomic_compare_exchange_weak_explicit(&pool->heads[cls], &head, next,
+			memory_order_acquire, memory_order_acquire))
+		{
+			return blk + 1;
+		}
+	}
+
+	// carve a fresh block
+	const size_t need = sizeof(props_pool_blk_t) + (PROPS_POOL_MIN << cls);
+	size_t used = atomic_load_explicit(&pool->used, memory_order_relaxed);
+	do
+	{
+		if(used + need > pool->size)
+			return NULL; // out-of-memory
+	} while(!atomic_compare_exchange_weak_explicit(&pool->used, &used, used + need,
+		memory_order_relaxed, memory_order_relaxed));
+
+	props_pool_blk_t *blk = (props_pool_blk_t *)(pool->base + used);
+	atomic_init(&blk->next, 0);
+	blk->cls = cls;
+
+	return blk + 1;
+}
+
+static inline void
+_props_pool_free(props_pool_t *pool, void *body)
+{
+	if(!body)
+		return;
+
+	props_pool_blk_t *blk = (props_pool_blk_t *)body - 1;
+	const uint64_t idx = ((uint8_t *)blk - pool->base) / 8 + 1;
+
+	uint64_t head = atomic_load_explicit(&pool->heads[blk->cls], memory_order_relaxed);
+	do
+	{
+		atomic_store_explicit(&blk->next, head & UINT32_MAX, memory_order_relaxed);
+	} while(!atomic_compare_exchange_weak_explicit(&pool->heads[blk->cls], &head,
+		( ((head >> 32) + 1) << 32) | idx, memory_order_release, memory_order_relaxed));
+}
+
+static inline uint32_t
+_props_pool_capacity(const void *body)
+{
+	const props_pool_blk_t *blk = (const props_pool_blk_t *)body - 1;
+
+	return PROPS_POOL_MIN << blk->cls;
+}
+
+// the stash's reference may only be synced with the stash locked
+static inline void
+_props_impl_ref_sync(props_t *props, props_impl_t *impl, bool stash)
+{
+	props_ref_t *ref = (props_ref_t *)((uint8_t *)props->value_base + impl->def->offset);
+	ref->size = impl->value.size;
+	ref->body = impl->value.body;
+
+	if(stash && props->stash_base)
+	{
+		ref = (props_ref_t *)((uint8_t *)props->stash_base + impl->def->offset);
+		ref->size = impl->stash.size;
+		ref->body = impl->stash.body;
+	}
+}
+
+static inline bool
+_props_impl_reserve(props_t *props, props_impl_t *impl, bool stash, uint32_t size)
+{
+	if(!_props_impl_flag(props, impl, PROPS_FLAG_POOLED))
+		return true; // reserved in plugin structure
+
+	void **body = stash
+		? &impl->stash.body
+		: &impl->value.body;
+
+	if(!props->pool)
+		return false;
+
+	if(*body && (_props_pool_capacity(*body) >= size))
+		return true;
+
+	void *fresh = _props_pool_alloc(props->pool, size);
+	if(!fresh)
+		return false;
+
+	_props_pool_free(props->pool, *body); // old content gets overwritten anyways
+	*body = fresh;
+
+	if(props->stashless)
+		impl->stash.body = impl->value.body;
+
+	return true;
+}
+
+static inline void
+_props_qsort(props_impl_t *A, int n)
+{
+	if(n < 2)
+		return;
+
+	const props_impl_t *p = A;
+
+	int i = -1;
+	int j = n;
+
+	while(true)
+	{
+		do {
+			i += 1;
+		} while(A[i].property < p->property);
+
+		do {
+			j -= 1;
+		} while(A[j].property > p->property);
+
+		if(i >= j)
+			break;
+
+		const props_impl_t tmp = A[i];
+		A[i] = A[j];
+		A[j] = tmp;
+	}
+
+	_props_qsort(A, j + 1);
+	_props_qsort(A + j + 1, n - j - 1);
+}
+
+static inline void
+_props_index(props_t *props)
+{
+	const unsigned nbits = PROPS_BITS(props->nimpls);
+	const uintptr_t align = sizeof(props_sync_t); // power of 2
+	const uintptr_t addr = (uintptr_t)&props->impls[props->nimpls];
+	props_sync_t *syncs = (props_sync_t *)((addr + align - 1) & ~(align - 1));
+	props_shape_t *shapes = (props_shape_t *)&syncs[props->nimpls];
+	uint32_t *dirty = (uint32_t *)&shapes[props->nimpls];
+	LV2_URID *keys = (LV2_URID *)&dirty[props->nimpls*PROPS_BITS(PROPS_ARRAY_MAX)];
+	uint32_t *bits = (uint32_t *)&keys[props->nimpls];
+
+	memset(bits, 0x0, PROPS_FLAG_MAX*nbits*sizeof(uint32_t));
+
+	props->shapes = shapes;
+	props->dirty = dirty;
+	props->keys = keys;
+	for(unsigned f = 0; f < PROPS_FLAG_MAX; f++)
+		props->flags[f] = &bits[f*nbits];
+
+	for(unsigned i = 0; i < props->nimpls; i++)
+	{
+		props_impl_t *impl = &props->impls[i];
+		const props_def_t *def = impl->def;
+		const uint32_t mask = 1U << (i % 32);
+
+		impl->sync = &syncs[i];
+		atomic_init(&impl->sync->state, PROP_STATE_NONE);
+		atomic_init(&impl->sync->version, 0);
+
+		keys[i] = impl->property;
+
+		if(def->hidden)
+			bits[PROPS_FLAG_HIDDEN*nbits + i/32] |= mask;
+		if(impl->access == props->urid.patch_readable)
+			bits[PROPS_FLAG_READABLE*nbits + i/32] |= mask;
+		if(def->event_cb)
+			bits[PROPS_FLAG_EVENT*nbits + i/32] |= mask;
+		if(def->pooled)
+			bits[PROPS_FLAG_POOLED*nbits + i/32] |= mask;
+		if(  !def->pooled
+			&& ( (impl->type == props->urid.atom_float)
+				|| ( !def->count
+					&& ( (impl->type == props->urid.atom_int)
+						|| (impl->type == props->urid.atom_long)
+						|| (impl->type == props->urid.atom_double)
+						|| (impl->type == props->urid.atom_vector) ) ) ) )
+		{
+			bits[PROPS_FLAG_NUMERIC*nbits + i/32] |= mask;
+		}
+	}
+}
+
+static inline props_impl_t *
+_props_impl_get(props_t *props, LV2_URID property)
+{
+	const LV2_URID *keys = props->keys;
+	const LV2_URID *base = keys;
+
+	if(!props->nimpls)
+		return NULL;
+
+	for(int N = props->nimpls, half; N > 1; N -= half)
+	{
+		half = N/2;
+		const LV2_URID *dst = &base[half];
+		base = (*dst > property) ? base : dst;
+	}
+
+	return (*base == property) ? &props->impls[base - keys] : NULL;
+}
+
+// props:index and patch:value as vectors of (changed) elements
+static inline LV2_Atom_Forge_Ref
+_props_patch_elements(props_t *props, LV2_Atom_Forge *forge,
+	props_impl_t *impl, bool changed)
+{
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+	const uint32_t *dirty = _props_impl_dirty(props, impl);
+	int32_t idxs [PROPS_ARRAY_MAX];
+	uint64_t elems [PROPS_ARRAY_MAX]; // elements are 4 or 8 bytes
+	uint32_t n = 0;
+	bool any = false;
+
+	for(unsigned i = 0; changed && (i < PROPS_BITS(shape->count)); i++)
+		any |= dirty[i] != 0;
+
+	for(uint32_t i = 0; i < shape->count; i++)
+	{
+		if(any && !_props_impl_marked(props, impl, i))
+			continue;
+
+		idxs[n] = i;
+		_props_impl_copy(props, impl, (uint8_t *)elems + n*impl->value.size,
+			_props_impl_elem(props, impl, impl->value.body, i), impl->value.size);
+		n++;
+	}
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_key(forge, props->urid.props_index);
+	if(ref)
+		ref = lv2_atom_forge_vector(forge, sizeof(int32_t), props->urid.atom_int,
+			n, idxs);
+	if(ref)
+		ref = lv2_atom_forge_key(forge, props->urid.patch_value);
+	if(ref)
+		ref = lv2_atom_forge_vector(forge, impl->value.size, impl->type,
+			n, elems);
+
+	return ref;
+}
+
+// whole value, arrays as atom:Vector
+static inline LV2_Atom_Forge_Ref
+_props_forge_value(props_t *props, LV2_Atom_Forge *forge, props_impl_t *impl)
+{
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+
+	if(shape->count)
+	{
+		uint64_t elems [PROPS_ARRAY_MAX]; // elements are 4 or 8 bytes
+
+		_props_impl_gather(props, impl, elems, impl->value.body);
+
+		return lv2_atom_forge_vector(forge, impl->value.size, impl->type,
+			shape->count, elems);
+	}
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_atom(forge, impl->value.size, impl->type);
+	if(ref)
+		ref = lv2_atom_forge_write(forge, impl->value.body, impl->value.size);
+
+	return ref;
+}
+
+// changed: arrays only send their elements marked as dirty, if any
+static inline LV2_Atom_Forge_Ref
+_props_patch_set(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	props_impl_t *impl, int32_t sequence_num, bool changed)
+{
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+	LV2_Atom_Forge_Frame obj_frame;
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+
+	if(ref)
+		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.patch_set);
+	{
+		if(props->urid.subject) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_subject);
+			if(ref)
+				ref = lv2_atom_forge_urid(forge, props->urid.subject);
+		}
+
+		if(sequence_num) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
+			if(ref)
+				ref = lv2_atom_forge_int(forge, sequence_num);
+		}
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_property);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, impl->property);
+
+		if(shape->count)
+		{
+			if(ref)
+				ref = _props_patch_elements(props, forge, impl, changed);
+		}
+		else
+		{
+			if(ref)
+				lv2_atom_forge_key(forge, props->urid.patch_value);
+			if(ref)
+				ref = _props_forge_value(props, forge, impl);
+		}
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	if(ref)
+		ref = lv2_atom_forge_frame_time(forge, frames);
+	if(ref)
+		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.state_StateChanged);
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	return ref;
+}
+
+#define _PROPS_PROPERTY_SIZE(SIZE) \
+	(sizeof(LV2_Atom_Property_Body) + lv2_atom_pad_size(SIZE))
+
+// upper bound of what _props_patch_set forges for a dump
+static inline uint32_t
+_props_patch_set_size(props_t *props, props_impl_t *impl, int32_t sequence_num)
+{
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+	uint32_t size = sizeof(LV2_Atom_Event) + sizeof(LV2_Atom_Object_Body)
+		+ _PROPS_PROPERTY_SIZE(sizeof(LV2_URID)); // patch:property
+
+	if(props->urid.subject)
+		size += _PROPS_PROPERTY_SIZE(sizeof(LV2_URID));
+	if(sequence_num)
+		size += _PROPS_PROPERTY_SIZE(sizeof(int32_t));
+
+	if(shape->count)
+	{
+		size += _PROPS_PROPERTY_SIZE(sizeof(LV2_Atom_Vector_Body)
+			+ shape->count*sizeof(int32_t));
+		size += _PROPS_PROPERTY_SIZE(sizeof(LV2_Atom_Vector_Body)
+			+ shape->count*impl->value.size);
+	}
+	else
+	{
+		size += _PROPS_PROPERTY_SIZE(impl->value.size);
+	}
+
+	// state:StateChanged
+	size += sizeof(LV2_Atom_Event) + sizeof(LV2_Atom_Object_Body);
+
+	return size;
+}
+
+#undef _PROPS_PROPERTY_SIZE
+
+static inline bool
+_props_impl_default(props_t *props, props_impl_t *impl)
+{
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+
+	if(!props->defaults_base || impl->def->pooled)
+		return false;
+
+	const uint8_t *body = (const uint8_t *)props->defaults_base + impl->def->offset;
+
+	if(shape->count)
+	{
+		for(uint32_t i = 0; i < shape->count; i++)
+		{
+			if(memcmp(_props_impl_elem(props, impl, impl->value.body, i),
+				body + i*shape->stride, impl->value.size))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	return (impl->value.size <= shape->max_size)
+		&& !memcmp(impl->value.body, body, impl->value.size);
+}
+
+// marks the start of a dump relative to defaults
+static inline LV2_Atom_Forge_Ref
+_props_patch_defaults(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	int32_t sequence_num)
+{
+	LV2_Atom_Forge_Frame obj_frame;
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+
+	if(ref)
+		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.patch_set);
+	{
+		if(props->urid.subject) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_subject);
+			if(ref)
+				ref = lv2_atom_forge_urid(forge, props->urid.subject);
+		}
+
+		if(sequence_num) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
+			if(ref)
+				ref = lv2_atom_forge_int(forge, sequence_num);
+		}
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_property);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, props->urid.props_defaults);
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_value);
+		if(ref)
+			ref = lv2_atom_forge_bool(forge, true);
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	return ref;
+}
+
+// whether a wildcard patch:Get sends this property on
+static inline bool
+_props_dump_visible(props_t *props, props_impl_t *impl)
+{
+	return !_props_impl_flag(props, impl, PROPS_FLAG_HIDDEN)
+		&& !(props->dump_defaults && _props_impl_default(props, impl));
+}
+
+// continue wildcard patch:Get, stops before a property would not fit
+static inline void
+_props_dump(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Ref *ref)
+{
+	unsigned n = 0;
+
+	while(*ref && (props->dump < props->nimpls))
+	{
+		props_impl_t *impl = &props->impls[props->dump];
+
+		if(_props_dump_visible(props, impl))
+		{
+#if PROPS_DUMP_MAX > 0
+			if(n >= PROPS_DUMP_MAX)
+				return; // resume on the next cycle
+#endif
+
+			// custom sinks have no buffer to check against
+			if(forge->buf)
+			{
+				const uint32_t size = _props_patch_set_size(props, impl, props->dump_seq);
+
+				if(sizeof(LV2_Atom_Sequence) + size > forge->size)
+				{
+					props->dump += 1; // would not even fit into an empty sequence, skip it
+					continue;
+				}
+
+				if(forge->offset + size > forge->size)
+					return; // resume on the next cycle
+			}
+
+			*ref = _props_patch_set(props, forge, frames, impl, props->dump_seq, false);
+			n += 1;
+		}
+
+		props->dump += 1;
+	}
+
+	if(props->dump == props->nimpls)
+		props->dumping = false;
+}
+
+// known and visible properties of a bulk message
+static inline props_impl_t *
+_props_bulk_impl(props_t *props, LV2_URID property)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(!impl || _props_impl_flag(props, impl, PROPS_FLAG_HIDDEN))
+		return NULL;
+
+	return impl;
+}
+
+// patch:property as atom:Vector of URIDs
+static inline LV2_Atom_Forge_Ref
+_props_forge_bulk_properties(props_t *props, LV2_Atom_Forge *forge,
+	const LV2_URID *properties, unsigned nproperties)
+{
+	const LV2_Atom_Vector_Body body = { sizeof(LV2_URID), props->urid.atom_urid };
+	uint32_t size = sizeof(body);
+
+	for(unsigned i = 0; i < nproperties; i++)
+	{
+		if(_props_bulk_impl(props, properties[i]))
+			size += sizeof(LV2_URID);
+	}
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_key(forge, props->urid.patch_property);
+	if(ref)
+		ref = lv2_atom_forge_atom(forge, size, props->urid.atom_vector);
+	if(ref)
+		ref = lv2_atom_forge_raw(forge, &body, sizeof(body));
+	for(unsigned i = 0; ref && (i < nproperties); i++)
+	{
+		if(_props_bulk_impl(props, properties[i]))
+			ref = lv2_atom_forge_raw(forge, &properties[i], sizeof(LV2_URID));
+	}
+	if(ref)
+		lv2_atom_forge_pad(forge, size);
+
+	return ref;
+}
+
+// patch:property as atom:Vector of URIDs, patch:value as atom:Tuple
+static inline LV2_Atom_Forge_Ref
+_props_patch_set_bulk(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	const LV2_URID *properties, unsigned nproperties, int32_t sequence_num)
+{
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Frame tup_frame;
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+
+	if(ref)
+		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.patch_set);
+	{
+		if(props->urid.subject) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_subject);
+			if(ref)
+				ref = lv2_atom_forge_urid(forge, props->urid.subject);
+		}
+
+		if(sequence_num) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
+			if(ref)
+				ref = lv2_atom_forge_int(forge, sequence_num);
+		}
+
+		if(ref)
+			ref = _props_forge_bulk_properties(props, forge, properties, nproperties);
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_value);
+		if(ref)
+			ref = lv2_atom_forge_tuple(forge, &tup_frame);
+		for(unsigned i = 0; ref && (i < nproperties); i++)
+		{
+			props_impl_t *impl = _props_bulk_impl(props, properties[i]);
+
+			if(impl)
+				ref = _props_forge_value(props, forge, impl);
+		}
+		if(ref)
+			lv2_atom_forge_pop(forge, &tup_frame);
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	if(ref)
+		ref = lv2_atom_forge_frame_time(forge, frames);
+	if(ref)
+		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.state_StateChanged);
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	return ref;
+}
+
+static inline LV2_Atom_Forge_Ref
+_props_patch_get(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	props_impl_t *impl, int32_t sequence_num)
+{
+	LV2_Atom_Forge_Frame obj_frame;
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+
+	if(ref)
+		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.patch_get);
+	{
+		if(props->urid.subject) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_subject);
+			if(ref)
+				ref = lv2_atom_forge_urid(forge, props->urid.subject);
+		}
+
+		if(sequence_num) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
+			if(ref)
+				ref = lv2_atom_forge_int(forge, sequence_num);
+		}
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_property);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, impl->property);
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	return ref;
+}
+
+static inline LV2_Atom_Forge_Ref
+_props_patch_get_bulk(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	const LV2_URID *properties, unsigned nproperties, int32_t sequence_num)
+{
+	LV2_Atom_Forge_Frame obj_frame;
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+
+	if(ref)
+		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.patch_get);
+	{
+		if(props->urid.subject) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_subject);
+			if(ref)
+				ref = lv2_atom_forge_urid(forge, props->urid.subject);
+		}
+
+		if(sequence_num) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
+			if(ref)
+				ref = lv2_atom_forge_int(forge, sequence_num);
+		}
+
+		if(ref)
+			ref = _props_forge_bulk_properties(props, forge, properties, nproperties);
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	return ref;
+}
+
+static inline LV2_Atom_Forge_Ref
+_props_patch_error(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	int32_t sequence_num)
+{
+	LV2_Atom_Forge_Frame obj_frame;
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+
+	if(ref)
+		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.patch_error);
+	{
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
+		if(ref)
+			ref = lv2_atom_forge_int(forge, sequence_num);
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	return ref;
+}
+
+static inline LV2_Atom_Forge_Ref
+_props_patch_ack(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	int32_t sequence_num)
+{
+	LV2_Atom_Forge_Frame obj_frame;
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+
+	if(ref)
+		ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.patch_ack);
+	{
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
+		if(ref)
+			ref = lv2_atom_forge_int(forge, sequence_num);
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	return ref;
+}
+
+static inline props_change_t *
+_props_change(props_t *props, uint32_t offset)
+{
+	return (props_change_t *)(props->history.buf + offset);
+}
+
+static inline uint32_t
+_props_change_size(uint32_t old_size, uint32_t new_size)
+{
+	return sizeof(props_change_t) + ((old_size + 7) & ~7U) + ((new_size + 7) & ~7U);
+}
+
+static inline uint8_t *
+_props_change_old(props_change_t *change)
+{
+	return (uint8_t *)&change[1];
+}
+
+static inline uint8_t *
+_props_change_new(props_change_t *change)
+{
+	return _props_change_old(change) + ((change->old_size + 7) & ~7U);
+}
+
+static inline void
+_props_history_drop(props_t *props)
+{
+	props_history_t *hist = &props->history;
+
+	if(hist->first == hist->last)
+	{
+		hist->first = PROPS_HISTORY_NONE;
+		hist->last = PROPS_HISTORY_NONE;
+		hist->cursor = PROPS_HISTORY_NONE;
+	}
+	else
+	{
+		hist->first = _props_change(props, hist->first)->next;
+		_props_change(props, hist->first)->prev = PROPS_HISTORY_NONE;
+	}
+}
+
+static inline void
+_props_history_record(props_t *props, props_impl_t *impl, uint32_t elem,
+	const void *old_body, uint32_t old_size, const void *new_body, uint32_t new_size)
+{
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+	props_history_t *hist = &props->history;
+	const uint32_t size = _props_change_size(old_size, new_size);
+
+	// undone changes cannot be redone anymore
+	hist->last = hist->cursor;
+	if(hist->last == PROPS_HISTORY_NONE)
+		hist->first = PROPS_HISTORY_NONE;
+	else
+		_props_change(props, hist->last)->next = PROPS_HISTORY_NONE;
+
+	if(size > hist->size) // nothing before this change can be undone
+	{
+		hist->first = PROPS_HISTORY_NONE;
+		hist->last = PROPS_HISTORY_NONE;
+		hist->cursor = PROPS_HISTORY_NONE;
+		return;
+	}
+
+	uint32_t pos = 0;
+	if(hist->last != PROPS_HISTORY_NONE)
+	{
+		props_change_t *last = _props_change(props, hist->last);
+
+		pos = hist->last + _props_change_size(last->old_size, last->new_size);
+	}
+
+	if(pos + size > hist->size) // wrap around, the end of the ring is given up
+	{
+		while( (hist->first != PROPS_HISTORY_NONE) && (hist->first >= pos) )
+			_props_history_drop(props);
+
+		pos = 0;
+	}
+
+	// overwrite the oldest changes
+	while( (hist->first != PROPS_HISTORY_NONE)
+		&& (hist->first >= pos) && (hist->first < pos + size) )
+	{
+		_props_history_drop(props);
+	}
+
+	props_change_t *change = _props_change(props, pos);
+
+	change->prev = hist->last;
+	change->next = PROPS_HISTORY_NONE;
+	change->group = shape->group; // as of the change, the stash may have been deferred
+	change->idx = impl - props->impls;
+	change->elem = elem;
+	change->old_size = old_size;
+	change->new_size = new_size;
+	change->pad = 0;
+	memcpy(_props_change_old(change), old_body, old_size);
+	memcpy(_props_change_new(change), new_body, new_size);
+
+	if(hist->last == PROPS_HISTORY_NONE)
+		hist->first = pos;
+	else
+		_props_change(props, hist->last)->next = pos;
+
+	hist->last = pos;
+	hist->cursor = pos;
+}
+
+// the stash still holds the value as of the last change, log what differs
+static inline void
+_props_history_diff(props_t *props, props_impl_t *impl)
+{
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+
+	if(shape->count)
+	{
+		for(uint32_t j = 0; j < shape->count; j++)
+		{
+			const void *old_body = _props_impl_elem(props, impl, impl->stash.body, j);
+			const void *new_body = _props_impl_elem(props, impl, impl->value.body, j);
+
+			if(memcmp(old_body, new_body, impl->value.size))
+			{
+				_props_history_record(props, impl, j, old_body, impl->value.size,
+					new_body, impl->value.size);
+			}
+		}
+	}
+	else if( (impl->stash.size != impl->value.size)
+		|| memcmp(impl->stash.body, impl->value.body, impl->value.size) )
+	{
+		_props_history_record(props, impl, 0, impl->stash.body, impl->stash.size,
+			impl->value.body, impl->value.size);
+	}
+}
+
+static inline void
+_props_impl_write_begin(props_t *props, props_impl_t *impl)
+{
+	if(props->stashless) // odd: value is being written to
+	{
+		_props_atomic_add(&impl->sync->version, 1, memory_order_relaxed);
+		_props_fence(memory_order_release);
+	}
+}
+
+static inline void
+_props_impl_write_end(props_t *props, props_impl_t *impl)
+{
+	if(props->stashless) // even: value is consistent
+	{
+		_props_atomic_add(&impl->sync->version, 1, memory_order_release);
+	}
+}
+
+// marks all properties derived from this one as stale
+static inline void
+_props_impl_invalidate(props_t *props, props_impl_t *impl)
+{
+	const unsigned nbits = PROPS_BITS(props->nderived);
+	const uint32_t *deps = &props->dependents[(impl - props->impls)*nbits];
+
+	for(unsigned d = 0; d < props->nderived; d++)
+	{
+		if(deps[d/32] & (1U << (d % 32)))
+		{
+			_props_impl_flag_set(props, &props->impls[props->derived[d]], PROPS_FLAG_STALE, true);
+			props->stale = true;
+		}
+	}
+}
+
+// stashes the value, logging the change under the group it was made in
+static inline void
+_props_impl_stash_grouped(props_t *props, props_impl_t *impl)
+{
+	props_shape_t *shape = _props_impl_shape(props, impl);
+
+	shape->stamp = ++props->stamp; // to be published
+
+	if(props->nderived)
+		_props_impl_invalidate(props, impl);
+
+	_props_epoch_open(props);
+
+	if(props->stashless)
+	{
+		// nothing to copy, just let the save thread know about the change
+		impl->stash.size = impl->value.size;
+		_props_atomic_add(&impl->sync->version, 2, memory_order_release);
+	}
+	else if(_props_impl_try_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK))
+	{
+		if(  props->history.buf && !props->history.paused
+			&& !_props_impl_flag(props, impl, PROPS_FLAG_POOLED) )
+		{
+			_props_history_diff(props, impl);
+		}
+
+		if(_props_impl_reserve(props, impl, true, impl->value.size))
+		{
+			_props_impl_flag_set(props, impl, PROPS_FLAG_STASHING, false);
+			impl->stash.size = impl->value.size;
+			if(shape->count)
+				_props_impl_copy_array(props, impl, impl->stash.body, impl->value.body);
+			else
+				_props_impl_copy(props, impl, impl->stash.body, impl->value.body, impl->value.size);
+			_props_atomic_add(&impl->sync->version, 1, memory_order_relaxed);
+		}
+		else
+		{
+			// pool exhausted, try again later
+			_props_impl_flag_set(props, impl, PROPS_FLAG_STASHING, true);
+			props->stashing = true;
+		}
+
+		if(_props_impl_flag(props, impl, PROPS_FLAG_POOLED))
+			_props_impl_ref_sync(props, impl, true);
+
+		_props_impl_unlock(impl, PROP_STATE_NONE);
+	}
+	else
+	{
+		// try again later
+		_props_impl_flag_set(props, impl, PROPS_FLAG_STASHING, true);
+		props->stashing = true;
+	}
+
+	if(_props_impl_flag(props, impl, PROPS_FLAG_POOLED))
+		_props_impl_ref_sync(props, impl, false); // stash synced above, if at all
+
+	if(props->transactions == 0)
+		_props_epoch_close(props);
+}
+
+static inline void
+_props_impl_stash(props_t *props, props_impl_t *impl)
+{
+	props_shape_t *shape = _props_impl_shape(props, impl);
+
+	if(  props->history.buf && !props->history.paused
+		&& (props->transactions == 0) ) // a change on its own
+	{
+		props->history.group++;
+	}
+
+	shape->group = props->history.group;
+
+	_props_impl_stash_grouped(props, impl);
+}
+
+static inline bool
+_props_impl_restore(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	props_impl_t *impl, LV2_Atom_Forge_Ref *ref, uint32_t *nbytes)
+{
+	props_shape_t *shape = _props_impl_shape(props, impl);
+
+	if(_props_impl_try_lock(impl, PROP_STATE_RESTORE, PROP_STATE_LOCK))
+	{
+		if(!_props_impl_reserve(props, impl, false, impl->stash.size))
+		{
+			_props_impl_unlock(impl, PROP_STATE_RESTORE); // pool exhausted, try again later
+			_props_restoring_set(props);
+
+			return false;
+		}
+
+		// makes no sense to stash a recently restored value
+		_props_impl_flag_set(props, impl, PROPS_FLAG_STASHING, false);
+		if(!props->stashless) // already written to value by props_restore
+		{
+			impl->value.size = impl->stash.size;
+			if(shape->count)
+				_props_impl_copy_array(props, impl, impl->value.body, impl->stash.body);
+			else
+				_props_impl_copy(props, impl, impl->value.body, impl->stash.body, impl->stash.size);
+		}
+		shape->stamp = ++props->stamp; // to be published
+
+		if(_props_impl_flag(props, impl, PROPS_FLAG_POOLED))
+			_props_impl_ref_sync(props, impl, true);
+
+		_props_impl_unlock(impl, PROP_STATE_NONE);
+
+		if(props->nderived)
+			_props_impl_invalidate(props, impl);
+
+		_props_cache_request(props, impl);
+
+		if(*ref && _props_impl_notify(props, impl))
+			*ref = _props_patch_set(props, forge, frames, impl, 0, false);
+
+		if(_props_impl_flag(props, impl, PROPS_FLAG_EVENT))
+			impl->def->event_cb(props->data, 0, impl);
+
+		*nbytes += shape->count
+			? shape->count*impl->value.size
+			: impl->value.size;
+
+		return true;
+	}
+
+	return false;
+}
+
+static inline uint32_t
+_props_type_size(props_t *props, LV2_URID type)
+{
+	if(  (type == props->urid.atom_int)
+		|| (type == props->urid.atom_float)
+		|| (type == props->urid.atom_bool)
+		|| (type == props->urid.atom_urid) )
+	{
+		return 4;
+	}
+	else if((type == props->urid.atom_long)
+		|| (type == props->urid.atom_double) )
+	{
+		return 8;
+	}
+	else if(type == props->urid.atom_literal)
+	{
+		return sizeof(LV2_Atom_Literal_Body);
+	}
+	else if(type == props->urid.atom_vector)
+	{
+		return sizeof(LV2_Atom_Vector_Body);
+	}
+	else if(type == props->urid.atom_object)
+	{
+		return sizeof(LV2_Atom_Object_Body);
+	}
+	else if(type == props->urid.atom_sequence)
+	{
+		return sizeof(LV2_Atom_Sequence_Body);
+	}
+
+	return 0; // assume everything else as having size 0
+}
+
+static inline uint32_t
+_props_def_max_size(props_t *props, const props_def_t *def, LV2_URID type)
+{
+	if(def->max_size)
+		return def->max_size;
+
+	return def->pooled
+		? PROPS_POOL_MAX
+		: _props_type_size(props, type);
+}
+
+static inline props_class_t
+_props_def_class(props_t *props, const props_def_t *def, LV2_URID type)
+{
+	const uint32_t max_size = _props_def_max_size(props, def, type);
+
+	if(def->pooled)
+		return PROP_CLASS_VAR;
+
+	if(  (max_size == sizeof(uint32_t))
+		&& ( (type == props->urid.atom_int)
+			|| (type == props->urid.atom_float)
+			|| (type == props->urid.atom_bool)
+			|| (type == props->urid.atom_urid) ) )
+	{
+		return PROP_CLASS_32;
+	}
+
+	if(  (max_size == sizeof(uint64_t))
+		&& ( (type == props->urid.atom_long)
+			|| (type == props->urid.atom_double) ) )
+	{
+		return PROP_CLASS_64;
+	}
+
+	return PROP_CLASS_VAR;
+}
+
+// returns whether the value has been taken over
+static inline bool
+_props_impl_set(props_t *props, props_impl_t *impl, LV2_URID type,
+	uint32_t size, const void *body)
+{
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+
+	if(  (impl->type != type)
+		|| (size > shape->max_size)
+		|| shape->count )
+	{
+		return false;
+	}
+
+	_props_impl_write_begin(props, impl);
+
+	const bool reserved = _props_impl_reserve(props, impl, false, size);
+	if(reserved)
+	{
+		impl->value.size = size;
+		_props_impl_copy(props, impl, impl->value.body, body, size);
+	}
+
+	_props_impl_write_end(props, impl);
+
+	_props_impl_stash(props, impl);
+
+	_props_cache_request(props, impl);
+
+	return reserved;
+}
+
+static inline const void *
+_props_vector_elems(props_t *props, const LV2_Atom *atom, LV2_URID child_type,
+	uint32_t child_size, uint32_t *n)
+{
+	const LV2_Atom_Vector *vec = (const LV2_Atom_Vector *)atom;
+
+	if(  (atom->type != props->urid.atom_vector)
+		|| (vec->body.child_type != child_type)
+		|| (vec->body.child_size != child_size) )
+	{
+		return NULL;
+	}
+
+	*n = (atom->size - sizeof(LV2_Atom_Vector_Body)) / child_size;
+
+	return &vec[1];
+}
+
+// index: single props:index Int with a scalar value or a props:index Vector
+// with a Vector of values, NULL for consecutive elements starting at 0
+static inline bool
+_props_impl_set_array(props_t *props, props_impl_t *impl,
+	const LV2_Atom *index, const LV2_Atom *value)
+{
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+	const uint32_t size = impl->value.size;
+	const int32_t *idxs = NULL;
+	const uint8_t *elems = NULL;
+	uint32_t n = 0;
+
+	if(index && (index->type == props->urid.atom_int))
+	{
+		if( (value->type != impl->type) || (value->size != size) )
+			return false;
+
+		idxs = &((const LV2_Atom_Int *)index)->body;
+		elems = (const uint8_t *)LV2_ATOM_BODY_CONST(value);
+		n = 1;
+	}
+	else
+	{
+		elems = (const uint8_t *)_props_vector_elems(props, value, impl->type, size, &n);
+		if(!elems)
+			return false;
+
+		if(index)
+		{
+			uint32_t nidxs = 0;
+
+			idxs = (const int32_t *)_props_vector_elems(props, index,
+				props->urid.atom_int, sizeof(int32_t), &nidxs);
+			if(!idxs || (nidxs != n))
+				return false;
+		}
+		else if(n > shape->count)
+		{
+			return false;
+		}
+	}
+
+	// all or nothing
+	for(uint32_t i = 0; idxs && (i < n); i++)
+	{
+		if( (idxs[i] < 0) || ((uint32_t)idxs[i] >= shape->count) )
+			return false;
+	}
+
+	_props_impl_write_begin(props, impl);
+
+	for(uint32_t i = 0; i < n; i++)
+	{
+		const uint32_t idx = idxs ? (uint32_t)idxs[i] : i;
+
+		_props_impl_copy(props, impl, _props_impl_elem(props, impl, impl->value.body, idx),
+			elems + i*size, size);
+		_props_impl_mark(props, impl, idx);
+	}
+
+	_props_impl_write_end(props, impl);
+
+	_props_impl_stash(props, impl);
+
+	return true;
+}
+
+static inline int
+_props_impl_init(props_t *props, props_impl_t *impl, const props_def_t *def,
+	void *value_base, void *stash_base, LV2_URID_Map *map)
+{
+	if(!def->property || !def->type)
+		return 0;
+
+	const LV2_URID type = map->map(map->handle, def->type);
+	const LV2_URID property = map->map(map->handle, def->property);
+	const LV2_URID access = def->access
+		? map->map(map->handle, def->access)
+		: map->map(map->handle, LV2_PATCH__writable);
+
+	if(!type || !property || !access)
+		return 0;
+
+	impl->property = property;
+	impl->access = access;
+	impl->def = def;
+	impl->value.body = (uint8_t *)value_base + def->offset;
+	impl->stash.body = stash_base // aliases value in stash-less mode
+		? (uint8_t *)stash_base + def->offset
+		: impl->value.body;
+
+	// pooled values get their memory with props_pool
+	const uint32_t size = def->pooled
+		? 0
+		: _props_type_size(props, type);
+
+	if(def->pooled)
+	{
+		impl->value.body = NULL;
+		impl->stash.body = NULL;
+	}
+
+	// arrays of fixed-size elements, saved as atom:Vector
+	if(  def->count
+		&& ( def->pooled || !size || (def->count > PROPS_ARRAY_MAX)
+			|| (def->stride && (def->stride < size)) ) )
+	{
+		return 0;
+	}
+
+	impl->type = type;
+	impl->value.size = size;
+	impl->stash.size = size;
+
+	return 1;
+}
+
+// after sorting, shapes are indexed like impls
+static inline void
+_props_impl_shape_init(props_t *props, props_impl_t *impl)
+{
+	const props_def_t *def = impl->def;
+	const uint32_t i = impl - props->impls;
+	props_shape_t *shape = &props->shapes[i];
+	const uint32_t size = impl->value.size; // per element
+
+	shape->max_size = def->count
+		? sizeof(LV2_Atom_Vector_Body) + def->count*size
+		: _props_def_max_size(props, def, impl->type);
+	shape->cls = _props_def_class(props, def, impl->type);
+	shape->count = def->count;
+	shape->stride = def->stride ? def->stride : size;
+	shape->group = 0;
+	_props_impl_clean(props, impl);
+
+	shape->stamp = 1; // publish initial values
+
+	// update maximal value size
+	const uint32_t max_size = shape->max_size;
+
+	if(max_size > props->max_size)
+	{
+		props->max_size = max_size;
+	}
+
+	props->sum_size += max_size;
+}
+
+// number of derived properties a derived property is transitively derived from
+static inline unsigned
+_props_graph_rank(const uint32_t *deps, unsigned nderived, const uint32_t *derived,
+	unsigned d)
+{
+	const unsigned nbits = PROPS_BITS(nderived);
+	unsigned rank = 0;
+
+	for(unsigned k = 0; k < nderived; k++)
+	{
+		if(deps[derived[k]*nbits + d/32] & (1U << (d % 32)))
+			rank += 1;
+	}
+
+	return rank;
+}
+
+static inline int
+props_init(props_t *props, const char *subject,
+	const props_def_t *defs, int nimpls,
+	void *value_base, void *stash_base,
+	LV2_URID_Map *map, void *data)
+{
+	if(!props || !defs || !value_base || !map)
+		return 0;
+
+#if PROPS_THREADING == PROPS_THREADING_LOCKFREE
+	stash_base = NULL; // writers never take a lock
+#endif
+
+	props->nimpls = nimpls;
+	props->stashless = !stash_base;
+	props->value_base = value_base;
+	props->stash_base = stash_base;
+	props->defaults_base = NULL;
+	props->pool = NULL;
+	props->data = data;
+
+	props->urid.subject = subject ? map->map(map->handle, subject) : 0;
+
+	props->urid.patch_get = map->map(map->handle, LV2_PATCH__Get);
 	props->urid.patch_set = map->map(map->handle, LV2_PATCH__Set);
 	props->urid.patch_put = map->map(map->handle, LV2_PATCH__Put);
 	props->urid.patch_patch = map->map(map->handle, LV2_PATCH__Patch);
@@ -596,389 +2528,1985 @@ props_init(props_t *props, const char *subject,
 	props->urid.patch_ack = map->map(map->handle, LV2_PATCH__Ack);
 	props->urid.patch_error = map->map(map->handle, LV2_PATCH__Error);
 
-	props->urid.atom_int = map->map(map->handle, LV2_ATOM__Int);
-	props->urid.atom_long = map->map(map->handle, LV2_ATOM__Long);
-	props->urid.atom_float = map->map(map->handle, LV2_ATOM__Float);
-	props->urid.atom_double = map->map(map->handle, LV2_ATOM__Double);
-	props->urid.atom_bool = map->map(map->handle, LV2_ATOM__Bool);
-	props->urid.atom_urid = map->map(map->handle, LV2_ATOM__URID);
-	props->urid.atom_path = map->map(map->handle, LV2_ATOM__Path);
-	props->urid.atom_literal = map->map(map->handle, LV2_ATOM__Literal);
-	props->urid.atom_vector = map->map(map->handle, LV2_ATOM__Vector);
-	props->urid.atom_object = map->map(map->handle, LV2_ATOM__Object);
-	props->urid.atom_sequence = map->map(map->handle, LV2_ATOM__Sequence);
+	props->urid.props_index = map->map(map->handle, LV2_PROPS__index);
+	props->urid.props_defaults = map->map(map->handle, LV2_PROPS__defaults);
+	props->urid.props_subscription = map->map(map->handle, LV2_PROPS__subscription);
+
+	props->urid.atom_int = map->map(map->handle, LV2_ATOM__Int);
+	props->urid.atom_long = map->map(map->handle, LV2_ATOM__Long);
+	props->urid.atom_float = map->map(map->handle, LV2_ATOM__Float);
+	props->urid.atom_double = map->map(map->handle, LV2_ATOM__Double);
+	props->urid.atom_bool = map->map(map->handle, LV2_ATOM__Bool);
+	props->urid.atom_urid = map->map(map->handle, LV2_ATOM__URID);
+	props->urid.atom_path = map->map(map->handle, LV2_ATOM__Path);
+	props->urid.atom_literal = map->map(map->handle, LV2_ATOM__Literal);
+	props->urid.atom_vector = map->map(map->handle, LV2_ATOM__Vector);
+	props->urid.atom_tuple = map->map(map->handle, LV2_ATOM__Tuple);
+	props->urid.atom_object = map->map(map->handle, LV2_ATOM__Object);
+	props->urid.atom_sequence = map->map(map->handle, LV2_ATOM__Sequence);
+
+	props->urid.state_StateChanged = map->map(map->handle, LV2_STATE__StateChanged);
+
+	atomic_init(&props->restoring, false);
+	props->sweeping = false;
+	props->cursor = 0;
+	props->dumping = false;
+	props->dump_defaults = false;
+	props->dump = 0;
+	props->dump_seq = 0;
+	atomic_init(&props->epoch, 0);
+	props->transactions = 0;
+	props->inconsistent = false;
+	props->max_size = 0;
+	props->sum_size = 0;
+	props->stamp = 1;
+	props->cache = NULL;
+	props->gens = NULL;
+	props->ngens = 0;
+	atomic_init(&props->gen, NULL);
+	props->slots = NULL;
+	props->nslots = 0;
+	atomic_init(&props->select, -1);
+	props->morphed = false;
+	props_history(props, NULL, 0);
+	props->history.group = 0;
+	props->history.paused = false;
+	props->reqs = NULL;
+	props->nreqs = 0;
+	props->sequence_num = 0;
+	props->frames = 0;
+	props->order = NULL;
+	props->derived = NULL;
+	props->nderived = 0;
+	props->dependents = NULL;
+	props->stale = false;
+
+	for(unsigned i = 0; i < props->nimpls; i++)
+	{
+		props_impl_t *impl = &props->impls[i];
+
+		if(!_props_impl_init(props, impl, &defs[i], value_base, stash_base, map))
+		{
+			props->nimpls = 0; // lookups find nothing instead of half-initialized impls
+			return 0;
+		}
+	}
+
+	_props_qsort(props->impls, props->nimpls);
+	_props_index(props);
+
+	for(unsigned i = 0; i < props->nimpls; i++)
+		_props_impl_shape_init(props, &props->impls[i]);
+
+	return 1;
+}
+
+static inline size_t
+props_size(int nimpls)
+{
+	const size_t size = offsetof(props_t, impls)
+		+ nimpls*sizeof(props_impl_t)
+		+ PROPS_INDEX_SIZE(nimpls);
+
+	return size < sizeof(props_t)
+		? sizeof(props_t)
+		: size;
+}
+
+static inline props_t *
+props_init_in(void *buffer, size_t size, const char *subject,
+	const props_def_t *defs, int nimpls,
+	void *value_base, void *stash_base,
+	LV2_URID_Map *map, void *data)
+{
+	if(  !buffer
+		|| ((uintptr_t)buffer % _Alignof(props_t))
+		|| (nimpls < 0)
+		|| (size < props_size(nimpls)) )
+	{
+		return NULL;
+	}
+
+	props_t *props = (props_t *)buffer;
+	memset(buffer, 0x0, size);
+
+	if(!props_init(props, subject, defs, nimpls, value_base, stash_base, map, data))
+		return NULL;
+
+	return props;
+}
+
+static inline void
+props_dyn(props_t *props, const props_dyn_t *dyn)
+{
+	props->dyn = dyn;
+}
+
+static inline void
+props_pool_init(props_pool_t *pool, void *buffer, size_t size)
+{
+	pool->base = (uint8_t *)buffer;
+	pool->size = size;
+	atomic_init(&pool->used, 0);
+
+	for(unsigned i = 0; i < PROPS_POOL_CLASSES; i++)
+		atomic_init(&pool->heads[i], 0);
+}
+
+static inline int
+props_pool(props_t *props, props_pool_t *pool)
+{
+	props->pool = pool;
+
+	for(unsigned i = 0; i < props->nimpls; i++)
+	{
+		props_impl_t *impl = &props->impls[i];
+
+		if(!_props_flag(props, i, PROPS_FLAG_POOLED) || impl->value.body)
+			continue;
+
+		const uint32_t size = _props_type_size(props, impl->type);
+
+		if(  !_props_impl_reserve(props, impl, false, size)
+			|| !_props_impl_reserve(props, impl, true, size) )
+		{
+			return 0;
+		}
+
+		impl->value.size = size;
+		impl->stash.size = size;
+		memset(impl->value.body, 0x0, size);
+		memset(impl->stash.body, 0x0, size);
+
+		_props_impl_ref_sync(props, impl, true);
+	}
+
+	return 1;
+}
+
+static inline void *
+props_reserve(props_t *props, LV2_URID property, uint32_t size)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(  !impl
+		|| _props_impl_shape(props, impl)->count
+		|| (impl->def->max_size && (size > impl->def->max_size))
+		|| !_props_impl_reserve(props, impl, false, size) )
+	{
+		return NULL;
+	}
+
+	impl->value.size = size;
+
+	if(_props_impl_flag(props, impl, PROPS_FLAG_POOLED))
+		_props_impl_ref_sync(props, impl, false); // stash is synced by props_set
+
+	return impl->value.body;
+}
+
+static inline void
+props_cache_init(props_cache_t *cache)
+{
+	memset((void *)cache, 0x0, sizeof(props_cache_t));
+
+	atomic_init(&cache->working, false);
+
+	for(unsigned i = 0; i < PROPS_CACHE_SLOTS; i++)
+	{
+		props_cache_slot_t *slot = &cache->slots[i];
+
+		atomic_init(&slot->state, PROP_CACHE_IDLE);
+		atomic_init(&slot->pending, NULL);
+		atomic_init(&slot->retired, NULL);
+	}
+}
+
+static inline void
+props_cache_deinit(props_cache_t *cache)
+{
+	for(unsigned i = 0; i < PROPS_CACHE_SLOTS; i++)
+	{
+		props_cache_slot_t *slot = &cache->slots[i];
+
+		_props_cache_free(atomic_exchange(&slot->pending, NULL));
+		_props_cache_free(atomic_exchange(&slot->retired, NULL));
+		_props_cache_free(slot->current);
+		slot->current = NULL;
+	}
+}
+
+static inline void
+props_cache(props_t *props, props_cache_t *cache)
+{
+	props->cache = cache;
+}
+
+static inline const props_cache_buf_t *
+props_cache_get(props_t *props, const char *path)
+{
+	if(!props->cache || !path)
+		return NULL;
+
+	return _props_cache_get(props->cache, path);
+}
+
+static inline bool
+props_cache_pending(props_t *props)
+{
+	if(!props->cache)
+		return false;
+
+	return atomic_exchange_explicit(&props->cache->working, false,
+		memory_order_acquire);
+}
+
+static inline void
+props_cache_work(props_cache_t *cache)
+{
+	for(unsigned i = 0; i < PROPS_CACHE_SLOTS; i++)
+	{
+		props_cache_slot_t *slot = &cache->slots[i];
+
+		// reclaim buffers the dsp has let go of
+		_props_cache_free(atomic_exchange_explicit(&slot->retired, NULL,
+			memory_order_acquire));
+
+		int expected = PROP_CACHE_REQUEST;
+		if(atomic_compare_exchange_strong_explicit(&slot->state, &expected,
+			PROP_CACHE_BUSY, memory_order_acquire, memory_order_acquire))
+		{
+			atomic_store_explicit(&slot->pending, _props_cache_load(slot->path),
+				memory_order_release);
+
+			atomic_store_explicit(&slot->state, PROP_CACHE_IDLE, memory_order_release);
+		}
+	}
+}
+
+// a property changed many times by props_morph is sent on only once
+static inline void
+_props_morph_notify(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Ref *ref)
+{
+	props->morphed = false;
+
+	for(unsigned i = 0; i < props->nimpls; i++)
+	{
+		props_impl_t *impl = &props->impls[i];
+
+		if(!_props_flag(props, i, PROPS_FLAG_MORPHED))
+			continue;
+
+		if(_props_impl_notify(props, impl))
+		{
+			if(*ref)
+				*ref = _props_patch_set(props, forge, frames, impl, 0, false);
+
+			if(!*ref)
+			{
+				props->morphed = true; // try again on the next cycle
+				continue;
+			}
+		}
+
+		_props_impl_flag_set(props, impl, PROPS_FLAG_MORPHED, false);
+	}
+}
+
+static inline bool
+props_idle_budget(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	unsigned max_props, uint32_t max_bytes, LV2_Atom_Forge_Ref *ref)
+{
+	_props_epoch_begin(props);
+
+	// a new sweep only starts after the ongoing one has been completed
+	if(props->sweeping || _props_restoring_get(props))
+	{
+		unsigned nprops = 0;
+		uint32_t nbytes = 0;
+
+		props->sweeping = true;
+
+		while(props->cursor < props->nimpls)
+		{
+			if(  (max_props && (nprops >= max_props))
+				|| (max_bytes && (nbytes >= max_bytes)) )
+			{
+				break; // resume on the next cycle
+			}
+
+			props_impl_t *impl = &props->impls[props->cursor++];
+
+			if(_props_impl_restore(props, forge, frames, impl, ref, &nbytes))
+				nprops += 1;
+		}
+
+		if(props->cursor == props->nimpls)
+		{
+			props->sweeping = false;
+			props->cursor = 0;
+		}
+	}
+
+	if(props->stashing)
+	{
+		props->stashing = false;
+
+		for(unsigned i = 0; i < props->nimpls; i++)
+		{
+			props_impl_t *impl = &props->impls[i];
+
+			if(_props_flag(props, i, PROPS_FLAG_STASHING))
+				_props_impl_stash_grouped(props, impl); // under the group of the original change
+		}
+	}
+
+	if(props->dumping)
+		_props_dump(props, forge, frames, ref);
+
+	if(props->morphed)
+		_props_morph_notify(props, forge, frames, ref);
+
+	const int slot = atomic_exchange_explicit(&props->select, -1, memory_order_acquire);
+	if(slot >= 0)
+		props_bank_recall(props, forge, frames, slot, ref);
+
+	if(props->stale) // e.g. after a restore
+		props_derive(props, forge, frames, ref);
+
+	_props_epoch_end(props);
+
+	return !props->sweeping;
+}
+
+static inline void
+props_idle(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Ref *ref)
+{
+	props_idle_budget(props, forge, frames, 0, 0, ref);
+}
+
+static inline int
+props_graph(props_t *props, void *buffer, size_t size)
+{
+	const unsigned nimpls = props->nimpls;
+	unsigned nderived = 0;
+
+	props->nderived = 0; // detached until resolved
+	props->stale = false;
+
+	for(unsigned i = 0; i < nimpls; i++)
+	{
+		props_impl_t *impl = &props->impls[i];
+
+		_props_impl_flag_set(props, impl, PROPS_FLAG_STALE, false);
+
+		if(impl->def->derive)
+			nderived += 1;
+	}
+
+	if(nderived == 0)
+		return 1; // nothing to resolve
+
+	if(  !buffer
+		|| ((uintptr_t)buffer % sizeof(uint32_t))
+		|| (size < PROPS_GRAPH_SIZE(nimpls, nderived)) )
+	{
+		return 0;
+	}
+
+	// only derived properties have dependencies, a bit per derived property
+	const unsigned nbits = PROPS_BITS(nderived);
+	uint32_t *order = (uint32_t *)buffer;
+	uint32_t *derived = &order[nderived];
+	uint32_t *deps = &derived[nderived];
+
+	memset(deps, 0x0, nimpls*nbits*sizeof(uint32_t));
+
+	for(unsigned i = 0, d = 0; i < nimpls; i++)
+	{
+		if(props->impls[i].def->derive)
+			derived[d++] = i;
+	}
+
+	for(unsigned d = 0; d < nderived; d++)
+	{
+		const props_def_t *def = props->impls[derived[d]].def;
+
+		for(const char *const *uri = def->depends; uri && *uri; uri++)
+		{
+			props_impl_t *src = _props_impl_get(props, props_map(props, *uri));
+
+			if(!src)
+				return 0;
+
+			deps[(src - props->impls)*nbits + d/32] |= 1U << (d % 32);
+		}
+	}
+
+	// transitive closure, only derived properties can be in between
+	for(unsigned k = 0; k < nderived; k++)
+	{
+		const uint32_t *via = &deps[derived[k]*nbits];
+
+		for(unsigned i = 0; i < nimpls; i++)
+		{
+			if(deps[i*nbits + k/32] & (1U << (k % 32)))
+			{
+				for(unsigned w = 0; w < nbits; w++)
+					deps[i*nbits + w] |= via[w];
+			}
+		}
+	}
+
+	for(unsigned d = 0; d < nderived; d++)
+	{
+		if(deps[derived[d]*nbits + d/32] & (1U << (d % 32)))
+			return 0; // derived from itself
+	}
+
+	// a property derived from another one has a higher rank
+	for(unsigned d = 0; d < nderived; d++)
+	{
+		const unsigned rank = _props_graph_rank(deps, nderived, derived, d);
+		unsigned o = d;
+
+		for( ; (o > 0)
+			&& (_props_graph_rank(deps, nderived, derived, order[o - 1]) > rank); o--)
+		{
+			order[o] = order[o - 1];
+		}
+		order[o] = d;
+	}
+
+	for(unsigned o = 0; o < nderived; o++)
+		order[o] = derived[order[o]];
+
+	props->order = order;
+	props->derived = derived;
+	props->dependents = deps;
+	props->nderived = nderived;
+
+	// all are stale at first
+	for(unsigned d = 0; d < nderived; d++)
+		_props_impl_flag_set(props, &props->impls[derived[d]], PROPS_FLAG_STALE, true);
+	props->stale = true;
+
+	return 1;
+}
+
+static inline unsigned
+props_derive(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Ref *ref)
+{
+	const bool paused = props->history.paused;
+	unsigned n = 0;
+
+	if(!props->stale)
+		return 0;
+
+	_props_epoch_begin(props);
+	props->history.paused = true;
+
+	for(unsigned o = 0; o < props->nderived; o++)
+	{
+		const unsigned j = props->order[o];
+		props_impl_t *impl = &props->impls[j];
+
+		if(!_props_flag(props, j, PROPS_FLAG_STALE))
+			continue;
+
+		_props_impl_flag_set(props, impl, PROPS_FLAG_STALE, false);
+
+		_props_impl_write_begin(props, impl);
+		impl->def->derive(props->data, impl);
+		_props_impl_write_end(props, impl);
+
+		_props_impl_stash(props, impl); // dependents come later in order
+
+		if(*ref && _props_impl_notify(props, impl))
+			*ref = _props_patch_set(props, forge, frames, impl, 0, false);
+
+		if(_props_impl_flag(props, impl, PROPS_FLAG_EVENT))
+			impl->def->event_cb(props->data, frames, impl);
+
+		n += 1;
+	}
+
+	// only what an event_cb has changed in the meantime is left
+	props->stale = false;
+	for(unsigned w = 0; w < PROPS_BITS(props->nimpls); w++)
+	{
+		if(props->flags[PROPS_FLAG_STALE][w])
+			props->stale = true;
+	}
+
+	props->history.paused = paused;
+	_props_epoch_end(props);
+
+	return n;
+}
+
+static inline unsigned
+props_idle_pending(props_t *props)
+{
+	if(props->sweeping)
+		return props->nimpls - props->cursor;
+
+	return atomic_load_explicit(&props->restoring, memory_order_relaxed)
+		? props->nimpls
+		: 0;
+}
+
+static inline void
+props_defaults(props_t *props, const void *defaults_base)
+{
+	props->defaults_base = defaults_base;
+}
+
+static inline bool
+props_default(props_t *props, LV2_URID property)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	return impl && _props_impl_default(props, impl);
+}
+
+static inline void
+props_subscribe(props_t *props, LV2_URID property, bool subscribed)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(impl)
+		_props_impl_flag_set(props, impl, PROPS_FLAG_MUTED, !subscribed);
+}
+
+static inline bool
+props_subscribed(props_t *props, LV2_URID property)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	return impl && !_props_impl_flag(props, impl, PROPS_FLAG_MUTED);
+}
+
+static inline unsigned
+props_dump_pending(props_t *props)
+{
+	unsigned n = 0;
+
+	if(props->dumping)
+	{
+		for(unsigned i = props->dump; i < props->nimpls; i++)
+		{
+			if(_props_dump_visible(props, &props->impls[i]))
+				n += 1;
+		}
+	}
+
+	return n;
+}
+
+// make sure that all properties lie within the object and are large enough
+// for their type, as the object size is the only thing we can trust in
+// messages from hosts and UIs
+static inline bool
+_props_object_check(props_t *props, const LV2_Atom_Object *obj)
+{
+	if(obj->atom.size < sizeof(LV2_Atom_Object_Body))
+		return false;
+
+	const uint8_t *end = (const uint8_t *)LV2_ATOM_BODY_CONST(&obj->atom)
+		+ obj->atom.size;
+
+	LV2_ATOM_OBJECT_FOREACH(obj, prop)
+	{
+		const uint8_t *value = (const uint8_t *)LV2_ATOM_BODY_CONST(&prop->value);
+
+		if(  ((const uint8_t *)prop + sizeof(LV2_Atom_Property_Body) > end) // header
+			|| (prop->value.size > (size_t)(end - value))
+			|| (prop->value.size < _props_type_size(props, prop->value.type)) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// outstanding request, otype and property are wildcards when 0
+static inline props_request_t *
+_props_request_find(props_t *props, int32_t sequence_num, LV2_URID otype,
+	LV2_URID property)
+{
+	for(unsigned i = 0; sequence_num && (i < props->nreqs); i++)
+	{
+		props_request_t *req = &props->reqs[i];
+
+		if(  (req->sequence_num == sequence_num)
+			&& (!otype || (req->otype == otype))
+			&& (!property || (req->property == property)) )
+		{
+			return req;
+		}
+	}
+
+	return NULL;
+}
+
+static inline props_request_t *
+_props_request_alloc(props_t *props, uint32_t frames, LV2_URID otype,
+	LV2_URID property, uint32_t timeout, props_request_cb_t cb, void *data)
+{
+	for(unsigned i = 0; i < props->nreqs; i++)
+	{
+		props_request_t *req = &props->reqs[i];
+
+		if(req->sequence_num)
+			continue; // in flight
+
+		// negative, as UIs number their messages upwards from 1, and never one
+		// that is still in flight
+		do
+		{
+			props->sequence_num = (props->sequence_num == -INT32_MAX)
+				? -1
+				: props->sequence_num - 1;
+		} while(_props_request_find(props, props->sequence_num, 0, 0));
+
+		req->sequence_num = props->sequence_num;
+		req->otype = otype;
+		req->property = property;
+		req->deadline = props->frames + frames + timeout;
+		req->cb = cb;
+		req->data = data;
+
+		return req;
+	}
+
+	return NULL; // table full
+}
+
+static inline int
+_props_request_complete(props_t *props, int32_t sequence_num,
+	props_request_status_t status)
+{
+	props_request_t *req = _props_request_find(props, sequence_num, 0, 0);
+
+	if(!req)
+		return 0;
+
+	// free the slot first, the callback may well issue the next request
+	const props_request_t done = *req;
+	req->sequence_num = 0;
+
+	if(done.cb)
+		done.cb(done.data, done.sequence_num, done.property, status);
+
+	return 1;
+}
+
+// patch:Set of props:subscription with patch:value as atom:Vector of the
+// URIDs to be notified or as atom:Bool for all or none of them
+static inline bool
+_props_subscribe(props_t *props, const LV2_Atom *value)
+{
+	if(value->type == props->urid.atom_bool)
+	{
+		if(value->size < sizeof(int32_t))
+			return false;
+
+		const bool on = ((const LV2_Atom_Bool *)value)->body;
+
+		for(unsigned i = 0; i < props->nimpls; i++)
+			_props_impl_flag_set(props, &props->impls[i], PROPS_FLAG_MUTED, !on);
+
+		return true;
+	}
+
+	uint32_t nproperties = 0;
+	const LV2_URID *properties = (const LV2_URID *)_props_vector_elems(props,
+		value, props->urid.atom_urid, sizeof(LV2_URID), &nproperties);
+
+	if(!properties)
+		return false;
+
+	for(unsigned i = 0; i < props->nimpls; i++)
+		_props_impl_flag_set(props, &props->impls[i], PROPS_FLAG_MUTED, true);
+
+	for(unsigned i = 0; i < nproperties; i++)
+	{
+		props_impl_t *impl = _props_impl_get(props, properties[i]);
+
+		if(impl)
+			_props_impl_flag_set(props, impl, PROPS_FLAG_MUTED, false);
+	}
+
+	return true;
+}
+
+// patch:Set with patch:property as atom:Vector of URIDs and patch:value as
+// atom:Tuple of matching values or as atom:Vector of same-typed values,
+// decoded in a single pass and sent on as a single patch:Set
+static inline int
+_props_set_bulk(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_URID subj, const LV2_URID *properties, uint32_t nproperties,
+	const LV2_Atom *value, int32_t sequence_num, LV2_Atom_Forge_Ref *ref)
+{
+	const LV2_Atom_Vector *vec = (const LV2_Atom_Vector *)value;
+	const uint8_t *body = (const uint8_t *)LV2_ATOM_BODY_CONST(value);
+	const bool tuple = (value->type == props->urid.atom_tuple);
+	uint32_t n = nproperties;
+
+	if(!tuple)
+	{
+		if( (value->type != props->urid.atom_vector) || !vec->body.child_size )
+		{
+			if(sequence_num && *ref)
+				*ref = _props_patch_error(props, forge, frames, sequence_num);
+
+			return 0;
+		}
+
+		const uint32_t nelems = (value->size - sizeof(LV2_Atom_Vector_Body))
+			/ vec->body.child_size;
+
+		if(nelems < n)
+			n = nelems;
+	}
+
+	size_t offset = 0;
+	for(uint32_t i = 0; i < n; i++)
+	{
+		const LV2_Atom *item = NULL;
+		const uint8_t *elem = NULL;
+
+		if(tuple) // each item must lie within the tuple
+		{
+			item = (const LV2_Atom *)(body + offset);
+
+			if(  (offset + sizeof(LV2_Atom) > value->size)
+				|| (item->size > value->size - offset - sizeof(LV2_Atom))
+				|| (item->size < _props_type_size(props, item->type)) )
+			{
+				n = i;
+				break;
+			}
+
+			offset += sizeof(LV2_Atom) + lv2_atom_pad_size(item->size);
+		}
+		else
+		{
+			elem = (const uint8_t *)&vec[1] + i*vec->body.child_size;
+		}
+
+		props_impl_t *impl = _props_impl_get(props, properties[i]);
+		if(impl)
+		{
+			if(item && _props_impl_shape(props, impl)->count)
+				_props_impl_set_array(props, impl, NULL, item);
+			else if(item)
+				_props_impl_set(props, impl, item->type, item->size,
+					LV2_ATOM_BODY_CONST(item));
+			else
+				_props_impl_set(props, impl, vec->body.child_type,
+					vec->body.child_size, elem);
+			_props_impl_clean(props, impl);
+
+			if(_props_impl_flag(props, impl, PROPS_FLAG_EVENT))
+				impl->def->event_cb(props->data, frames, impl);
+		}
+		else if(item && props->dyn && props->dyn->prop)
+		{
+			props->dyn->prop(props->data, PROPS_DYN_EV_SET, subj, properties[i], item);
+		}
+	}
+
+	// send on (e.g. to UI)
+	if(*ref)
+		*ref = _props_patch_set_bulk(props, forge, frames, properties, n, sequence_num);
+
+	if(sequence_num && *ref)
+		*ref = _props_patch_ack(props, forge, frames, sequence_num);
+
+	return 1;
+}
+
+static inline int
+_props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	const LV2_Atom_Object *obj, LV2_Atom_Forge_Ref *ref)
+{
+	if(  !lv2_atom_forge_is_object_type(forge, obj->atom.type)
+		|| !_props_object_check(props, obj) )
+	{
+		return 0;
+	}
+
+	if(obj->body.otype == props->urid.patch_get)
+	{
+		const LV2_Atom_URID *subject = NULL;
+		const LV2_Atom_URID *property = NULL;
+		const LV2_Atom_Int *sequence = NULL;
+		const LV2_Atom_Int *index = NULL;
+		const LV2_Atom_Bool *defaults = NULL;
+
+		lv2_atom_object_get(obj,
+			props->urid.patch_subject, &subject,
+			props->urid.patch_property, &property,
+			props->urid.patch_sequence, &sequence,
+			props->urid.props_index, &index,
+			props->urid.props_defaults, &defaults,
+			0);
+
+		// check for a matching optional subject
+		if(  (subject && props->urid.subject)
+			&& ( (subject->atom.type != props->urid.atom_urid)
+				|| (subject->body != props->urid.subject) ) )
+		{
+			return 0;
+		}
+
+		int32_t sequence_num = 0;
+		if(sequence && (sequence->atom.type == props->urid.atom_int))
+		{
+			sequence_num = sequence->body;
+		}
+
+		if(!property)
+		{
+			// a new wildcard patch:Get restarts an ongoing dump
+			props->dumping = true;
+			props->dump_defaults = props->defaults_base && defaults
+				&& (defaults->atom.type == props->urid.atom_bool) && defaults->body;
+			props->dump = 0;
+			props->dump_seq = sequence_num;
+
+			if(props->dump_defaults && *ref)
+				*ref = _props_patch_defaults(props, forge, frames, sequence_num);
+
+			_props_dump(props, forge, frames, ref);
+
+			return 1;
+		}
+		else if(property->atom.type == props->urid.atom_urid)
+		{
+			props_impl_t *impl = _props_impl_get(props, property->body);
+
+			if(impl)
+			{
+				const props_shape_t *shape = _props_impl_shape(props, impl);
+
+				// a single element of an array
+				const bool single = shape->count && index
+					&& (index->atom.type == props->urid.atom_int)
+					&& (index->body >= 0) && ((uint32_t)index->body < shape->count);
+
+				// reply with only the element, pending dsp-side marks stay
+				uint32_t dirty [PROPS_BITS(PROPS_ARRAY_MAX)];
+
+				if(single)
+				{
+					memcpy(dirty, _props_impl_dirty(props, impl), sizeof(dirty));
+					_props_impl_clean(props, impl);
+					_props_impl_mark(props, impl, index->body);
+				}
+
+				if(*ref && !_props_impl_flag(props, impl, PROPS_FLAG_HIDDEN))
+					*ref = _props_patch_set(props, forge, frames, impl, sequence_num, single);
+
+				if(single)
+					memcpy(_props_impl_dirty(props, impl), dirty, sizeof(dirty));
+
+				return 1;
+			}
+			else if(sequence_num)
+			{
+				if(*ref)
+					*ref = _props_patch_error(props, forge, frames, sequence_num);
+			}
+		}
+		else if(property->atom.type == props->urid.atom_vector) // bulk
+		{
+			uint32_t nproperties = 0;
+			const LV2_URID *properties = (const LV2_URID *)_props_vector_elems(props,
+				&property->atom, props->urid.atom_urid, sizeof(LV2_URID), &nproperties);
+
+			if(properties)
+			{
+				if(*ref)
+					*ref = _props_patch_set_bulk(props, forge, frames, properties,
+						nproperties, sequence_num);
+
+				return 1;
+			}
+			else if(sequence_num)
+			{
+				if(*ref)
+					*ref = _props_patch_error(props, forge, frames, sequence_num);
+			}
+		}
+		else if(sequence_num)
+		{
+			if(*ref)
+				*ref = _props_patch_error(props, forge, frames, sequence_num);
+		}
+	}
+	else if(obj->body.otype == props->urid.patch_set)
+	{
+		const LV2_Atom_URID *subject = NULL;
+		const LV2_Atom_URID *property = NULL;
+		const LV2_Atom_Int *sequence = NULL;
+		const LV2_Atom *value = NULL;
+		const LV2_Atom *index = NULL;
+
+		lv2_atom_object_get(obj,
+			props->urid.patch_subject, &subject,
+			props->urid.patch_property, &property,
+			props->urid.patch_sequence, &sequence,
+			props->urid.patch_value, &value,
+			props->urid.props_index, &index,
+			0);
+
+		// check for a matching optional subject
+		if(  (subject && props->urid.subject)
+			&& ( (subject->atom.type != props->urid.atom_urid)
+				|| (subject->body != props->urid.subject) ) )
+		{
+			return 0;
+		}
+
+		int32_t sequence_num = 0;
+		if(sequence && (sequence->atom.type == props->urid.atom_int))
+		{
+			sequence_num = sequence->body;
+		}
+
+		if(  property && value && (property->atom.type == props->urid.atom_urid)
+			&& (property->body == props->urid.props_subscription) )
+		{
+			const bool ok = _props_subscribe(props, value);
+
+			if(sequence_num)
+			{
+				if(*ref)
+					*ref = ok
+						? _props_patch_ack(props, forge, frames, sequence_num)
+						: _props_patch_error(props, forge, frames, sequence_num);
+			}
+
+			return ok;
+		}
+
+		if(property && value && (property->atom.type == props->urid.atom_vector)) // bulk
+		{
+			uint32_t nproperties = 0;
+			const LV2_URID *properties = (const LV2_URID *)_props_vector_elems(props,
+				&property->atom, props->urid.atom_urid, sizeof(LV2_URID), &nproperties);
+
+			if(properties)
+			{
+				const LV2_URID subj = (subject && (subject->atom.type == props->urid.atom_urid))
+					? subject->body
+					: 0;
+
+				return _props_set_bulk(props, forge, frames, subj,
+					properties, nproperties, value, sequence_num, ref);
+			}
+		}
+
+		if(!property || (property->atom.type != props->urid.atom_urid) || !value)
+		{
+			if(sequence_num)
+			{
+				if(ref)
+					*ref = _props_patch_error(props, forge, frames, sequence_num);
+			}
+
+			return 0;
+		}
+
+		// a reply to props_request_get is neither passed on with its sequence
+		// number nor acked, anything else with a (positive) number is
+		int32_t reply_num = 0;
+		if(  (sequence_num < 0)
+			&& _props_request_find(props, sequence_num, props->urid.patch_get, property->body) )
+		{
+			reply_num = sequence_num;
+			sequence_num = 0;
+		}
+
+		props_impl_t *impl = _props_impl_get(props, property->body);
+		if(impl)
+		{
+			if(_props_impl_shape(props, impl)->count)
+				_props_impl_set_array(props, impl, index, value);
+			else
+				_props_impl_set(props, impl, value->type, value->size,
+					LV2_ATOM_BODY_CONST(value));
+
+			// send on (e.g. to UI)
+			if(*ref && _props_impl_notify(props, impl))
+				*ref = _props_patch_set(props, forge, frames, impl, sequence_num, true);
+			_props_impl_clean(props, impl);
+
+			if(_props_impl_flag(props, impl, PROPS_FLAG_EVENT))
+				impl->def->event_cb(props->data, frames, impl);
+
+			if(sequence_num)
+			{
+				if(*ref)
+					*ref = _props_patch_ack(props, forge, frames, sequence_num);
+			}
+
+			if(reply_num)
+				_props_request_complete(props, reply_num, PROPS_REQUEST_VALUE);
+
+			return 1;
+		}
+		else if(props->dyn && props->dyn->prop)
+		{
+			const LV2_URID subj = subject ? subject->body : 0;
+
+			props->dyn->prop(props->data, PROPS_DYN_EV_SET, subj, property->body, value);
+
+			//TODO send ack
+		}
+		else if(sequence_num)
+		{
+			if(*ref)
+				*ref = _props_patch_error(props, forge, frames, sequence_num);
+		}
+	}
+	else if(obj->body.otype == props->urid.patch_put)
+	{
+		const LV2_Atom_URID *subject = NULL;
+		const LV2_Atom_Int *sequence = NULL;
+		const LV2_Atom_Object *body = NULL;
+
+		lv2_atom_object_get(obj,
+			props->urid.patch_subject, &subject,
+			props->urid.patch_sequence, &sequence,
+			props->urid.patch_body, &body,
+			0);
+
+		// check for a matching optional subject
+		if(  (subject && props->urid.subject)
+			&& ( (subject->atom.type != props->urid.atom_urid)
+				|| (subject->body != props->urid.subject) ) )
+		{
+			return 0;
+		}
+
+		int32_t sequence_num = 0;
+		if(sequence && (sequence->atom.type == props->urid.atom_int))
+		{
+			sequence_num = sequence->body;
+		}
+
+		if(  !body
+			|| !lv2_atom_forge_is_object_type(forge, body->atom.type)
+			|| !_props_object_check(props, body) )
+		{
+			if(sequence_num)
+			{
+				if(*ref)
+					*ref = _props_patch_error(props, forge, frames, sequence_num);
+			}
+
+			return 0;
+		}
+
+		LV2_ATOM_OBJECT_FOREACH(body, prop)
+		{
+			const LV2_URID property = prop->key;
+			const LV2_Atom *value = &prop->value;
+
+			props_impl_t *impl = _props_impl_get(props, property);
+			if(impl)
+			{
+				if(_props_impl_shape(props, impl)->count)
+					_props_impl_set_array(props, impl, NULL, value);
+				else
+					_props_impl_set(props, impl, value->type, value->size,
+						LV2_ATOM_BODY_CONST(value));
+
+				// send on (e.g. to UI)
+				if(*ref && _props_impl_notify(props, impl))
+					*ref = _props_patch_set(props, forge, frames, impl, sequence_num, true);
+				_props_impl_clean(props, impl);
+
+				if(_props_impl_flag(props, impl, PROPS_FLAG_EVENT))
+					impl->def->event_cb(props->data, frames, impl);
+			}
+			else if(props->dyn && props->dyn->prop)
+			{
+				const LV2_URID subj = subject ? subject->body : 0;
+
+				props->dyn->prop(props->data, PROPS_DYN_EV_SET, subj, property, value);
+
+			//TODO send ack
+			}
+		}
+
+		if(sequence_num)
+		{
+			if(*ref)
+				*ref = _props_patch_ack(props, forge, frames, sequence_num);
+		}
+
+		return 1;
+	}
+	else if( (obj->body.otype == props->urid.patch_ack)
+		|| (obj->body.otype == props->urid.patch_error) )
+	{
+		const LV2_Atom_Int *sequence = NULL;
+
+		lv2_atom_object_get(obj,
+			props->urid.patch_sequence, &sequence,
+			0);
+
+		if(!sequence || (sequence->atom.type != props->urid.atom_int))
+			return 0;
+
+		return _props_request_complete(props, sequence->body,
+			(obj->body.otype == props->urid.patch_ack)
+				? PROPS_REQUEST_ACK
+				: PROPS_REQUEST_ERROR);
+	}
+	else if(obj->body.otype == props->urid.patch_patch)
+	{
+		const LV2_Atom_URID *subject = NULL;
+		const LV2_Atom_Int *sequence = NULL;
+		const LV2_Atom_Object *add = NULL;
+		const LV2_Atom_Object *rem = NULL;
+
+		lv2_atom_object_get(obj,
+			props->urid.patch_subject, &subject,
+			props->urid.patch_sequence, &sequence,
+			props->urid.patch_add, &add,
+			props->urid.patch_remove, &rem,
+			0);
+
+		LV2_URID subj = 0;
+		if(subject && (subject->atom.type == props->urid.atom_urid))
+		{
+			subj = subject->body;
+		}
+
+		int32_t sequence_num = 0;
+		if(sequence && (sequence->atom.type == props->urid.atom_int))
+		{
+			sequence_num = sequence->body;
+		}
+
+		// nested objects only lie within the message, check their properties, too
+		if(  (rem && lv2_atom_forge_is_object_type(forge, rem->atom.type)
+				&& !_props_object_check(props, rem))
+			|| (add && lv2_atom_forge_is_object_type(forge, add->atom.type)
+				&& !_props_object_check(props, add)) )
+		{
+			if(sequence_num && *ref)
+			{
+				*ref = _props_patch_error(props, forge, frames, sequence_num);
+			}
+
+			return 0;
+		}
+
+		if(rem && lv2_atom_forge_is_object_type(forge, rem->atom.type))
+		{
+			LV2_ATOM_OBJECT_FOREACH(rem, prop)
+			{
+				const LV2_URID property = prop->key;
+				const LV2_Atom *value = &prop->value;
+
+				if(props->dyn && props->dyn->prop)
+				{
+					props->dyn->prop(props->data, PROPS_DYN_EV_REM, subj, property, value);
+				}
+			}
+		}
+
+		if(add && lv2_atom_forge_is_object_type(forge, add->atom.type))
+		{
+			LV2_ATOM_OBJECT_FOREACH(add, prop)
+			{
+				const LV2_URID property = prop->key;
+				const LV2_Atom *value = &prop->value;
+
+				if(props->dyn && props->dyn->prop)
+				{
+					props->dyn->prop(props->data, PROPS_DYN_EV_ADD, subj, property, value);
+				}
+			}
+		}
+
+		if(sequence_num && *ref)
+		{
+			*ref = _props_patch_ack(props, forge, frames, sequence_num);
+		}
+
+		return 1;
+	}
+
+	return 0; // did not handle a patch event
+}
+
+static inline int
+props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	const LV2_Atom_Object *obj, LV2_Atom_Forge_Ref *ref)
+{
+	// all properties changed by a single message are saved consistently
+	_props_epoch_begin(props);
+
+	const int handled = _props_advance(props, forge, frames, obj, ref);
+
+	_props_epoch_end(props);
+
+	return handled;
+}
+
+static inline void
+props_set(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_URID property, LV2_Atom_Forge_Ref *ref)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(impl)
+	{
+		_props_impl_stash(props, impl);
+
+		if(*ref && _props_impl_notify(props, impl)) // see props_request_set
+			*ref = _props_patch_set(props, forge, frames, impl, 0, true);
+		_props_impl_clean(props, impl);
+	}
+}
+
+static inline void
+props_get(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_URID property, LV2_Atom_Forge_Ref *ref)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(impl)
+	{
+		if(*ref && !_props_impl_flag(props, impl, PROPS_FLAG_HIDDEN)) // see props_request_get
+			*ref = _props_patch_get(props, forge, frames, impl, 0);
+	}
+}
+
+static inline void
+props_set_bulk(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	const LV2_URID *properties, unsigned nproperties, LV2_Atom_Forge_Ref *ref)
+{
+	for(unsigned i = 0; i < nproperties; i++)
+	{
+		props_impl_t *impl = _props_impl_get(props, properties[i]);
+
+		if(impl)
+		{
+			_props_impl_stash(props, impl);
+			_props_impl_clean(props, impl);
+		}
+	}
+
+	if(*ref)
+		*ref = _props_patch_set_bulk(props, forge, frames, properties, nproperties, 0);
+}
+
+static inline void
+props_get_bulk(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	const LV2_URID *properties, unsigned nproperties, LV2_Atom_Forge_Ref *ref)
+{
+	if(*ref)
+		*ref = _props_patch_get_bulk(props, forge, frames, properties, nproperties, 0);
+}
+
+static inline void
+props_requests(props_t *props, props_request_t *reqs, unsigned nreqs)
+{
+	for(unsigned i = 0; i < nreqs; i++)
+		reqs[i].sequence_num = 0;
+
+	props->reqs = reqs;
+	props->nreqs = nreqs;
+}
+
+static inline int32_t
+props_request_set(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_URID property, uint32_t timeout, props_request_cb_t cb, void *data,
+	LV2_Atom_Forge_Ref *ref)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(!impl || !*ref)
+		return 0;
+
+	props_request_t *req = _props_request_alloc(props, frames,
+		props->urid.patch_set, property, timeout, cb, data);
+
+	if(!req)
+		return 0;
+
+	_props_impl_stash(props, impl);
+
+	*ref = _props_patch_set(props, forge, frames, impl, req->sequence_num, true);
+	_props_impl_clean(props, impl);
+
+	if(!*ref) // never sent
+	{
+		req->sequence_num = 0;
+		return 0;
+	}
+
+	return req->sequence_num;
+}
+
+static inline int32_t
+props_request_get(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_URID property, uint32_t timeout, props_request_cb_t cb, void *data,
+	LV2_Atom_Forge_Ref *ref)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(!impl || !*ref)
+		return 0;
+
+	props_request_t *req = _props_request_alloc(props, frames,
+		props->urid.patch_get, property, timeout, cb, data);
+
+	if(!req)
+		return 0;
+
+	*ref = _props_patch_get(props, forge, frames, impl, req->sequence_num);
+
+	if(!*ref) // never sent
+	{
+		req->sequence_num = 0;
+		return 0;
+	}
 
-	props->urid.state_StateChanged = map->map(map->handle, LV2_STATE__StateChanged);
+	return req->sequence_num;
+}
 
-	atomic_init(&props->restoring, false);
+static inline void
+props_tick(props_t *props, uint32_t nframes)
+{
+	props->frames += nframes;
 
-	int status = 1;
-	for(unsigned i = 0; i < props->nimpls; i++)
+	for(unsigned i = 0; i < props->nreqs; i++)
 	{
-		props_impl_t *impl = &props->impls[i];
+		props_request_t *req = &props->reqs[i];
 
-		status = status
-			&& _props_impl_init(props, impl, &defs[i], value_base, stash_base, map);
+		if(req->sequence_num && (req->deadline <= props->frames))
+			_props_request_complete(props, req->sequence_num, PROPS_REQUEST_TIMEOUT);
 	}
+}
 
-	_props_qsort(props->impls, props->nimpls);
+static inline void
+props_stash(props_t *props, LV2_URID property)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
 
-	return status;
+	if(impl)
+		_props_impl_stash(props, impl);
 }
 
 static inline void
-props_dyn(props_t *props, const props_dyn_t *dyn)
+props_dirty(props_t *props, LV2_URID property, uint32_t index)
 {
-	props->dyn = dyn;
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(impl && (index < _props_impl_shape(props, impl)->count))
+		_props_impl_mark(props, impl, index);
+}
+
+static inline void *
+props_element(props_t *props, LV2_URID property, uint32_t index)
+{
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(!impl || (index >= _props_impl_shape(props, impl)->count))
+		return NULL;
+
+	return _props_impl_elem(props, impl, impl->value.body, index);
 }
 
 static inline void
-props_idle(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
-	LV2_Atom_Forge_Ref *ref)
+props_generations(props_t *props, props_gen_t *gens, unsigned ngens)
+{
+	for(unsigned i = 0; i < ngens; i++)
+	{
+		props_gen_t *gen = &gens[i];
+
+		gen->stamp = 0;
+		atomic_init(&gen->readers, 0);
+	}
+
+	props->gens = gens;
+	props->ngens = ngens;
+	atomic_store(&props->gen, NULL);
+}
+
+static inline bool
+props_publish(props_t *props)
 {
-	if(_props_restoring_get(props))
+	props_gen_t *cur = atomic_load_explicit(&props->gen, memory_order_relaxed);
+
+	if(cur && (cur->stamp == props->stamp))
+		return true; // nothing changed since last publication
+
+	for(unsigned g = 0; g < props->ngens; g++)
 	{
+		props_gen_t *gen = &props->gens[g];
+
+		if( (gen == cur) || (atomic_load(&gen->readers) != 0) )
+			continue; // still in use
+
+		// bring generation up-to-date with only what has changed since
 		for(unsigned i = 0; i < props->nimpls; i++)
 		{
 			props_impl_t *impl = &props->impls[i];
 
-			_props_impl_restore(props, forge, frames, impl, ref);
+			if(_props_flag(props, i, PROPS_FLAG_POOLED))
+				continue; // not part of the value structure
+
+			if(props->shapes[i].stamp > gen->stamp)
+			{
+				void *dst = (uint8_t *)gen->base + impl->def->offset;
+
+				if(props->shapes[i].count)
+					_props_impl_copy_array(props, impl, dst, impl->value.body);
+				else
+					memcpy(dst, impl->value.body, impl->value.size);
+			}
 		}
+
+		gen->stamp = props->stamp;
+		atomic_store(&props->gen, gen);
+
+		return true;
 	}
 
-	if(props->stashing)
+	return false; // all generations still in use, try again next cycle
+}
+
+static inline const void *
+props_acquire(props_t *props, props_gen_t **gen)
+{
+	while(true)
 	{
-		props->stashing = false;
+		props_gen_t *cur = atomic_load(&props->gen);
 
-		for(unsigned i = 0; i < props->nimpls; i++)
+		if(!cur)
 		{
-			props_impl_t *impl = &props->impls[i];
+			*gen = NULL;
+			return NULL; // nothing published yet
+		}
 
-			if(impl->stashing)
-				_props_impl_stash(props, impl);
+		atomic_fetch_add(&cur->readers, 1);
+
+		// only retries when the writer published in between
+		if(atomic_load(&props->gen) == cur)
+		{
+			*gen = cur;
+			return cur->base;
 		}
+
+		atomic_fetch_sub(&cur->readers, 1);
 	}
 }
 
-static inline int
-props_advance(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
-	const LV2_Atom_Object *obj, LV2_Atom_Forge_Ref *ref)
+static inline void
+props_release(props_t *props __attribute__((unused)), props_gen_t *gen)
+{
+	if(gen)
+		atomic_fetch_sub_explicit(&gen->readers, 1, memory_order_release);
+}
+
+static inline void
+props_bank(props_t *props, props_slot_t *slots, unsigned nslots)
+{
+	for(unsigned s = 0; s < nslots; s++)
+		slots[s].stored = false;
+
+	props->slots = slots;
+	props->nslots = nslots;
+	atomic_store(&props->select, -1);
+}
+
+// variable-sized values need their size stored along
+static inline bool
+_props_bank_skip(props_t *props, const props_slot_t *slot, unsigned i)
 {
-	if(!lv2_atom_forge_is_object_type(forge, obj->atom.type))
+	const props_shape_t *shape = &props->shapes[i];
+
+	return _props_flag(props, i, PROPS_FLAG_POOLED) // not part of the value structure
+		|| (!slot->sizes && !shape->count && (shape->cls == PROP_CLASS_VAR));
+}
+
+static inline bool
+props_bank_store(props_t *props, unsigned s)
+{
+	if(s >= props->nslots)
+		return false;
+
+	props_slot_t *slot = &props->slots[s];
+
+	for(unsigned i = 0; i < props->nimpls; i++)
 	{
-		return 0;
+		props_impl_t *impl = &props->impls[i];
+
+		if(_props_bank_skip(props, slot, i))
+			continue;
+
+		void *dst = (uint8_t *)slot->base + impl->def->offset;
+
+		if(props->shapes[i].count)
+			_props_impl_copy_array(props, impl, dst, impl->value.body);
+		else
+			memcpy(dst, impl->value.body, impl->value.size);
+
+		if(slot->sizes)
+			slot->sizes[i] = impl->value.size;
 	}
 
-	if(obj->body.otype == props->urid.patch_get)
-	{
-		const LV2_Atom_URID *subject = NULL;
-		const LV2_Atom_URID *property = NULL;
-		const LV2_Atom_Int *sequence = NULL;
+	slot->stored = true;
 
-		lv2_atom_object_get(obj,
-			props->urid.patch_subject, &subject,
-			props->urid.patch_property, &property,
-			props->urid.patch_sequence, &sequence,
-			0);
+	return true;
+}
 
-		// check for a matching optional subject
-		if(  (subject && props->urid.subject)
-			&& ( (subject->atom.type != props->urid.atom_urid)
-				|| (subject->body != props->urid.subject) ) )
-		{
-			return 0;
-		}
+// changes a property to its value in a slot, returns whether it differed
+static inline bool
+_props_bank_apply(props_t *props, const props_slot_t *slot, unsigned i)
+{
+	props_impl_t *impl = &props->impls[i];
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+	const uint8_t *src = (const uint8_t *)slot->base + impl->def->offset;
 
-		int32_t sequence_num = 0;
-		if(sequence && (sequence->atom.type == props->urid.atom_int))
+	if(shape->count)
+	{
+		bool same = true;
+
+		for(uint32_t j = 0; same && (j < shape->count); j++)
 		{
-			sequence_num = sequence->body;
+			same = !memcmp(_props_impl_elem(props, impl, impl->value.body, j),
+				src + j*shape->stride, impl->value.size);
 		}
 
-		if(!property)
-		{
-			for(unsigned i = 0; i < props->nimpls; i++)
-			{
-				props_impl_t *impl = &props->impls[i];
+		if(same)
+			return false;
 
-				if(*ref && !impl->def->hidden)
-					*ref = _props_patch_set(props, forge, frames, impl, sequence_num);
-			}
+		_props_impl_write_begin(props, impl);
+		_props_impl_copy_array(props, impl, impl->value.body, src);
+		_props_impl_write_end(props, impl);
 
-			return 1;
-		}
-		else if(property->atom.type == props->urid.atom_urid)
-		{
-			props_impl_t *impl = _props_impl_get(props, property->body);
+		_props_impl_stash(props, impl);
+	}
+	else
+	{
+		const uint32_t size = slot->sizes
+			? slot->sizes[i]
+			: impl->value.size;
 
-			if(impl)
-			{
-				if(*ref && !impl->def->hidden)
-					*ref = _props_patch_set(props, forge, frames, impl, sequence_num);
+		if( (size == impl->value.size) && !memcmp(impl->value.body, src, size) )
+			return false;
 
-				return 1;
-			}
-			else if(sequence_num)
-			{
-				if(*ref)
-					*ref = _props_patch_error(props, forge, frames, sequence_num);
-			}
-		}
-		else if(sequence_num)
-		{
-			if(*ref)
-				*ref = _props_patch_error(props, forge, frames, sequence_num);
-		}
+		return _props_impl_set(props, impl, impl->type, size, src);
 	}
-	else if(obj->body.otype == props->urid.patch_set)
+
+	return true;
+}
+
+static inline unsigned
+props_bank_recall(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	unsigned s, LV2_Atom_Forge_Ref *ref)
+{
+	if( (s >= props->nslots) || !props->slots[s].stored )
+		return 0;
+
+	props_slot_t *slot = &props->slots[s];
+	unsigned n = 0;
+
+	_props_epoch_begin(props);
+
+	for(unsigned i = 0; i < props->nimpls; i++)
 	{
-		const LV2_Atom_URID *subject = NULL;
-		const LV2_Atom_URID *property = NULL;
-		const LV2_Atom_Int *sequence = NULL;
-		const LV2_Atom *value = NULL;
+		props_impl_t *impl = &props->impls[i];
 
-		lv2_atom_object_get(obj,
-			props->urid.patch_subject, &subject,
-			props->urid.patch_property, &property,
-			props->urid.patch_sequence, &sequence,
-			props->urid.patch_value, &value,
-			0);
+		if(_props_bank_skip(props, slot, i))
+			continue;
 
-		// check for a matching optional subject
-		if(  (subject && props->urid.subject)
-			&& ( (subject->atom.type != props->urid.atom_urid)
-				|| (subject->body != props->urid.subject) ) )
-		{
-			return 0;
-		}
+		if(!_props_bank_apply(props, slot, i))
+			continue;
 
-		int32_t sequence_num = 0;
-		if(sequence && (sequence->atom.type == props->urid.atom_int))
-		{
-			sequence_num = sequence->body;
-		}
+		if(*ref && _props_impl_notify(props, impl))
+			*ref = _props_patch_set(props, forge, frames, impl, 0, false);
 
-		if(!property || (property->atom.type != props->urid.atom_urid) || !value)
-		{
-			if(sequence_num)
-			{
-				if(ref)
-					*ref = _props_patch_error(props, forge, frames, sequence_num);
-			}
+		if(_props_impl_flag(props, impl, PROPS_FLAG_EVENT))
+			impl->def->event_cb(props->data, frames, impl);
 
-			return 0;
-		}
+		n += 1;
+	}
 
-		props_impl_t *impl = _props_impl_get(props, property->body);
-		if(impl)
-		{
-			_props_impl_set(props, impl, value->type, value->size,
-				LV2_ATOM_BODY_CONST(value));
+	_props_epoch_end(props);
 
-			// send on (e.g. to UI)
-			if(*ref && !impl->def->hidden)
-				*ref = _props_patch_set(props, forge, frames, impl, sequence_num);
+	return n;
+}
 
-			const props_def_t *def = impl->def;
-			if(def->event_cb)
-				def->event_cb(props->data, frames, impl);
+static inline void
+props_bank_select(props_t *props, unsigned slot)
+{
+	atomic_store_explicit(&props->select, slot, memory_order_release);
+}
 
-			if(sequence_num)
-			{
-				if(*ref)
-					*ref = _props_patch_ack(props, forge, frames, sequence_num);
-			}
+// auto-vectorized (-O3) for densely packed arrays, returns whether anything changed
+static inline bool
+_props_morph_f32(float *dst, const float *a, const float *b, uint32_t n,
+	float ratio)
+{
+	uint32_t changed = 0; // a bool reduction would keep the loop scalar
 
-			return 1;
-		}
-		else if(props->dyn && props->dyn->prop)
-		{
-			const LV2_URID subj = subject ? subject->body : 0;
+	for(uint32_t i = 0; i < n; i++)
+	{
+		const float v = a[i] + (b[i] - a[i])*ratio;
 
-			props->dyn->prop(props->data, PROPS_DYN_EV_SET, subj, property->body, value);
+		changed |= (dst[i] != v);
+		dst[i] = v;
+	}
 
-			//TODO send ack
-		}
-		else if(sequence_num)
-		{
-			if(*ref)
-				*ref = _props_patch_error(props, forge, frames, sequence_num);
-		}
+	return changed;
+}
+
+// rounded and kept in between a and b, as the double may be off for Long
+static inline int64_t
+_props_morph_round(int64_t a, int64_t b, float ratio)
+{
+	const double v = (double)a + ((double)b - (double)a)*ratio;
+	const int64_t lo = a < b ? a : b;
+	const int64_t hi = a < b ? b : a;
+
+	if(v <= (double)lo)
+		return lo;
+	if(v >= (double)hi)
+		return hi;
+
+	return (int64_t)(v < 0.0 ? v - 0.5 : v + 0.5);
+}
+
+static inline bool
+_props_morph_scalar(props_t *props, props_impl_t *impl, const void *a,
+	const void *b, float ratio)
+{
+	union {
+		int32_t i;
+		int64_t h;
+		float f;
+		double d;
+	} v;
+
+	if(impl->type == props->urid.atom_float)
+	{
+		const float A = *(const float *)a;
+		v.f = A + (*(const float *)b - A)*ratio;
 	}
-	else if(obj->body.otype == props->urid.patch_put)
+	else if(impl->type == props->urid.atom_double)
 	{
-		const LV2_Atom_URID *subject = NULL;
-		const LV2_Atom_Int *sequence = NULL;
-		const LV2_Atom_Object *body = NULL;
+		const double A = *(const double *)a;
+		v.d = A + (*(const double *)b - A)*ratio;
+	}
+	else if(impl->type == props->urid.atom_int)
+	{
+		v.i = _props_morph_round(*(const int32_t *)a, *(const int32_t *)b, ratio);
+	}
+	else // atom_long
+	{
+		v.h = _props_morph_round(*(const int64_t *)a, *(const int64_t *)b, ratio);
+	}
 
-		lv2_atom_object_get(obj,
-			props->urid.patch_subject, &subject,
-			props->urid.patch_sequence, &sequence,
-			props->urid.patch_body, &body,
-			0);
+	if(!memcmp(impl->value.body, &v, impl->value.size))
+		return false;
 
-		// check for a matching optional subject
-		if(  (subject && props->urid.subject)
-			&& ( (subject->atom.type != props->urid.atom_urid)
-				|| (subject->body != props->urid.subject) ) )
-		{
-			return 0;
-		}
+	_props_impl_write_begin(props, impl);
+	_props_impl_copy(props, impl, impl->value.body, &v, impl->value.size);
+	_props_impl_write_end(props, impl);
 
-		int32_t sequence_num = 0;
-		if(sequence && (sequence->atom.type == props->urid.atom_int))
-		{
-			sequence_num = sequence->body;
-		}
+	return true;
+}
 
-		if(!body || !lv2_atom_forge_is_object_type(forge, body->atom.type))
-		{
-			if(sequence_num)
-			{
-				if(*ref)
-					*ref = _props_patch_error(props, forge, frames, sequence_num);
-			}
+// atom:Vector is only blended between Float vectors of equal length
+static inline bool
+_props_morph_blendable(props_t *props, const props_slot_t *a,
+	const props_slot_t *b, unsigned i)
+{
+	const props_impl_t *impl = &props->impls[i];
 
-			return 0;
-		}
+	if(impl->type != props->urid.atom_vector)
+		return true;
 
-		LV2_ATOM_OBJECT_FOREACH(body, prop)
-		{
-			const LV2_URID property = prop->key;
-			const LV2_Atom *value = &prop->value;
+	if(  !a->sizes || !b->sizes
+		|| (a->sizes[i] != b->sizes[i])
+		|| (a->sizes[i] < sizeof(LV2_Atom_Vector_Body)) )
+	{
+		return false;
+	}
 
-			props_impl_t *impl = _props_impl_get(props, property);
-			if(impl)
-			{
-				_props_impl_set(props, impl, value->type, value->size,
-					LV2_ATOM_BODY_CONST(value));
+	const LV2_Atom_Vector_Body *A = (const LV2_Atom_Vector_Body *)
+		((const uint8_t *)a->base + impl->def->offset);
+	const LV2_Atom_Vector_Body *B = (const LV2_Atom_Vector_Body *)
+		((const uint8_t *)b->base + impl->def->offset);
 
-				// send on (e.g. to UI)
-				if(*ref && !impl->def->hidden)
-					*ref = _props_patch_set(props, forge, frames, impl, sequence_num);
+	return (A->child_type == props->urid.atom_float)
+		&& (A->child_size == sizeof(float))
+		&& !memcmp(A, B, sizeof(LV2_Atom_Vector_Body));
+}
 
-				const props_def_t *def = impl->def;
-				if(def->event_cb)
-					def->event_cb(props->data, frames, impl);
-			}
-			else if(props->dyn && props->dyn->prop)
-			{
-				const LV2_URID subj = subject ? subject->body : 0;
+static inline bool
+_props_morph_vector(props_t *props, props_impl_t *impl, const void *a,
+	const void *b, uint32_t size, float ratio)
+{
+	const uint32_t n = (size - sizeof(LV2_Atom_Vector_Body)) / sizeof(float);
+	bool changed = (impl->value.size != size)
+		|| memcmp(impl->value.body, a, sizeof(LV2_Atom_Vector_Body));
 
-				props->dyn->prop(props->data, PROPS_DYN_EV_SET, subj, property, value);
+	_props_impl_write_begin(props, impl);
 
-			//TODO send ack
-			}
-		}
+	impl->value.size = size;
+	memcpy(impl->value.body, a, sizeof(LV2_Atom_Vector_Body));
+	changed |= _props_morph_f32(
+		(float *)((LV2_Atom_Vector_Body *)impl->value.body + 1),
+		(const float *)((const LV2_Atom_Vector_Body *)a + 1),
+		(const float *)((const LV2_Atom_Vector_Body *)b + 1), n, ratio);
 
-		if(sequence_num)
-		{
-			if(*ref)
-				*ref = _props_patch_ack(props, forge, frames, sequence_num);
-		}
+	_props_impl_write_end(props, impl);
 
-		return 1;
-	}
-	else if(obj->body.otype == props->urid.patch_patch)
+	return changed;
+}
+
+static inline unsigned
+props_morph(props_t *props, uint32_t frames, unsigned from, unsigned to,
+	float ratio)
+{
+	if(  (from >= props->nslots) || !props->slots[from].stored
+		|| (to >= props->nslots) || !props->slots[to].stored )
 	{
-		const LV2_Atom_URID *subject = NULL;
-		const LV2_Atom_Int *sequence = NULL;
-		const LV2_Atom_Object *add = NULL;
-		const LV2_Atom_Object *rem = NULL;
+		return 0;
+	}
 
-		lv2_atom_object_get(obj,
-			props->urid.patch_subject, &subject,
-			props->urid.patch_sequence, &sequence,
-			props->urid.patch_add, &add,
-			props->urid.patch_remove, &rem,
-			0);
+	const props_slot_t *a = &props->slots[from];
+	const props_slot_t *b = &props->slots[to];
+	const bool paused = props->history.paused;
+	unsigned n = 0;
 
-		LV2_URID subj = 0;
-		if(subject && (subject->atom.type == props->urid.atom_urid))
-		{
-			subj = subject->body;
-		}
+	if(ratio < 0.f)
+		ratio = 0.f;
+	else if(ratio > 1.f)
+		ratio = 1.f;
 
-		int32_t sequence_num = 0;
-		if(sequence && (sequence->atom.type == props->urid.atom_int))
-		{
-			sequence_num = sequence->body;
-		}
+	_props_epoch_begin(props);
+	props->history.paused = true;
 
-		if(rem && lv2_atom_forge_is_object_type(forge, rem->atom.type))
-		{
-			LV2_ATOM_OBJECT_FOREACH(rem, prop)
-			{
-				const LV2_URID property = prop->key;
-				const LV2_Atom *value = &prop->value;
+	for(unsigned i = 0; i < props->nimpls; i++)
+	{
+		props_impl_t *impl = &props->impls[i];
 
-				if(props->dyn && props->dyn->prop)
-				{
-					props->dyn->prop(props->data, PROPS_DYN_EV_REM, subj, property, value);
-				}
-			}
-		}
+		if(_props_bank_skip(props, a, i) || _props_bank_skip(props, b, i))
+			continue;
 
-		if(add && lv2_atom_forge_is_object_type(forge, add->atom.type))
+		if(  _props_flag(props, i, PROPS_FLAG_NUMERIC)
+			&& _props_morph_blendable(props, a, b, i) )
 		{
-			LV2_ATOM_OBJECT_FOREACH(add, prop)
+			const props_shape_t *shape = &props->shapes[i];
+			const uint8_t *A = (const uint8_t *)a->base + impl->def->offset;
+			const uint8_t *B = (const uint8_t *)b->base + impl->def->offset;
+			bool changed = false;
+
+			if(shape->count)
 			{
-				const LV2_URID property = prop->key;
-				const LV2_Atom *value = &prop->value;
+				_props_impl_write_begin(props, impl);
 
-				if(props->dyn && props->dyn->prop)
+				if(shape->stride == sizeof(float))
 				{
-					props->dyn->prop(props->data, PROPS_DYN_EV_ADD, subj, property, value);
+					changed = _props_morph_f32((float *)impl->value.body,
+						(const float *)A, (const float *)B, shape->count, ratio);
+				}
+				else
+				{
+					for(uint32_t j = 0; j < shape->count; j++)
+					{
+						changed |= _props_morph_f32(
+							(float *)_props_impl_elem(props, impl, impl->value.body, j),
+							(const float *)(A + j*shape->stride),
+							(const float *)(B + j*shape->stride), 1, ratio);
+					}
 				}
+
+				_props_impl_write_end(props, impl);
+			}
+			else if(impl->type == props->urid.atom_vector)
+			{
+				changed = _props_morph_vector(props, impl, A, B, a->sizes[i], ratio);
+			}
+			else
+			{
+				changed = _props_morph_scalar(props, impl, A, B, ratio);
 			}
-		}
 
-		if(sequence_num && *ref)
+			if(!changed)
+				continue;
+
+			_props_impl_stash(props, impl);
+		}
+		else if(!_props_bank_apply(props, ratio < PROPS_MORPH_THRESHOLD ? a : b, i))
 		{
-			*ref = _props_patch_ack(props, forge, frames, sequence_num);
+			continue;
 		}
 
-		return 1;
+		_props_impl_flag_set(props, impl, PROPS_FLAG_MORPHED, true);
+		props->morphed = true;
+
+		if(_props_impl_flag(props, impl, PROPS_FLAG_EVENT))
+			impl->def->event_cb(props->data, frames, impl);
+
+		n += 1;
 	}
 
-	return 0; // did not handle a patch event
+	props->history.paused = paused;
+	_props_epoch_end(props);
+
+	return n;
 }
 
 static inline void
-props_set(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
-	LV2_URID property, LV2_Atom_Forge_Ref *ref)
+props_history(props_t *props, void *buf, uint32_t size)
 {
-	props_impl_t *impl = _props_impl_get(props, property);
+	props_history_t *hist = &props->history;
 
-	if(impl)
+	hist->buf = (uint8_t *)buf;
+	hist->size = buf ? size & ~7U : 0;
+	hist->first = PROPS_HISTORY_NONE;
+	hist->last = PROPS_HISTORY_NONE;
+	hist->cursor = PROPS_HISTORY_NONE;
+}
+
+// goes through the regular set path, but is not logged again
+static inline void
+_props_history_apply(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	props_change_t *change, const void *body, uint32_t size, LV2_Atom_Forge_Ref *ref)
+{
+	props_impl_t *impl = &props->impls[change->idx];
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+
+	if(shape->count)
 	{
+		_props_impl_write_begin(props, impl);
+		_props_impl_copy(props, impl, _props_impl_elem(props, impl, impl->value.body, change->elem),
+			body, size);
+		_props_impl_mark(props, impl, change->elem);
+		_props_impl_write_end(props, impl);
+
 		_props_impl_stash(props, impl);
+	}
+	else
+	{
+		_props_impl_set(props, impl, impl->type, size, body);
+	}
+
+	if(*ref && _props_impl_notify(props, impl))
+		*ref = _props_patch_set(props, forge, frames, impl, 0, true);
+	_props_impl_clean(props, impl);
+
+	if(_props_impl_flag(props, impl, PROPS_FLAG_EVENT))
+		impl->def->event_cb(props->data, frames, impl);
+}
+
+static inline unsigned
+props_undo(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Ref *ref)
+{
+	props_history_t *hist = &props->history;
+	const bool paused = hist->paused; // e.g. from an event_cb of props_derive
+	unsigned n = 0;
+
+	if(hist->cursor == PROPS_HISTORY_NONE)
+		return 0;
+
+	const uint32_t group = _props_change(props, hist->cursor)->group;
+
+	_props_epoch_begin(props);
+	hist->paused = true;
+
+	// newest first
+	while( (hist->cursor != PROPS_HISTORY_NONE)
+		&& (_props_change(props, hist->cursor)->group == group) )
+	{
+		props_change_t *change = _props_change(props, hist->cursor);
 
-		if(*ref && !impl->def->hidden) //TODO use patch:sequenceNumber
-			*ref = _props_patch_set(props, forge, frames, impl, 0);
+		_props_history_apply(props, forge, frames, change,
+			_props_change_old(change), change->old_size, ref);
+
+		hist->cursor = change->prev;
+		n += 1;
 	}
+
+	hist->paused = paused;
+	_props_epoch_end(props);
+
+	return n;
 }
 
-static inline void
-props_get(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
-	LV2_URID property, LV2_Atom_Forge_Ref *ref)
+static inline unsigned
+props_redo(props_t *props, LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Ref *ref)
 {
-	props_impl_t *impl = _props_impl_get(props, property);
+	props_history_t *hist = &props->history;
+	const bool paused = hist->paused; // e.g. from an event_cb of props_derive
+	unsigned n = 0;
 
-	if(impl)
+	if(hist->cursor == hist->last)
+		return 0;
+
+	uint32_t next = (hist->cursor == PROPS_HISTORY_NONE)
+		? hist->first
+		: _props_change(props, hist->cursor)->next;
+	const uint32_t group = _props_change(props, next)->group;
+
+	_props_epoch_begin(props);
+	hist->paused = true;
+
+	// oldest first
+	while( (next != PROPS_HISTORY_NONE)
+		&& (_props_change(props, next)->group == group) )
 	{
-		if(*ref && !impl->def->hidden) //TODO use patch:sequenceNumber
-			*ref = _props_patch_get(props, forge, frames, impl, 0);
+		props_change_t *change = _props_change(props, next);
+
+		_props_history_apply(props, forge, frames, change,
+			_props_change_new(change), change->new_size, ref);
+
+		hist->cursor = next;
+		next = change->next;
+		n += 1;
 	}
+
+	hist->paused = paused;
+	_props_epoch_end(props);
+
+	return n;
 }
 
 static inline void
-props_stash(props_t *props, LV2_URID property)
+props_epoch_begin(props_t *props)
 {
-	props_impl_t *impl = _props_impl_get(props, property);
+	_props_epoch_begin(props);
 
-	if(impl)
-		_props_impl_stash(props, impl);
+	// direct writes to values may follow right away
+	_props_epoch_open(props);
+}
+
+static inline void
+props_epoch_end(props_t *props)
+{
+	_props_epoch_end(props);
 }
 
 static inline LV2_URID
@@ -1051,6 +4579,133 @@ _free_path(const LV2_State_Free_Path *free_path, char *path)
 	}
 }
 
+// arrays are dumped as atom:Vector body
+static inline uint32_t
+_props_impl_dump(props_t *props, const props_impl_t *impl, void *body,
+	const void *src, uint32_t size)
+{
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+
+	if(!shape->count)
+	{
+		memcpy(body, src, size);
+		return size;
+	}
+
+	LV2_Atom_Vector_Body *vec = (LV2_Atom_Vector_Body *)body;
+	vec->child_size = impl->value.size;
+	vec->child_type = impl->type;
+	_props_impl_gather(props, impl, &vec[1], src);
+
+	return shape->max_size;
+}
+
+static inline uint64_t
+_props_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+// size is left at 0 if the value could not be read before the deadline
+static inline void
+_props_impl_snapshot(props_t *props, props_impl_t *impl, void *body,
+	uint32_t max_size, uint32_t *size, unsigned *version, uint64_t deadline)
+{
+	if(props->stashless) // optimistic read of the only copy, never blocks the dsp
+	{
+		*size = 0;
+
+		do
+		{
+			const unsigned v0 = atomic_load_explicit(&impl->sync->version, memory_order_acquire);
+			const uint32_t sz = impl->value.size;
+
+			if( !(v0 & 1) && (sz <= max_size) )
+			{
+				const uint32_t dumped = _props_impl_dump(props, impl, body, impl->value.body, sz);
+
+				_props_fence(memory_order_acquire);
+
+				if(atomic_load_explicit(&impl->sync->version, memory_order_relaxed) == v0)
+				{
+					*version = v0;
+					*size = dumped;
+					return;
+				}
+			}
+
+			sched_yield(); // dsp is writing right now
+		} while(_props_now() <= deadline);
+	}
+	else
+	{
+		const int state = _props_impl_spin_lock(impl, PROP_STATE_LOCK);
+
+		*version = atomic_load_explicit(&impl->sync->version, memory_order_relaxed);
+		*size = _props_impl_dump(props, impl, body, impl->stash.body, impl->stash.size);
+
+		_props_impl_unlock(impl, state); // keep a pending restore
+	}
+}
+
+// consistent across properties unless the dsp keeps an epoch open for longer
+// than PROPS_SNAPSHOT_TIMEOUT, e.g. while run is not being called, then falls
+// back to the values stashed so far
+static inline void
+_props_snapshot(props_t *props, uint8_t *snapshot, uint32_t *sizes,
+	unsigned *versions)
+{
+	const uint64_t deadline = _props_now() + (uint64_t)PROPS_SNAPSHOT_TIMEOUT*1000000;
+
+	for(unsigned retry = 0; true; retry++)
+	{
+		unsigned epoch;
+		bool late = false;
+
+		// an open epoch is only ever half-written, wait for the dsp to close it
+		while( (epoch = atomic_load(&props->epoch)) & 1)
+		{
+			if( (late = (_props_now() > deadline)) )
+				break;
+
+			sched_yield();
+		}
+
+		uint8_t *body = snapshot;
+		for(unsigned i = 0; i < props->nimpls; i++)
+		{
+			props_impl_t *impl = &props->impls[i];
+
+			// only (re)copy what has changed since the last round
+			const uint32_t max_size = props->shapes[i].max_size;
+
+			if(  !_props_flag(props, i, PROPS_FLAG_READABLE)
+				&& ( (retry == 0)
+					|| (atomic_load_explicit(&impl->sync->version, memory_order_relaxed) != versions[i]) ) )
+			{
+				_props_impl_snapshot(props, impl, body, max_size, &sizes[i], &versions[i],
+					deadline);
+			}
+
+			body += max_size;
+		}
+
+		_props_fence(memory_order_seq_cst);
+
+		if(late || (atomic_load(&props->epoch) == epoch))
+			return; // no dsp-side update in between, snapshot is consistent
+
+		if(_props_now() > deadline)
+			return; // each value as of its last stash
+
+		sched_yield();
+	}
+}
+
 static inline LV2_State_Status
 props_save(props_t *props, LV2_State_Store_Function store,
 	LV2_State_Handle state, uint32_t flags, const LV2_Feature *const *features)
@@ -1066,43 +4721,47 @@ props_save(props_t *props, LV2_State_Store_Function store,
 	{
 		if(!strcmp(features[i]->URI, LV2_STATE__mapPath))
 		{
-			map_path = features[i]->data;
+			map_path = (const LV2_State_Map_Path *)features[i]->data;
 		}
 		else if(!strcmp(features[i]->URI, LV2_STATE__makePath))
 		{
-			make_path = features[i]->data;
+			make_path = (const LV2_State_Make_Path *)features[i]->data;
 		}
 		else if(!strcmp(features[i]->URI, LV2_STATE__freePath))
 		{
-			free_path = features[i]->data;
+			free_path = (const LV2_State_Free_Path *)features[i]->data;
 		}
 	}
 
-	void *body = malloc(props->max_size); // create memory to store widest value
-	if(body)
+	// create temporary copy of all values, store() may well be blocking
+	uint8_t *snapshot = (uint8_t *)calloc(1, props->sum_size);
+	uint32_t *sizes = (uint32_t *)calloc(props->nimpls, sizeof(uint32_t));
+	unsigned *versions = (unsigned *)calloc(props->nimpls, sizeof(unsigned));
+
+	LV2_State_Status status = LV2_STATE_ERR_UNKNOWN;
+
+	if(snapshot && sizes && versions)
 	{
-		for(unsigned i = 0; i < props->nimpls; i++)
+		_props_snapshot(props, snapshot, sizes, versions);
+		status = LV2_STATE_SUCCESS;
+
+		uint8_t *body = snapshot;
+		for(unsigned i = 0; i < props->nimpls; body += props->shapes[i++].max_size)
 		{
 			props_impl_t *impl = &props->impls[i];
 
-			if(impl->access == props->urid.patch_readable)
+			if(_props_flag(props, i, PROPS_FLAG_READABLE))
 				continue; // skip read-only, as it makes no sense to restore them
 
-			// always clear memory
-			memset(body, 0x0, props->max_size);
-
-			_props_impl_spin_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK);
+			const uint32_t size = sizes[i];
 
-			// create temporary copy of value, store() may well be blocking
-			const uint32_t size = impl->stash.size;
-			memcpy(body, impl->stash.body, size);
-
-			_props_impl_unlock(impl, PROP_STATE_NONE);
+			if(!size)
+				continue; // not read in time
 
 			if(  map_path && map_path->abstract_path
 				&& (impl->type == props->urid.atom_path) )
 			{
-				const char *path = strstr(body, "file://") == body
+				const char *path = strstr((char *)body, "file://") == (char *)body
 					? (char *)body + 7 // skip "file://"
 					: (char *)body;
 
@@ -1138,14 +4797,84 @@ props_save(props_t *props, LV2_State_Store_Function store,
 			}
 			else // !Path
 			{
-				store(state, impl->property, body, size, impl->type, flags);
+				store(state, impl->property, body, size,
+					props->shapes[i].count ? props->urid.atom_vector : impl->type, flags);
 			}
 		}
+	}
+
+	free(snapshot);
+	free(sizes);
+	free(versions);
+
+	return status;
+}
+
+static inline bool
+_props_impl_restore_write(props_t *props, props_impl_t *impl,
+	const void *body, uint32_t size)
+{
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+
+	if(size > shape->max_size)
+		return false;
+
+	if(shape->count) // atom:Vector body with up to count elements
+	{
+		const LV2_Atom_Vector_Body *vec = (const LV2_Atom_Vector_Body *)body;
+
+		if(  (size < sizeof(LV2_Atom_Vector_Body))
+			|| (vec->child_type != impl->type)
+			|| (vec->child_size != impl->value.size) )
+		{
+			return false;
+		}
+
+		const uint32_t n = (size - sizeof(LV2_Atom_Vector_Body)) / impl->value.size;
+
+		if(props->stashless)
+		{
+			_props_impl_write_begin(props, impl);
+			_props_impl_scatter(props, impl, impl->value.body, &vec[1], n);
+			_props_impl_write_end(props, impl);
+		}
+		else
+		{
+			_props_impl_scatter(props, impl, impl->stash.body, &vec[1], n);
+			_props_atomic_add(&impl->sync->version, 1, memory_order_relaxed);
+		}
 
-		free(body);
+		return true;
 	}
 
-	return LV2_STATE_SUCCESS;
+	if(props->stashless) // restore is not concurrent with run in this mode
+	{
+		_props_impl_write_begin(props, impl);
+
+		const bool reserved = _props_impl_reserve(props, impl, false, size);
+		if(reserved)
+		{
+			impl->value.size = size;
+			impl->stash.size = size;
+			memcpy(impl->value.body, body, size);
+		}
+
+		_props_impl_write_end(props, impl);
+
+		if(reserved && _props_impl_flag(props, impl, PROPS_FLAG_POOLED))
+			_props_impl_ref_sync(props, impl, true);
+
+		return reserved;
+	}
+
+	if(!_props_impl_reserve(props, impl, true, size))
+		return false;
+
+	impl->stash.size = size;
+	memcpy(impl->stash.body, body, size);
+	_props_atomic_add(&impl->sync->version, 1, memory_order_relaxed);
+
+	return true;
 }
 
 static inline LV2_State_Status
@@ -1160,11 +4889,11 @@ props_restore(props_t *props, LV2_State_Retrieve_Function retrieve,
 	{
 		if(!strcmp(features[i]->URI, LV2_STATE__mapPath))
 		{
-			map_path = features[i]->data;
+			map_path = (const LV2_State_Map_Path *)features[i]->data;
 		}
 		if(!strcmp(features[i]->URI, LV2_STATE__freePath))
 		{
-			free_path = features[i]->data;
+			free_path = (const LV2_State_Free_Path *)features[i]->data;
 		}
 	}
 
@@ -1172,7 +4901,7 @@ props_restore(props_t *props, LV2_State_Retrieve_Function retrieve,
 	{
 		props_impl_t *impl = &props->impls[i];
 
-		if(impl->access == props->urid.patch_readable)
+		if(_props_flag(props, i, PROPS_FLAG_READABLE))
 			continue; // skip read-only, as it makes no sense to restore them
 
 		size_t size;
@@ -1181,35 +4910,35 @@ props_restore(props_t *props, LV2_State_Retrieve_Function retrieve,
 		const void *body = retrieve(state, impl->property, &size, &type, &_flags);
 
 		if(  body
-			&& (type == impl->type)
+			&& (type == (props->shapes[i].count ? props->urid.atom_vector : impl->type))
 			&& ( (impl->def->max_size == 0) || (size <= impl->def->max_size) ) )
 		{
 			if(  map_path && map_path->absolute_path
 				&& (type == props->urid.atom_path) )
 			{
-				char *absolute = map_path->absolute_path(map_path->handle, body);
+				char *absolute = map_path->absolute_path(map_path->handle, (const char *)body);
 				if(absolute)
 				{
 					const uint32_t sz = strlen(absolute) + 1;
 
-					_props_impl_spin_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK);
-
-					impl->stash.size = sz;
-					memcpy(impl->stash.body, absolute, sz);
+					const int state = _props_impl_spin_lock(impl, PROP_STATE_LOCK);
 
-					_props_impl_unlock(impl, PROP_STATE_RESTORE);
+					_props_impl_unlock(impl,
+						_props_impl_restore_write(props, impl, absolute, sz)
+							? PROP_STATE_RESTORE
+							: state);
 
 					_free_path(free_path, absolute);
 				}
 			}
 			else // !Path
 			{
-				_props_impl_spin_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK);
+				const int state = _props_impl_spin_lock(impl, PROP_STATE_LOCK);
 
-				impl->stash.size = size;
-				memcpy(impl->stash.body, body, size);
-
-				_props_impl_unlock(impl, PROP_STATE_RESTORE);
+				_props_impl_unlock(impl,
+					_props_impl_restore_write(props, impl, body, size)
+						? PROP_STATE_RESTORE
+						: state);
 			}
 		}
 	}
@@ -1221,6 +4950,37 @@ props_restore(props_t *props, LV2_State_Retrieve_Function retrieve,
 
 #ifdef __cplusplus
 }
+
+#	ifdef _PROPS_CXX_KEYWORDS
+#		undef _PROPS_CXX_KEYWORDS
+#		undef _Atomic
+#		undef _Alignas
+#		undef _Alignof
+#	endif
+#	undef atomic_bool
+#	undef atomic_int
+#	undef atomic_uint
+#	undef atomic_size_t
+#	undef memory_order
+#	undef memory_order_relaxed
+#	undef memory_order_acquire
+#	undef memory_order_release
+#	undef memory_order_acq_rel
+#	undef memory_order_seq_cst
+#	undef atomic_init
+#	undef atomic_load
+#	undef atomic_load_explicit
+#	undef atomic_store
+#	undef atomic_store_explicit
+#	undef atomic_exchange
+#	undef atomic_exchange_explicit
+#	undef atomic_fetch_add
+#	undef atomic_fetch_add_explicit
+#	undef atomic_fetch_sub
+#	undef atomic_fetch_sub_explicit
+#	undef atomic_compare_exchange_strong_explicit
+#	undef atomic_compare_exchange_weak_explicit
+#	undef atomic_thread_fence
 #endif
 
 #endif // _LV2_PROPS_H_
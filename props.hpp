@@ -0,0 +1,547 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _LV2_PROPS_HPP_
+#define _LV2_PROPS_HPP_
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+#include <props.h>
+
+/*****************************************************************************
+ * API START
+ *****************************************************************************/
+
+// struct state_t {
+// 	float gain;
+// 	char name [32];
+// };
+//
+// constexpr auto gain = props::property<props::atom::Float,
+// 	PROPS_MEMBER(state_t, gain)>(PREFIX"gain");
+// constexpr auto name = props::property<props::atom::String,
+// 	PROPS_MEMBER(state_t, name)>(PREFIX"name").hidden();
+// constexpr auto defs = props::make_defs(gain, name);
+//
+// props::store<state_t, defs> store;
+// store.init(PREFIX"subj", map, nullptr);
+// store.value<gain>() = 0.5f;
+// store.set<gain>(forge, frames, &ref);
+
+// binds a property to a member of the plugin state structure
+#define PROPS_MEMBER(CLASS, MEMBER) \
+	::props::member<CLASS, decltype(CLASS::MEMBER), \
+		offsetof(CLASS, MEMBER), &CLASS::MEMBER>
+
+namespace props {
+
+// FNV-1a
+constexpr uint32_t
+hash(const char *uri)
+{
+	uint32_t h = 0x811c9dc5;
+
+	while(*uri)
+	{
+		h ^= static_cast<uint8_t>(*uri++);
+		h *= 0x01000193;
+	}
+
+	return h;
+}
+
+template<typename Class, typename Type, size_t Offset, Type Class::*Pointer>
+struct member {
+	using class_type = Class;
+	using value_type = Type;
+
+	static constexpr size_t offset = Offset;
+	static constexpr Type Class::*pointer = Pointer;
+};
+
+namespace atom {
+
+// fixed size, e.g. int32_t
+template<typename T>
+struct scalar {
+	template<typename M>
+	static constexpr bool matches = std::is_same<M, T>::value;
+
+	template<typename M>
+	static constexpr uint32_t max_size = 0; // resolved by props_init
+
+	template<typename M>
+	static constexpr uint32_t count = 0;
+
+	static constexpr bool pooled = false;
+};
+
+// variable size with an upper bound, e.g. char [N]
+template<typename T>
+struct array {
+	template<typename M>
+	static constexpr bool matches = std::is_array<M>::value
+		&& (std::extent<M>::value > 0)
+		&& std::is_same<typename std::remove_extent<M>::type, T>::value;
+
+	template<typename M>
+	static constexpr uint32_t max_size = sizeof(M);
+
+	template<typename M>
+	static constexpr uint32_t count = 0;
+
+	static constexpr bool pooled = false;
+};
+
+struct Int : scalar<int32_t> {
+	static constexpr const char *uri = LV2_ATOM__Int;
+};
+
+struct Long : scalar<int64_t> {
+	static constexpr const char *uri = LV2_ATOM__Long;
+};
+
+struct Float : scalar<float> {
+	static constexpr const char *uri = LV2_ATOM__Float;
+};
+
+struct Double : scalar<double> {
+	static constexpr const char *uri = LV2_ATOM__Double;
+};
+
+struct Bool : scalar<int32_t> {
+	static constexpr const char *uri = LV2_ATOM__Bool;
+};
+
+struct URID : scalar<LV2_URID> {
+	static constexpr const char *uri = LV2_ATOM__URID;
+};
+
+struct String : array<char> {
+	static constexpr const char *uri = LV2_ATOM__String;
+};
+
+struct URI : array<char> {
+	static constexpr const char *uri = LV2_ATOM__URI;
+};
+
+struct Path : array<char> {
+	static constexpr const char *uri = LV2_ATOM__Path;
+};
+
+struct Chunk : array<uint8_t> {
+	static constexpr const char *uri = LV2_ATOM__Chunk;
+};
+
+// densely packed elements of a fixed size atom, e.g. vector<Float> for
+// float [N]; strided arrays are only available via the plain C API
+template<typename A>
+struct vector {
+	static constexpr const char *uri = A::uri;
+
+	template<typename M>
+	static constexpr bool matches = std::is_array<M>::value
+		&& (std::extent<M>::value > 0)
+		&& A::template matches<typename std::remove_extent<M>::type>
+		&& (A::template max_size<typename std::remove_extent<M>::type> == 0);
+
+	template<typename M>
+	static constexpr uint32_t max_size = 0; // resolved by props_init
+
+	template<typename M>
+	static constexpr uint32_t count = std::extent<M>::value;
+
+	static constexpr bool pooled = false;
+};
+
+// stored out-of-line in the pool, bound to a props_ref_t member,
+// MaxSize of 0 defaults to PROPS_POOL_MAX
+template<typename A, uint32_t MaxSize = 0>
+struct pool {
+	static constexpr const char *uri = A::uri;
+
+	template<typename M>
+	static constexpr bool matches = std::is_same<M, props_ref_t>::value;
+
+	template<typename M>
+	static constexpr uint32_t max_size = MaxSize;
+
+	template<typename M>
+	static constexpr uint32_t count = 0;
+
+	static constexpr bool pooled = true;
+};
+
+} // namespace atom
+
+template<typename Atom, typename Member>
+class property {
+public:
+	using atom_type = Atom;
+	using member_type = Member;
+	using class_type = typename Member::class_type;
+	using value_type = typename Member::value_type;
+
+	static_assert(Atom::template matches<value_type>,
+		"member type does not match atom type");
+	static_assert(std::is_standard_layout<class_type>::value,
+		"state structure must be standard-layout for offsetof");
+
+	constexpr explicit
+	property(const char *uri)
+		: _uri(uri), _hash(props::hash(uri)), _access(LV2_PATCH__writable),
+			_hidden(false), _event_cb(nullptr), _derive(nullptr), _depends(nullptr)
+	{}
+
+	constexpr property
+	readable() const
+	{
+		property prop = *this;
+		prop._access = LV2_PATCH__readable;
+		return prop;
+	}
+
+	constexpr property
+	hidden() const
+	{
+		property prop = *this;
+		prop._hidden = true;
+		return prop;
+	}
+
+	constexpr property
+	on_event(props_event_cb_t event_cb) const
+	{
+		property prop = *this;
+		prop._event_cb = event_cb;
+		return prop;
+	}
+
+	// depends is a NULL-terminated array of property URIs
+	constexpr property
+	derived(props_derive_cb_t derive, const char *const *depends) const
+	{
+		property prop = *this;
+		prop._derive = derive;
+		prop._depends = depends;
+		return prop;
+	}
+
+	constexpr const char *
+	uri() const
+	{
+		return _uri;
+	}
+
+	constexpr uint32_t
+	hash() const
+	{
+		return _hash;
+	}
+
+	constexpr props_def_t
+	def() const
+	{
+		return props_def_t {
+			_uri,
+			Atom::uri,
+			_access,
+			Member::offset,
+			_hidden,
+			Atom::template max_size<value_type>,
+			_event_cb,
+			Atom::pooled,
+			Atom::template count<value_type>,
+			0, // dense
+			_derive,
+			_depends
+		};
+	}
+
+	// typed access to the bound member
+	constexpr value_type &
+	operator()(class_type &state) const
+	{
+		return state.*Member::pointer;
+	}
+
+	constexpr const value_type &
+	operator()(const class_type &state) const
+	{
+		return state.*Member::pointer;
+	}
+
+private:
+	const char *_uri;
+	uint32_t _hash;
+	const char *_access;
+	bool _hidden;
+	props_event_cb_t _event_cb;
+	props_derive_cb_t _derive;
+	const char *const *_depends;
+};
+
+template<typename... Props>
+constexpr std::array<props_def_t, sizeof...(Props)>
+make_defs(const Props &... props)
+{
+	return {{ props.def()... }};
+}
+
+template<typename Class, const auto &Defs>
+class store {
+public:
+	static constexpr size_t size = Defs.size();
+
+	static_assert(size > 0, "no properties defined");
+
+	// rt-safe
+	int
+	init(const char *subject, LV2_URID_Map *map, void *data,
+		bool stashless = false);
+
+	// rt-safe
+	template<const auto &Prop>
+	LV2_URID
+	urid() const;
+
+	// rt-safe
+	template<const auto &Prop>
+	auto &
+	value();
+
+	// rt-safe
+	template<const auto &Prop>
+	void
+	set(LV2_Atom_Forge *forge, uint32_t frames, LV2_Atom_Forge_Ref *ref);
+
+	// rt-safe
+	template<const auto &Prop>
+	void
+	get(LV2_Atom_Forge *forge, uint32_t frames, LV2_Atom_Forge_Ref *ref);
+
+	// rt-safe
+	int
+	advance(LV2_Atom_Forge *forge, uint32_t frames, const LV2_Atom_Object *obj,
+		LV2_Atom_Forge_Ref *ref);
+
+	// rt-safe
+	void
+	idle(LV2_Atom_Forge *forge, uint32_t frames, LV2_Atom_Forge_Ref *ref);
+
+	// rt-safe
+	unsigned
+	derive(LV2_Atom_Forge *forge, uint32_t frames, LV2_Atom_Forge_Ref *ref);
+
+	// non-rt
+	LV2_State_Status
+	save(LV2_State_Store_Function store_fn, LV2_State_Handle handle,
+		uint32_t flags, const LV2_Feature *const *features);
+
+	// non-rt
+	LV2_State_Status
+	restore(LV2_State_Retrieve_Function retrieve_fn, LV2_State_Handle handle,
+		uint32_t flags, const LV2_Feature *const *features);
+
+	// access to the plain C API
+	props_t *
+	c_props();
+
+	Class state;
+	Class stash;
+
+private:
+	static constexpr size_t
+	nderived();
+
+	PROPS_T(_props, size);
+	uint32_t _graph [PROPS_GRAPH_SIZE(size, nderived())/sizeof(uint32_t) + 1];
+	LV2_URID _urids [size];
+
+	template<const auto &Prop>
+	static constexpr size_t
+	index();
+
+	static constexpr bool
+	unique();
+};
+
+/*****************************************************************************
+ * API END
+ *****************************************************************************/
+
+template<typename Class, const auto &Defs>
+constexpr bool
+store<Class, Defs>::unique()
+{
+	for(size_t i = 0; i < size; i++)
+	{
+		for(size_t j = i + 1; j < size; j++)
+		{
+			if(props::hash(Defs[i].property) == props::hash(Defs[j].property))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+template<typename Class, const auto &Defs>
+constexpr size_t
+store<Class, Defs>::nderived()
+{
+	size_t n = 0;
+
+	for(size_t i = 0; i < size; i++)
+	{
+		if(Defs[i].derive)
+			n++;
+	}
+
+	return n;
+}
+
+template<typename Class, const auto &Defs>
+template<const auto &Prop>
+constexpr size_t
+store<Class, Defs>::index()
+{
+	using prop_type = std::remove_cv_t<std::remove_reference_t<decltype(Prop)>>;
+
+	static_assert(std::is_same<typename prop_type::class_type, Class>::value,
+		"property is bound to another state structure");
+
+	for(size_t i = 0; i < size; i++)
+	{
+		if(props::hash(Defs[i].property) == Prop.hash())
+			return i;
+	}
+
+	return size;
+}
+
+template<typename Class, const auto &Defs>
+inline int
+store<Class, Defs>::init(const char *subject, LV2_URID_Map *map, void *data,
+	bool stashless)
+{
+	static_assert(unique(), "property URIs (and their hashes) must be unique");
+
+	const int status = props_init(&_props, subject, Defs.data(), size,
+		&state, stashless ? nullptr : &stash, map, data);
+
+	for(size_t i = 0; i < size; i++)
+	{
+		_urids[i] = props_map(&_props, Defs[i].property);
+	}
+
+	return status
+		&& props_graph(&_props, _graph, sizeof(_graph));
+}
+
+template<typename Class, const auto &Defs>
+template<const auto &Prop>
+inline LV2_URID
+store<Class, Defs>::urid() const
+{
+	constexpr size_t idx = index<Prop>();
+
+	static_assert(idx < size, "property is not part of this store");
+
+	return _urids[idx];
+}
+
+template<typename Class, const auto &Defs>
+template<const auto &Prop>
+inline auto &
+store<Class, Defs>::value()
+{
+	static_assert(index<Prop>() < size, "property is not part of this store");
+
+	return Prop(state);
+}
+
+template<typename Class, const auto &Defs>
+template<const auto &Prop>
+inline void
+store<Class, Defs>::set(LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Ref *ref)
+{
+	props_set(&_props, forge, frames, urid<Prop>(), ref);
+}
+
+template<typename Class, const auto &Defs>
+template<const auto &Prop>
+inline void
+store<Class, Defs>::get(LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Ref *ref)
+{
+	props_get(&_props, forge, frames, urid<Prop>(), ref);
+}
+
+template<typename Class, const auto &Defs>
+inline int
+store<Class, Defs>::advance(LV2_Atom_Forge *forge, uint32_t frames,
+	const LV2_Atom_Object *obj, LV2_Atom_Forge_Ref *ref)
+{
+	return props_advance(&_props, forge, frames, obj, ref);
+}
+
+template<typename Class, const auto &Defs>
+inline void
+store<Class, Defs>::idle(LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Ref *ref)
+{
+	props_idle(&_props, forge, frames, ref);
+}
+
+template<typename Class, const auto &Defs>
+inline unsigned
+store<Class, Defs>::derive(LV2_Atom_Forge *forge, uint32_t frames,
+	LV2_Atom_Forge_Ref *ref)
+{
+	return props_derive(&_props, forge, frames, ref);
+}
+
+template<typename Class, const auto &Defs>
+inline LV2_State_Status
+store<Class, Defs>::save(LV2_State_Store_Function store_fn,
+	LV2_State_Handle handle, uint32_t flags, const LV2_Feature *const *features)
+{
+	return props_save(&_props, store_fn, handle, flags, features);
+}
+
+template<typename Class, const auto &Defs>
+inline LV2_State_Status
+store<Class, Defs>::restore(LV2_State_Retrieve_Function retrieve_fn,
+	LV2_State_Handle handle, uint32_t flags, const LV2_Feature *const *features)
+{
+	return props_restore(&_props, retrieve_fn, handle, flags, features);
+}
+
+template<typename Class, const auto &Defs>
+inline props_t *
+store<Class, Defs>::c_props()
+{
+	return &_props;
+}
+
+} // namespace props
+
+#endif // _LV2_PROPS_HPP_
@@ -0,0 +1,593 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _LV2_PROPS_CLIENT_H_
+#define _LV2_PROPS_CLIENT_H_
+
+#include <props.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************
+ * API START
+ *****************************************************************************/
+
+// UI-side replica of a plugin's properties, built on the same defs table
+//
+// PROPS_CLIENT_T(client, MAX_NIMPLS);
+// props_client_init(&client, SUBJ, defs, MAX_NIMPLS, &mirror, map, _changed, ui);
+//
+// port_event:  props_client_advance(&client, obj);
+// on a change: props_client_set(&client, gain, forge.Float, sizeof(float), &val);
+// idle:        if(props_client_flush(&client, &forge, &ref)) write_function(...);
+
+typedef struct _props_client_t props_client_t;
+
+typedef void (*props_client_cb_t)(void *data, LV2_URID property);
+
+typedef enum _props_client_flag_t {
+	PROPS_CLIENT_FLAG_KNOWN   = 0, // value received
+	PROPS_CLIENT_FLAG_GETTING = 1, // patch:Get sent
+	PROPS_CLIENT_FLAG_WRITE   = 2, // changed, to be flushed
+
+	PROPS_CLIENT_FLAG_MAX
+} props_client_flag_t;
+
+struct _props_client_t {
+	props_client_cb_t cb;
+	void *data;
+
+	int32_t sequence_num;
+	int32_t inflight; // sequence number of the last unacknowledged flush
+
+	LV2_Atom_Forge forge; // only for its object type URIDs
+	uint32_t *flags [PROPS_CLIENT_FLAG_MAX]; // bitsets, indexed like impls, after the index
+
+	props_t props; // must be last, followed by impls and index, see PROPS_CLIENT_T
+};
+
+#define PROPS_CLIENT_INDEX_SIZE(N) \
+	( PROPS_INDEX_SIZE(N) \
+	+ PROPS_CLIENT_FLAG_MAX*PROPS_BITS(N)*sizeof(uint32_t) )
+
+#define PROPS_CLIENT_T(CLIENT, MAX_NIMPLS) \
+	props_client_t CLIENT; \
+	props_impl_t _client_impls [MAX_NIMPLS]; \
+	uint8_t _client_index [PROPS_CLIENT_INDEX_SIZE(MAX_NIMPLS)]
+
+// non-rt, value_base is the UI's mirror of the plugin's state structure
+static inline int
+props_client_init(props_client_t *client, const char *subject,
+	const props_def_t *defs, int nimpls, void *value_base, LV2_URID_Map *map,
+	props_client_cb_t cb, void *data);
+
+// non-rt, consumes patch:Set/Put/Ack/Error of the plugin's notify port and
+// calls cb for each property changed in the mirror, returns 1 if handled
+static inline int
+props_client_advance(props_client_t *client, const LV2_Atom_Object *obj);
+
+// non-rt, whether a value has been received since init or the last sync
+static inline bool
+props_client_known(props_client_t *client, LV2_URID property);
+
+// non-rt, forges a patch:Get unless the value is known or already asked for,
+// returns true if one was forged
+static inline bool
+props_client_get(props_client_t *client, LV2_Atom_Forge *forge,
+	LV2_URID property, LV2_Atom_Forge_Ref *ref);
+
+// non-rt, forgets all values and forges a wildcard patch:Get
+static inline void
+props_client_sync(props_client_t *client, LV2_Atom_Forge *forge,
+	LV2_Atom_Forge_Ref *ref);
+
+// non-rt, changes the mirror, the value is sent with the next flush, incoming
+// values of the property are ignored until then
+static inline int
+props_client_set(props_client_t *client, LV2_URID property, LV2_URID type,
+	uint32_t size, const void *body);
+
+// non-rt, marks an element of an array property as changed in the mirror
+static inline void
+props_client_dirty(props_client_t *client, LV2_URID property, uint32_t index);
+
+// non-rt, forges a single patch:Set object of all properties changed since the
+// last flush, to be sent with atom:eventTransfer, returns their count. Many
+// changes of a property in between are coalesced to its latest value. A
+// rejected flush forgets all values, see props_client_known
+static inline unsigned
+props_client_flush(props_client_t *client, LV2_Atom_Forge *forge,
+	LV2_Atom_Forge_Ref *ref);
+
+/*****************************************************************************
+ * API END
+ *****************************************************************************/
+
+static inline bool
+_props_client_flag(props_client_t *client, const props_impl_t *impl,
+	props_client_flag_t flag)
+{
+	const unsigned idx = impl - client->props.impls;
+
+	return client->flags[flag][idx / 32] & (1U << (idx % 32));
+}
+
+static inline void
+_props_client_flag_set(props_client_t *client, const props_impl_t *impl,
+	props_client_flag_t flag, bool on)
+{
+	const unsigned idx = impl - client->props.impls;
+	const uint32_t mask = 1U << (idx % 32);
+
+	if(on)
+		client->flags[flag][idx / 32] |= mask;
+	else
+		client->flags[flag][idx / 32] &= ~mask;
+}
+
+static inline void
+_props_client_apply(props_client_t *client, props_impl_t *impl,
+	const LV2_Atom *index, const LV2_Atom *value)
+{
+	props_t *props = &client->props;
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+
+	if(_props_client_flag(client, impl, PROPS_CLIENT_FLAG_WRITE))
+		return; // local changes win until flushed
+
+	if(shape->count)
+	{
+		if(!_props_impl_set_array(props, impl, index, value))
+			return;
+
+		_props_impl_clean(props, impl);
+	}
+	else
+	{
+		if( (value->type != impl->type) || (value->size > shape->max_size) )
+			return;
+
+		_props_impl_set(props, impl, value->type, value->size,
+			LV2_ATOM_BODY_CONST(value));
+	}
+
+	_props_client_flag_set(client, impl, PROPS_CLIENT_FLAG_KNOWN, true);
+	_props_client_flag_set(client, impl, PROPS_CLIENT_FLAG_GETTING, false);
+
+	if(client->cb)
+		client->cb(client->data, impl->property);
+}
+
+// patch:property as atom:Vector of URIDs, patch:value as atom:Tuple
+static inline void
+_props_client_apply_bulk(props_client_t *client, const LV2_Atom *property,
+	const LV2_Atom *value)
+{
+	props_t *props = &client->props;
+	const uint8_t *body = (const uint8_t *)LV2_ATOM_BODY_CONST(value);
+	uint32_t nproperties = 0;
+
+	const LV2_URID *properties = (const LV2_URID *)_props_vector_elems(props,
+		property, props->urid.atom_urid, sizeof(LV2_URID), &nproperties);
+
+	if(!properties || (value->type != props->urid.atom_tuple))
+		return;
+
+	size_t offset = 0;
+	for(uint32_t i = 0; i < nproperties; i++)
+	{
+		const LV2_Atom *item = (const LV2_Atom *)(body + offset);
+
+		// each item must lie within the tuple and be large enough for its type
+		if(  (offset + sizeof(LV2_Atom) > value->size)
+			|| (item->size > value->size - offset - sizeof(LV2_Atom))
+			|| (item->size < _props_type_size(props, item->type)) )
+		{
+			break;
+		}
+
+		offset += sizeof(LV2_Atom) + lv2_atom_pad_size(item->size);
+
+		props_impl_t *impl = _props_impl_get(props, properties[i]);
+
+		if(impl)
+			_props_client_apply(client, impl, NULL, item);
+	}
+}
+
+static inline int
+props_client_init(props_client_t *client, const char *subject,
+	const props_def_t *defs, int nimpls, void *value_base, LV2_URID_Map *map,
+	props_client_cb_t cb, void *data)
+{
+	if(!client)
+		return 0;
+
+	client->cb = cb;
+	client->data = data;
+	client->sequence_num = 0;
+	client->inflight = 0;
+	lv2_atom_forge_init(&client->forge, map);
+
+	// the UI is the only writer of its mirror
+	if(!props_init(&client->props, subject, defs, nimpls, value_base, NULL,
+		map, data))
+	{
+		return 0;
+	}
+
+	// the client's bitsets follow the index, see PROPS_CLIENT_INDEX_SIZE
+	props_t *props = &client->props;
+	const unsigned nbits = PROPS_BITS(props->nimpls);
+	uint32_t *bits = (uint32_t *)((uint8_t *)&props->impls[props->nimpls]
+		+ PROPS_INDEX_SIZE(props->nimpls));
+
+	memset(bits, 0x0, PROPS_CLIENT_FLAG_MAX*nbits*sizeof(uint32_t));
+	for(unsigned f = 0; f < PROPS_CLIENT_FLAG_MAX; f++)
+		client->flags[f] = &bits[f*nbits];
+
+	return 1;
+}
+
+static inline int
+props_client_advance(props_client_t *client, const LV2_Atom_Object *obj)
+{
+	props_t *props = &client->props;
+	const LV2_Atom_URID *subject = NULL;
+	const LV2_Atom_URID *property = NULL;
+	const LV2_Atom_Int *sequence = NULL;
+	const LV2_Atom *value = NULL;
+	const LV2_Atom *index = NULL;
+	const LV2_Atom_Object *body = NULL;
+
+	if(  !lv2_atom_forge_is_object_type(&client->forge, obj->atom.type)
+		|| !_props_object_check(props, obj) )
+	{
+		return 0;
+	}
+
+	lv2_atom_object_get(obj,
+		props->urid.patch_subject, &subject,
+		props->urid.patch_property, &property,
+		props->urid.patch_sequence, &sequence,
+		props->urid.patch_value, &value,
+		props->urid.props_index, &index,
+		props->urid.patch_body, &body,
+		0);
+
+	// check for a matching optional subject
+	if(  (subject && props->urid.subject)
+		&& ( (subject->atom.type != props->urid.atom_urid)
+			|| (subject->body != props->urid.subject) ) )
+	{
+		return 0;
+	}
+
+	if(obj->body.otype == props->urid.patch_set)
+	{
+		if(!property || !value)
+			return 0;
+
+		if(property->atom.type == props->urid.atom_vector) // bulk
+		{
+			_props_client_apply_bulk(client, &property->atom, value);
+
+			return 1;
+		}
+
+		props_impl_t *impl = (property->atom.type == props->urid.atom_urid)
+			? _props_impl_get(props, property->body)
+			: NULL;
+
+		if(!impl)
+			return 0;
+
+		_props_client_apply(client, impl, index, value);
+
+		return 1;
+	}
+	else if(obj->body.otype == props->urid.patch_put)
+	{
+		if(  !body
+			|| !lv2_atom_forge_is_object_type(&client->forge, body->atom.type)
+			|| !_props_object_check(props, body) )
+		{
+			return 0;
+		}
+
+		LV2_ATOM_OBJECT_FOREACH(body, prop)
+		{
+			props_impl_t *impl = _props_impl_get(props, prop->key);
+
+			if(impl)
+				_props_client_apply(client, impl, NULL, &prop->value);
+		}
+
+		return 1;
+	}
+	else if( (obj->body.otype == props->urid.patch_ack)
+		|| (obj->body.otype == props->urid.patch_error) )
+	{
+		if(  !client->inflight || !sequence
+			|| (sequence->atom.type != props->urid.atom_int)
+			|| (sequence->body != client->inflight) )
+		{
+			return 0;
+		}
+
+		client->inflight = 0;
+
+		if(obj->body.otype == props->urid.patch_error)
+		{
+			for(unsigned i = 0; i < props->nimpls; i++)
+				_props_client_flag_set(client, &props->impls[i], PROPS_CLIENT_FLAG_KNOWN,
+					false);
+		}
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static inline bool
+props_client_known(props_client_t *client, LV2_URID property)
+{
+	props_t *props = &client->props;
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	return impl && _props_client_flag(client, impl, PROPS_CLIENT_FLAG_KNOWN);
+}
+
+static inline LV2_Atom_Forge_Ref
+_props_client_patch_get(props_client_t *client, LV2_Atom_Forge *forge,
+	props_impl_t *impl)
+{
+	props_t *props = &client->props;
+	LV2_Atom_Forge_Frame obj_frame;
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_object(forge, &obj_frame, 0,
+		props->urid.patch_get);
+	{
+		if(props->urid.subject) // is optional
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_subject);
+			if(ref)
+				ref = lv2_atom_forge_urid(forge, props->urid.subject);
+		}
+
+		if(impl) // wildcard otherwise
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_property);
+			if(ref)
+				ref = lv2_atom_forge_urid(forge, impl->property);
+		}
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	return ref;
+}
+
+static inline bool
+props_client_get(props_client_t *client, LV2_Atom_Forge *forge,
+	LV2_URID property, LV2_Atom_Forge_Ref *ref)
+{
+	props_t *props = &client->props;
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(  !impl || !*ref
+		|| _props_client_flag(client, impl, PROPS_CLIENT_FLAG_KNOWN)
+		|| _props_client_flag(client, impl, PROPS_CLIENT_FLAG_GETTING) )
+	{
+		return false;
+	}
+
+	*ref = _props_client_patch_get(client, forge, impl);
+	if(!*ref)
+		return false;
+
+	_props_client_flag_set(client, impl, PROPS_CLIENT_FLAG_GETTING, true);
+
+	return true;
+}
+
+static inline void
+props_client_sync(props_client_t *client, LV2_Atom_Forge *forge,
+	LV2_Atom_Forge_Ref *ref)
+{
+	props_t *props = &client->props;
+
+	if(!*ref)
+		return;
+
+	*ref = _props_client_patch_get(client, forge, NULL);
+
+	for(unsigned i = 0; *ref && (i < props->nimpls); i++)
+	{
+		props_impl_t *impl = &props->impls[i];
+
+		_props_client_flag_set(client, impl, PROPS_CLIENT_FLAG_KNOWN, false);
+		_props_client_flag_set(client, impl, PROPS_CLIENT_FLAG_GETTING,
+			!_props_impl_flag(props, impl, PROPS_FLAG_HIDDEN));
+	}
+}
+
+static inline int
+props_client_set(props_client_t *client, LV2_URID property, LV2_URID type,
+	uint32_t size, const void *body)
+{
+	props_t *props = &client->props;
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(!impl)
+		return 0;
+
+	const props_shape_t *shape = _props_impl_shape(props, impl);
+
+	if(shape->count || (impl->type != type) || (size > shape->max_size))
+		return 0;
+
+	_props_impl_set(props, impl, type, size, body);
+	_props_client_flag_set(client, impl, PROPS_CLIENT_FLAG_WRITE, true);
+
+	return 1;
+}
+
+static inline void
+props_client_dirty(props_client_t *client, LV2_URID property, uint32_t index)
+{
+	props_t *props = &client->props;
+	props_impl_t *impl = _props_impl_get(props, property);
+
+	if(impl && (index < _props_impl_shape(props, impl)->count))
+	{
+		_props_impl_mark(props, impl, index);
+		_props_client_flag_set(client, impl, PROPS_CLIENT_FLAG_WRITE, true);
+	}
+}
+
+static inline unsigned
+props_client_flush(props_client_t *client, LV2_Atom_Forge *forge,
+	LV2_Atom_Forge_Ref *ref)
+{
+	props_t *props = &client->props;
+	props_impl_t *single = NULL;
+	unsigned n = 0;
+
+	for(unsigned i = 0; i < props->nimpls; i++)
+	{
+		props_impl_t *impl = &props->impls[i];
+
+		if(_props_client_flag(client, impl, PROPS_CLIENT_FLAG_WRITE))
+		{
+			single = impl;
+			n++;
+		}
+	}
+
+	if(!n || !*ref)
+		return 0;
+
+	if(++client->sequence_num <= 0) // sequence numbers are positive
+		client->sequence_num = 1;
+
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Frame tup_frame;
+
+	*ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.patch_set);
+	{
+		if(props->urid.subject) // is optional
+		{
+			if(*ref)
+				*ref = lv2_atom_forge_key(forge, props->urid.patch_subject);
+			if(*ref)
+				*ref = lv2_atom_forge_urid(forge, props->urid.subject);
+		}
+
+		if(*ref)
+			*ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
+		if(*ref)
+			*ref = lv2_atom_forge_int(forge, client->sequence_num);
+
+		if(n == 1)
+		{
+			if(*ref)
+				*ref = lv2_atom_forge_key(forge, props->urid.patch_property);
+			if(*ref)
+				*ref = lv2_atom_forge_urid(forge, single->property);
+
+			if(_props_impl_shape(props, single)->count)
+			{
+				if(*ref)
+					*ref = _props_patch_elements(props, forge, single, true);
+			}
+			else
+			{
+				if(*ref)
+					*ref = lv2_atom_forge_key(forge, props->urid.patch_value);
+				if(*ref)
+					*ref = _props_forge_value(props, forge, single);
+			}
+		}
+		else // patch:property as atom:Vector of URIDs, patch:value as atom:Tuple
+		{
+			const LV2_Atom_Vector_Body body = { sizeof(LV2_URID), props->urid.atom_urid };
+			const uint32_t size = sizeof(body) + n*sizeof(LV2_URID);
+
+			if(*ref)
+				*ref = lv2_atom_forge_key(forge, props->urid.patch_property);
+			if(*ref)
+				*ref = lv2_atom_forge_atom(forge, size, props->urid.atom_vector);
+			if(*ref)
+				*ref = lv2_atom_forge_raw(forge, &body, sizeof(body));
+			for(unsigned i = 0; *ref && (i < props->nimpls); i++)
+			{
+				props_impl_t *impl = &props->impls[i];
+
+				if(_props_client_flag(client, impl, PROPS_CLIENT_FLAG_WRITE))
+					*ref = lv2_atom_forge_raw(forge, &impl->property, sizeof(LV2_URID));
+			}
+			if(*ref)
+				lv2_atom_forge_pad(forge, size);
+
+			if(*ref)
+				*ref = lv2_atom_forge_key(forge, props->urid.patch_value);
+			if(*ref)
+				*ref = lv2_atom_forge_tuple(forge, &tup_frame);
+			for(unsigned i = 0; *ref && (i < props->nimpls); i++)
+			{
+				props_impl_t *impl = &props->impls[i];
+
+				if(_props_client_flag(client, impl, PROPS_CLIENT_FLAG_WRITE))
+					*ref = _props_forge_value(props, forge, impl);
+			}
+			if(*ref)
+				lv2_atom_forge_pop(forge, &tup_frame);
+		}
+	}
+	if(*ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	if(!*ref)
+		return 0; // try again with a larger buffer
+
+	for(unsigned i = 0; i < props->nimpls; i++)
+	{
+		props_impl_t *impl = &props->impls[i];
+
+		if(_props_client_flag(client, impl, PROPS_CLIENT_FLAG_WRITE))
+		{
+			_props_client_flag_set(client, impl, PROPS_CLIENT_FLAG_WRITE, false);
+			_props_impl_clean(props, impl);
+		}
+	}
+
+	client->inflight = client->sequence_num;
+
+	return n;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _LV2_PROPS_CLIENT_H_
@@ -0,0 +1,589 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _LV2_PROPS_LIBRARY_H_
+#define _LV2_PROPS_LIBRARY_H_
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <props.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************
+ * API START
+ *****************************************************************************/
+
+// binary preset library in native byte order, all offsets are from the start
+// of the file, all tables and values are 8-byte aligned:
+//
+// header | keys, sorted by URI | presets, sorted by name
+//        | per preset: values of all keys, packed values | strings
+
+#define PROPS_LIBRARY_MAGIC   0x53505250 // "PRPS"
+#define PROPS_LIBRARY_VERSION 1
+
+typedef struct _props_library_header_t props_library_header_t;
+typedef struct _props_library_key_t props_library_key_t;
+typedef struct _props_library_preset_t props_library_preset_t;
+typedef struct _props_library_value_t props_library_value_t;
+typedef struct _props_library_t props_library_t;
+
+struct _props_library_header_t {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nkeys;
+	uint32_t npresets;
+	uint32_t keys; // props_library_key_t [nkeys]
+	uint32_t presets; // props_library_preset_t [npresets]
+};
+
+struct _props_library_key_t {
+	uint32_t uri; // string
+	uint32_t type; // string, atom:Vector for arrays
+};
+
+struct _props_library_preset_t {
+	uint32_t name; // string
+	uint32_t values; // props_library_value_t [nkeys]
+};
+
+struct _props_library_value_t {
+	uint32_t offset; // 0: not part of the preset
+	uint32_t size;
+};
+
+struct _props_library_t {
+	const uint8_t *base;
+	size_t size;
+	const props_library_header_t *header;
+	const props_library_key_t *keys;
+	const props_library_preset_t *presets;
+};
+
+// non-rt, writes npresets slots of a bank, see props_bank, to a library,
+// replaces path atomically, fails for duplicate names
+static inline int
+props_library_save(props_t *props, const char *path,
+	const char *const *names, const props_slot_t *slots, unsigned npresets);
+
+// non-rt, maps a library read-only, only the tables are checked up front
+static inline int
+props_library_open(props_library_t *lib, const char *path);
+
+// non-rt
+static inline void
+props_library_close(props_library_t *lib);
+
+// non-rt
+static inline unsigned
+props_library_count(const props_library_t *lib);
+
+// non-rt, in sort order
+static inline const char *
+props_library_name(const props_library_t *lib, unsigned preset);
+
+// non-rt, returns -1 if not found
+static inline int
+props_library_find(const props_library_t *lib, const char *name);
+
+// non-rt, like props_restore with a preset as state
+static inline LV2_State_Status
+props_library_restore(props_t *props, const props_library_t *lib,
+	unsigned preset, const LV2_Feature *const *features);
+
+/*****************************************************************************
+ * API END
+ *****************************************************************************/
+
+typedef struct _props_library_state_t props_library_state_t;
+
+struct _props_library_state_t {
+	props_t *props;
+	const props_library_t *lib;
+	const props_library_value_t *values;
+};
+
+static inline uint32_t
+_props_library_pad(uint32_t size)
+{
+	return (size + 7) & ~7U;
+}
+
+static inline int
+_props_library_impl_cmp(const void *a, const void *b)
+{
+	const props_impl_t *A = *(const props_impl_t *const *)a;
+	const props_impl_t *B = *(const props_impl_t *const *)b;
+
+	return strcmp(A->def->property, B->def->property);
+}
+
+// sorts pointers into the names array, their distance to it is the slot
+static inline int
+_props_library_name_cmp(const void *a, const void *b)
+{
+	return strcmp(**(const char *const *const *)a, **(const char *const *const *)b);
+}
+
+// size of a slot's value as saved by props_save, 0 if not part of it
+static inline uint32_t
+_props_library_size(props_t *props, const props_slot_t *slot, unsigned i)
+{
+	const props_impl_t *impl = &props->impls[i];
+	const props_shape_t *shape = &props->shapes[i];
+
+	if(_props_flag(props, i, PROPS_FLAG_POOLED))
+		return 0; // not part of the value structure
+
+	if(shape->count)
+		return sizeof(LV2_Atom_Vector_Body) + shape->count*impl->value.size;
+
+	if(shape->cls != PROP_CLASS_VAR)
+		return impl->value.size;
+
+	return slot->sizes && (slot->sizes[i] <= shape->max_size)
+		? slot->sizes[i]
+		: 0;
+}
+
+static inline uint32_t
+_props_library_layout(props_t *props, props_impl_t **keys, uint32_t nkeys,
+	const props_slot_t *slots, unsigned npresets, uint32_t *strings)
+{
+	uint32_t offset = _props_library_pad(sizeof(props_library_header_t))
+		+ _props_library_pad(nkeys*sizeof(props_library_key_t))
+		+ _props_library_pad(npresets*sizeof(props_library_preset_t));
+
+	for(unsigned p = 0; p < npresets; p++)
+	{
+		offset += _props_library_pad(nkeys*sizeof(props_library_value_t));
+
+		for(uint32_t k = 0; k < nkeys; k++)
+			offset += _props_library_pad(_props_library_size(props, &slots[p], keys[k] - props->impls));
+	}
+
+	*strings = offset;
+
+	return offset;
+}
+
+static inline uint32_t
+_props_library_strcpy(uint8_t *buf, uint32_t *strings, const char *str)
+{
+	const uint32_t offset = *strings;
+	const size_t len = strlen(str) + 1;
+
+	memcpy(buf + offset, str, len);
+	*strings += len;
+
+	return offset;
+}
+
+static inline void
+_props_library_build(props_t *props, uint8_t *buf, props_impl_t **keys,
+	uint32_t nkeys, const char *const *names, const char *const **sorted,
+	const props_slot_t *slots, unsigned npresets, uint32_t strings)
+{
+	props_library_header_t *header = (props_library_header_t *)buf;
+
+	header->magic = PROPS_LIBRARY_MAGIC;
+	header->version = PROPS_LIBRARY_VERSION;
+	header->nkeys = nkeys;
+	header->npresets = npresets;
+	header->keys = _props_library_pad(sizeof(props_library_header_t));
+	header->presets = header->keys
+		+ _props_library_pad(nkeys*sizeof(props_library_key_t));
+
+	props_library_key_t *lkeys = (props_library_key_t *)(buf + header->keys);
+	props_library_preset_t *presets = (props_library_preset_t *)(buf + header->presets);
+
+	for(uint32_t k = 0; k < nkeys; k++)
+	{
+		lkeys[k].uri = _props_library_strcpy(buf, &strings, keys[k]->def->property);
+		lkeys[k].type = _props_library_strcpy(buf, &strings,
+			keys[k]->def->count ? LV2_ATOM__Vector : keys[k]->def->type);
+	}
+
+	uint32_t values = header->presets
+		+ _props_library_pad(npresets*sizeof(props_library_preset_t));
+
+	for(unsigned p = 0; p < npresets; p++)
+	{
+		// slot of the preset with the p-th name in sort order
+		const unsigned s = sorted[p] - names;
+		const props_slot_t *slot = &slots[s];
+		props_library_value_t *table = (props_library_value_t *)(buf + values);
+
+		presets[p].name = _props_library_strcpy(buf, &strings, names[s]);
+		presets[p].values = values;
+		values += _props_library_pad(nkeys*sizeof(props_library_value_t));
+
+		for(uint32_t k = 0; k < nkeys; k++)
+		{
+			props_impl_t *impl = keys[k];
+			const uint32_t size = _props_library_size(props, slot, impl - props->impls);
+			const uint8_t *src = (const uint8_t *)slot->base + impl->def->offset;
+
+			if(!size)
+				continue;
+
+			table[k].offset = values;
+			table[k].size = size;
+
+			if(impl->def->count)
+			{
+				LV2_Atom_Vector_Body *vec = (LV2_Atom_Vector_Body *)(buf + values);
+
+				vec->child_size = impl->value.size;
+				vec->child_type = impl->type;
+				_props_impl_gather(props, impl, &vec[1], src);
+			}
+			else
+			{
+				memcpy(buf + values, src, size);
+			}
+
+			values += _props_library_pad(size);
+		}
+	}
+}
+
+// writes to a temporary file next to path and renames it over path, so a
+// library mapped by props_library_open is never seen half-written
+static inline int
+_props_library_write(const char *path, const uint8_t *buf, uint32_t size)
+{
+	const size_t len = strlen(path);
+	char *tmp = (char *)malloc(len + 8);
+	int ret = 0;
+
+	if(!tmp)
+		return 0;
+
+	memcpy(tmp, path, len);
+	memcpy(tmp + len, ".XXXXXX", 8);
+
+	const int fd = mkstemp(tmp);
+	if(fd != -1)
+	{
+		FILE *f = fdopen(fd, "wb");
+
+		if(f)
+		{
+			ret = (fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == 0)
+				&& (fwrite(buf, 1, size, f) == size);
+
+			if(fclose(f))
+				ret = 0;
+		}
+		else
+		{
+			close(fd);
+		}
+
+		if(!ret || rename(tmp, path))
+		{
+			unlink(tmp);
+			ret = 0;
+		}
+	}
+
+	free(tmp);
+
+	return ret;
+}
+
+static inline int
+props_library_save(props_t *props, const char *path,
+	const char *const *names, const props_slot_t *slots, unsigned npresets)
+{
+	props_impl_t **keys = (props_impl_t **)calloc(props->nimpls + 1, sizeof(props_impl_t *));
+	const char *const **sorted = (const char *const **)calloc(npresets + 1,
+		sizeof(const char *const *));
+	uint8_t *buf = NULL;
+	int ret = 0;
+
+	if(keys && sorted)
+	{
+		uint32_t nkeys = 0;
+		for(unsigned i = 0; i < props->nimpls; i++)
+		{
+			if(!_props_flag(props, i, PROPS_FLAG_POOLED))
+				keys[nkeys++] = &props->impls[i];
+		}
+		qsort(keys, nkeys, sizeof(props_impl_t *), _props_library_impl_cmp);
+
+		for(unsigned p = 0; p < npresets; p++)
+			sorted[p] = &names[p];
+		qsort(sorted, npresets, sizeof(const char *const *), _props_library_name_cmp);
+
+		bool unique = true;
+		for(unsigned p = 1; p < npresets; p++)
+		{
+			if(!strcmp(*sorted[p - 1], *sorted[p]))
+				unique = false; // props_library_find would be ambiguous
+		}
+
+		uint32_t strings;
+		uint32_t size = _props_library_layout(props, keys, nkeys, slots, npresets,
+			&strings);
+
+		for(uint32_t k = 0; k < nkeys; k++)
+		{
+			size += strlen(keys[k]->def->property) + 1;
+			size += strlen(keys[k]->def->count ? LV2_ATOM__Vector : keys[k]->def->type) + 1;
+		}
+		for(unsigned p = 0; p < npresets; p++)
+			size += strlen(names[p]) + 1;
+
+		buf = unique
+			? (uint8_t *)calloc(1, size)
+			: NULL;
+		if(buf)
+		{
+			_props_library_build(props, buf, keys, nkeys, names, sorted, slots,
+				npresets, strings);
+
+			ret = _props_library_write(path, buf, size);
+		}
+	}
+
+	free(buf);
+	free(sorted);
+	free(keys);
+
+	return ret;
+}
+
+// NULL for offsets outside of the library or without terminating NUL
+static inline const char *
+_props_library_string(const props_library_t *lib, uint32_t offset)
+{
+	if( (offset >= lib->size) || !memchr(lib->base + offset, '\0', lib->size - offset) )
+		return NULL;
+
+	return (const char *)lib->base + offset;
+}
+
+static inline bool
+_props_library_table(const props_library_t *lib, uint32_t offset, uint32_t n,
+	size_t size)
+{
+	return !(offset % 8)
+		&& (offset <= lib->size)
+		&& (n <= (lib->size - offset) / size);
+}
+
+static inline int
+props_library_open(props_library_t *lib, const char *path)
+{
+	memset(lib, 0x0, sizeof(props_library_t));
+
+	const int fd = open(path, O_RDONLY);
+	if(fd == -1)
+		return 0;
+
+	struct stat st;
+	if(fstat(fd, &st) || (st.st_size < (off_t)sizeof(props_library_header_t))
+		|| ((uint64_t)st.st_size > UINT32_MAX) )
+	{
+		close(fd);
+		return 0;
+	}
+
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); // the mapping stays valid
+
+	if(base == MAP_FAILED)
+		return 0;
+
+	lib->base = (const uint8_t *)base;
+	lib->size = st.st_size;
+	lib->header = (const props_library_header_t *)base;
+
+	const props_library_header_t *header = lib->header;
+
+	if(  (header->magic != PROPS_LIBRARY_MAGIC)
+		|| (header->version != PROPS_LIBRARY_VERSION)
+		|| !_props_library_table(lib, header->keys, header->nkeys,
+			sizeof(props_library_key_t))
+		|| !_props_library_table(lib, header->presets, header->npresets,
+			sizeof(props_library_preset_t)) )
+	{
+		props_library_close(lib);
+		return 0;
+	}
+
+	lib->keys = (const props_library_key_t *)(lib->base + header->keys);
+	lib->presets = (const props_library_preset_t *)(lib->base + header->presets);
+
+	for(uint32_t p = 0; p < header->npresets; p++)
+	{
+		if(  !_props_library_string(lib, lib->presets[p].name)
+			|| !_props_library_table(lib, lib->presets[p].values, header->nkeys,
+				sizeof(props_library_value_t)) )
+		{
+			props_library_close(lib);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static inline void
+props_library_close(props_library_t *lib)
+{
+	if(lib->base)
+		munmap((void *)lib->base, lib->size);
+
+	memset(lib, 0x0, sizeof(props_library_t));
+}
+
+static inline unsigned
+props_library_count(const props_library_t *lib)
+{
+	return lib->header
+		? lib->header->npresets
+		: 0;
+}
+
+static inline const char *
+props_library_name(const props_library_t *lib, unsigned preset)
+{
+	if(preset >= props_library_count(lib))
+		return NULL;
+
+	return _props_library_string(lib, lib->presets[preset].name);
+}
+
+static inline int
+props_library_find(const props_library_t *lib, const char *name)
+{
+	int lo = 0;
+	int hi = (int)props_library_count(lib) - 1;
+
+	while(lo <= hi)
+	{
+		const int mid = lo + (hi - lo) / 2;
+		const int cmp = strcmp(name, props_library_name(lib, mid));
+
+		if(cmp == 0)
+			return mid;
+		else if(cmp < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+
+	return -1;
+}
+
+static inline int
+_props_library_key(const props_library_t *lib, const char *uri)
+{
+	int lo = 0;
+	int hi = (int)lib->header->nkeys - 1;
+
+	while(lo <= hi)
+	{
+		const int mid = lo + (hi - lo) / 2;
+		const char *key = _props_library_string(lib, lib->keys[mid].uri);
+
+		if(!key)
+			return -1;
+
+		const int cmp = strcmp(uri, key);
+
+		if(cmp == 0)
+			return mid;
+		else if(cmp < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+
+	return -1;
+}
+
+static inline const void *
+_props_library_retrieve(LV2_State_Handle handle, uint32_t key, size_t *size,
+	uint32_t *type, uint32_t *flags)
+{
+	props_library_state_t *state = (props_library_state_t *)handle;
+	props_t *props = state->props;
+	const props_library_t *lib = state->lib;
+	props_impl_t *impl = _props_impl_get(props, key);
+
+	if(!impl)
+		return NULL;
+
+	const int k = _props_library_key(lib, impl->def->property);
+	if(k < 0)
+		return NULL;
+
+	const props_library_value_t *value = &state->values[k];
+	const char *type_uri = _props_library_string(lib, lib->keys[k].type);
+
+	if(  !value->offset || !type_uri
+		|| (value->offset % 8) // values are aligned for direct access
+		|| (value->offset > lib->size)
+		|| (value->size > lib->size - value->offset) )
+	{
+		return NULL;
+	}
+
+	if(!strcmp(type_uri, LV2_ATOM__Vector))
+		*type = props->urid.atom_vector;
+	else if(!strcmp(type_uri, impl->def->type))
+		*type = impl->type;
+	else
+		return NULL; // type has changed since
+
+	*size = value->size;
+	*flags = LV2_STATE_IS_POD | LV2_STATE_IS_PORTABLE;
+
+	return lib->base + value->offset;
+}
+
+static inline LV2_State_Status
+props_library_restore(props_t *props, const props_library_t *lib,
+	unsigned preset, const LV2_Feature *const *features)
+{
+	if(preset >= props_library_count(lib))
+		return LV2_STATE_ERR_UNKNOWN;
+
+	props_library_state_t state = {
+		.props = props,
+		.lib = lib,
+		.values = (const props_library_value_t *)(lib->base + lib->presets[preset].values)
+	};
+
+	return props_restore(props, _props_library_retrieve, &state, 0, features);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _LV2_PROPS_LIBRARY_H_
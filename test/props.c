@@ -26,6 +26,7 @@
 #define PROPS_TEST_URI	PROPS_PREFIX"test"
 
 #define MAX_NPROPS 7
+#define MAX_NDERIVED 2
 #define MAX_STRLEN 256
 
 typedef struct _plugstate_t plugstate_t;
@@ -49,14 +50,10 @@ struct _plughandle_t {
 	LV2_Atom_Forge_Ref ref;
 
 	PROPS_T(props, MAX_NPROPS);
+	uint32_t graph [PROPS_GRAPH_SIZE(MAX_NPROPS, MAX_NDERIVED)/sizeof(uint32_t)];
 	plugstate_t state;
 	plugstate_t stash;
 
-	struct {
-		LV2_URID val2;
-		LV2_URID val4;
-	} urid;
-
 	const LV2_Atom_Sequence *event_in;
 	LV2_Atom_Sequence *event_out;
 };
@@ -70,29 +67,24 @@ _intercept(void *data, int64_t frames __attribute__((unused)), props_impl_t *imp
 }
 
 static void
-_intercept_stat1(void *data, int64_t frames, props_impl_t *impl)
+_derive_stat2(void *data, props_impl_t *impl __attribute__((unused)))
 {
 	plughandle_t *handle = data;
 
-	_intercept(data, frames, impl);
-
 	handle->state.val2 = handle->state.val1 * 2;
-
-	props_set(&handle->props, &handle->forge, frames, handle->urid.val2, &handle->ref);
 }
 
 static void
-_intercept_stat3(void *data, int64_t frames, props_impl_t *impl)
+_derive_stat4(void *data, props_impl_t *impl __attribute__((unused)))
 {
 	plughandle_t *handle = data;
 
-	_intercept(data, frames, impl);
-
 	handle->state.val4 = handle->state.val3 * 2;
-
-	props_set(&handle->props, &handle->forge, frames, handle->urid.val4, &handle->ref);
 }
 
+static const char *const stat2_depends [] = { PROPS_PREFIX"statInt", NULL };
+static const char *const stat4_depends [] = { PROPS_PREFIX"statFloat", NULL };
+
 static void
 _intercept_stat6(void *data, int64_t frames, props_impl_t *impl)
 {
@@ -113,7 +105,7 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.property = PROPS_PREFIX"statInt",
 		.offset = offsetof(plugstate_t, val1),
 		.type = LV2_ATOM__Int,
-		.event_cb = _intercept_stat1,
+		.event_cb = _intercept,
 	},
 	{
 		.property = PROPS_PREFIX"statLong",
@@ -121,12 +113,14 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.offset = offsetof(plugstate_t, val2),
 		.type = LV2_ATOM__Long,
 		.event_cb = _intercept,
+		.derive = _derive_stat2,
+		.depends = stat2_depends
 	},
 	{
 		.property = PROPS_PREFIX"statFloat",
 		.offset = offsetof(plugstate_t, val3),
 		.type = LV2_ATOM__Float,
-		.event_cb = _intercept_stat3,
+		.event_cb = _intercept,
 	},
 	{	
 		.property = PROPS_PREFIX"statDouble",
@@ -134,6 +128,8 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.offset = offsetof(plugstate_t, val4),
 		.type = LV2_ATOM__Double,
 		.event_cb = _intercept,
+		.derive = _derive_stat4,
+		.depends = stat4_depends
 	},
 	{
 		.property = PROPS_PREFIX"statString",
@@ -194,18 +190,16 @@ instantiate(const LV2_Descriptor* descriptor,
 	lv2_log_logger_init(&handle->logger, handle->map, handle->log);
 	lv2_atom_forge_init(&handle->forge, handle->map);
 
-	if(!props_init(&handle->props, descriptor->URI,
-		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
+	if(  !props_init(&handle->props, descriptor->URI,
+			defs, MAX_NPROPS, &handle->state, &handle->stash,
+			handle->map, handle)
+		|| !props_graph(&handle->props, handle->graph, sizeof(handle->graph)) )
 	{
 		lv2_log_error(&handle->logger, "failed to initialize property structure\n");
 		free(handle);
 		return NULL;
 	}
 
-	handle->urid.val2 = props_map(&handle->props, PROPS_PREFIX"statLong");
-	handle->urid.val4 = props_map(&handle->props, PROPS_PREFIX"statDouble");
-
 	return handle;
 }
 
@@ -239,14 +233,20 @@ run(LV2_Handle instance, uint32_t nsamples __attribute__((unused)))
 
 	props_idle(&handle->props, &handle->forge, 0, &handle->ref);
 
+	int64_t frames = 0;
 	LV2_ATOM_SEQUENCE_FOREACH(handle->event_in, ev)
 	{
 		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
 
+		frames = ev->time.frames;
+
 		if(handle->ref)
-			props_advance(&handle->props, &handle->forge, ev->time.frames, obj, &handle->ref);
+			props_advance(&handle->props, &handle->forge, frames, obj, &handle->ref);
 	}
 
+	if(handle->ref) // derived properties once per run
+		props_derive(&handle->props, &handle->forge, frames, &handle->ref);
+
 	if(handle->ref)
 		lv2_atom_forge_pop(&handle->forge, &frame);
 	else
@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+#if defined(__linux__)
+#	include <unistd.h>
+#	include <sys/ioctl.h>
+#	include <sys/syscall.h>
+#	include <linux/perf_event.h>
+#endif
+
+#include <props.h>
+
+#define MAX_URIDS 2048
+#define MAX_NPROPS 1024
+#define MAX_URI 64
+#define NLOOKUPS (1 << 22)
+#define NSETS (1 << 20)
+#define BUF_SIZE 0x20000
+
+#define PROPS_PREFIX		"http://open-music-kontrollers.ch/lv2/props#"
+
+typedef struct _urid_t urid_t;
+typedef struct _handle_t handle_t;
+typedef struct _perf_t perf_t;
+
+struct _urid_t {
+	LV2_URID urid;
+	char *uri;
+};
+
+struct _handle_t {
+	PROPS_T(props, MAX_NPROPS);
+	float state [MAX_NPROPS];
+	float stash [MAX_NPROPS];
+
+	LV2_URID_Map map;
+	LV2_Atom_Forge forge;
+
+	urid_t urids [MAX_URIDS];
+	LV2_URID urid;
+
+	char uris [MAX_NPROPS][MAX_URI];
+	props_def_t defs [MAX_NPROPS];
+	LV2_URID order [MAX_NPROPS];
+
+	uint8_t msgs [BUF_SIZE];
+	uint8_t notify [BUF_SIZE];
+
+	atomic_bool contending;
+};
+
+struct _perf_t {
+	int fd;
+	struct timespec t0;
+};
+
+static LV2_URID
+_map(LV2_URID_Map_Handle instance, const char *uri)
+{
+	handle_t *handle = instance;
+
+	urid_t *itm;
+	for(itm=handle->urids; itm->urid; itm++)
+	{
+		if(!strcmp(itm->uri, uri))
+			return itm->urid;
+	}
+
+	assert(handle->urid + 1 < MAX_URIDS);
+
+	// create new
+	itm->urid = ++handle->urid;
+	itm->uri = strdup(uri);
+
+	return itm->urid;
+}
+
+static void
+_perf_start(perf_t *perf)
+{
+	perf->fd = -1;
+
+#if defined(__linux__)
+	struct perf_event_attr attr;
+
+	memset(&attr, 0x0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	perf->fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if(perf->fd != -1)
+	{
+		ioctl(perf->fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf->fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+
+	clock_gettime(CLOCK_MONOTONIC, &perf->t0);
+}
+
+static void
+_perf_stop(perf_t *perf, const char *label, unsigned nops)
+{
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	const double ns = (t1.tv_sec - perf->t0.tv_sec) * 1e9
+		+ (t1.tv_nsec - perf->t0.tv_nsec);
+
+	printf("%-24s %8.2f ns/op", label, ns / nops);
+
+#if defined(__linux__)
+	if(perf->fd != -1)
+	{
+		long long misses = 0;
+
+		ioctl(perf->fd, PERF_EVENT_IOC_DISABLE, 0);
+		if(read(perf->fd, &misses, sizeof(misses)) == sizeof(misses))
+			printf(" %8.4f cache-misses/op", (double)misses / nops);
+		close(perf->fd);
+	}
+	else
+#endif
+	{
+		printf("      n/a cache-misses/op");
+	}
+
+	printf("\n");
+}
+
+static void
+_bench_lookup(handle_t *handle)
+{
+	props_t *props = &handle->props;
+	LV2_URID sum = 0;
+	perf_t perf;
+
+	_perf_start(&perf);
+
+	for(unsigned i = 0; i < NLOOKUPS; i++)
+	{
+		props_impl_t *impl = _props_impl_get(props, handle->order[i % MAX_NPROPS]);
+
+		sum += impl->property;
+	}
+
+	_perf_stop(&perf, "lookup", NLOOKUPS);
+
+	assert(sum);
+}
+
+static void
+_bench_impl_set(handle_t *handle)
+{
+	props_t *props = &handle->props;
+	props_impl_t *impls [MAX_NPROPS];
+	perf_t perf;
+
+	for(unsigned i = 0; i < MAX_NPROPS; i++)
+	{
+		impls[i] = _props_impl_get(props, handle->order[i]);
+	}
+
+	_perf_start(&perf);
+
+	props_epoch_begin(props);
+	for(unsigned i = 0; i < NLOOKUPS; i++)
+	{
+		const float val = i;
+
+		_props_impl_set(props, impls[i % MAX_NPROPS], props->urid.atom_float,
+			sizeof(float), &val);
+	}
+	props_epoch_end(props);
+
+	_perf_stop(&perf, "set", NLOOKUPS);
+}
+
+static void
+_bench_set(handle_t *handle)
+{
+	props_t *props = &handle->props;
+	LV2_Atom_Forge *forge = &handle->forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+	perf_t perf;
+
+	// forge one patch:Set per property in random order
+	lv2_atom_forge_set_buffer(forge, handle->msgs, BUF_SIZE);
+	ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+	for(unsigned i = 0; i < MAX_NPROPS; i++)
+	{
+		LV2_Atom_Forge_Frame obj_frame;
+
+		if(ref)
+			ref = lv2_atom_forge_frame_time(forge, 0);
+		if(ref)
+			ref = lv2_atom_forge_object(forge, &obj_frame, 0, props->urid.patch_set);
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_property);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, handle->order[i]);
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_value);
+		if(ref)
+			ref = lv2_atom_forge_float(forge, i);
+		if(ref)
+			lv2_atom_forge_pop(forge, &obj_frame);
+	}
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame);
+	assert(ref);
+
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)handle->msgs;
+
+	_perf_start(&perf);
+
+	for(unsigned i = 0; i < NSETS; )
+	{
+		lv2_atom_forge_set_buffer(forge, handle->notify, BUF_SIZE);
+		ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+		props_idle(props, forge, 0, &ref);
+
+		LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+		{
+			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+			if(ref)
+				props_advance(props, forge, ev->time.frames, obj, &ref);
+			i++;
+
+			if(!ref) // notify buffer full
+			{
+				lv2_atom_forge_set_buffer(forge, handle->notify, BUF_SIZE);
+				ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+			}
+		}
+
+		if(ref)
+			lv2_atom_forge_pop(forge, &frame);
+	}
+
+	_perf_stop(&perf, "patch:Set", NSETS);
+}
+
+#if PROPS_THREADING != PROPS_THREADING_SINGLE
+static void *
+_contender(void *data)
+{
+	handle_t *handle = data;
+	props_t *props = &handle->props;
+
+	// hammer on the lock words like a concurrent props_save would
+	while(atomic_load(&handle->contending))
+	{
+		for(unsigned i = 0; i < props->nimpls; i++)
+		{
+			props_impl_t *impl = &props->impls[i];
+
+			if(_props_impl_try_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK))
+				_props_impl_unlock(impl, PROP_STATE_NONE);
+		}
+	}
+
+	return NULL;
+}
+
+static void
+_bench_contention(handle_t *handle)
+{
+	props_t *props = &handle->props;
+	float sum = 0.f;
+	pthread_t thread;
+	perf_t perf;
+
+	atomic_store(&handle->contending, true);
+	if(pthread_create(&thread, NULL, _contender, handle))
+		return;
+
+	_perf_start(&perf);
+
+	for(unsigned i = 0; i < NLOOKUPS; i++)
+	{
+		props_impl_t *impl = _props_impl_get(props, handle->order[i % MAX_NPROPS]);
+
+		sum += *(const float *)impl->value.body;
+	}
+
+	_perf_stop(&perf, "lookup+read (contended)", NLOOKUPS);
+
+	atomic_store(&handle->contending, false);
+	pthread_join(thread, NULL);
+
+	assert(sum >= 0.f);
+}
+#endif
+
+int
+main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
+{
+	static handle_t handle;
+
+	handle.map.handle = &handle;
+	handle.map.map = _map;
+
+	lv2_atom_forge_init(&handle.forge, &handle.map);
+
+	for(unsigned i = 0; i < MAX_NPROPS; i++)
+	{
+		props_def_t *def = &handle.defs[i];
+
+		snprintf(handle.uris[i], MAX_URI, PROPS_PREFIX"prop_%u", i);
+
+		def->property = handle.uris[i];
+		def->type = LV2_ATOM__Float;
+		def->offset = i * sizeof(float);
+	}
+
+	if(props_init(&handle.props, PROPS_PREFIX"subj", handle.defs, MAX_NPROPS,
+		handle.state, handle.stash, &handle.map, NULL) != 1)
+	{
+		fprintf(stderr, "props_init failed\n");
+		return -1;
+	}
+
+	// shuffled lookup order
+	srand(0);
+	for(unsigned i = 0; i < MAX_NPROPS; i++)
+	{
+		handle.order[i] = props_map(&handle.props, handle.uris[i]);
+	}
+	for(unsigned i = MAX_NPROPS - 1; i > 0; i--)
+	{
+		const unsigned j = rand() % (i + 1);
+		const LV2_URID tmp = handle.order[i];
+
+		handle.order[i] = handle.order[j];
+		handle.order[j] = tmp;
+	}
+
+#if defined(PROPS_CACHE_LINE)
+	printf("sync words padded to %u bytes\n", PROPS_CACHE_LINE);
+#else
+	printf("sync words packed\n");
+#endif
+
+#if PROPS_THREADING == PROPS_THREADING_SINGLE
+	printf("single-thread policy\n");
+#elif PROPS_THREADING == PROPS_THREADING_LOCKFREE
+	printf("lock-free policy\n");
+#else
+	printf("spin policy\n");
+#endif
+
+	_bench_lookup(&handle);
+	_bench_impl_set(&handle);
+	_bench_set(&handle);
+#if PROPS_THREADING != PROPS_THREADING_SINGLE
+	_bench_contention(&handle);
+#endif
+
+	for(urid_t *itm=handle.urids; itm->urid; itm++)
+	{
+		free(itm->uri);
+	}
+
+	return 0;
+}
@@ -0,0 +1,854 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+// mutation fuzzer for props_advance, best run from a sanitized build:
+//
+//   meson setup -Db_sanitize=address,undefined build
+//   ASAN_OPTIONS=abort_on_error=1 build/props_fuzz -n 1000000 -c test/chunk.bin
+//
+// crashing inputs are dumped as raw atoms to crash-SEED-ITERATION.atom,
+// replay them (or any other corpus) with: props_fuzz -r FILE...
+
+#include <assert.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <props.h>
+#include <props_client.h>
+
+#define MAX_URIDS 512
+#define STR_SIZE 32
+#define CHUNK_SIZE 16
+#define VEC_SIZE 13
+#define ARR_SIZE 8
+#define MSG_SIZE 0x1000
+#define NOTIFY_SIZE 0x10000
+
+#define PROPS_PREFIX		"http://open-music-kontrollers.ch/lv2/props#"
+
+typedef struct _plugstate_t plugstate_t;
+typedef struct _urid_t urid_t;
+typedef struct _handle_t handle_t;
+
+struct _plugstate_t {
+	int32_t b32;
+	int32_t i32;
+	int64_t i64;
+	float f32;
+	double f64;
+	uint32_t urid;
+	char str [STR_SIZE];
+	char path [STR_SIZE];
+	uint8_t chunk [CHUNK_SIZE];
+	LV2_Atom_Literal_Body lit;
+		char lit_body [STR_SIZE];
+	LV2_Atom_Vector_Body vec;
+		int32_t vec_body [VEC_SIZE];
+	LV2_Atom_Object_Body obj;
+	struct {
+		int32_t note;
+		float vel;
+	} arr [ARR_SIZE];
+};
+
+struct _urid_t {
+	LV2_URID urid;
+	char *uri;
+};
+
+enum {
+	PROP_b32 = 0,
+	PROP_i32,
+	PROP_i64,
+	PROP_f32,
+	PROP_f64,
+	PROP_urid,
+	PROP_str,
+	PROP_path,
+	PROP_chunk,
+	PROP_lit,
+	PROP_vec,
+	PROP_obj,
+	PROP_arr,
+
+	MAX_NPROPS
+};
+
+struct _handle_t {
+	PROPS_T(props, MAX_NPROPS);
+	plugstate_t state;
+	plugstate_t stash;
+	plugstate_t defaults;
+
+	LV2_URID_Map map;
+	LV2_Atom_Forge forge;
+
+	urid_t urids [MAX_URIDS];
+	LV2_URID urid;
+
+	LV2_URID properties [MAX_NPROPS];
+	LV2_URID types [MAX_NPROPS];
+	props_request_t reqs [4];
+	uint64_t history [32]; // small enough to wrap around often
+	plugstate_t presets [2];
+	uint32_t sizes [2][MAX_NPROPS];
+	props_slot_t slots [2];
+
+	const uint8_t *seed;
+	size_t seed_size;
+
+	uint64_t rand;
+	unsigned handled;
+
+	_Alignas(LV2_Atom_Event) uint8_t msg [MSG_SIZE];
+	_Alignas(LV2_Atom_Event) uint8_t notify [NOTIFY_SIZE];
+
+	PROPS_CLIENT_T(client, MAX_NPROPS);
+	plugstate_t mirror;
+};
+
+static const props_def_t defs [MAX_NPROPS] = {
+	[PROP_b32] = {
+		.property = PROPS_PREFIX"b32",
+		.offset = offsetof(plugstate_t, b32),
+		.type = LV2_ATOM__Bool
+	},
+	[PROP_i32] = {
+		.property = PROPS_PREFIX"i32",
+		.offset = offsetof(plugstate_t, i32),
+		.type = LV2_ATOM__Int
+	},
+	[PROP_i64] = {
+		.property = PROPS_PREFIX"i64",
+		.offset = offsetof(plugstate_t, i64),
+		.type = LV2_ATOM__Long
+	},
+	[PROP_f32] = {
+		.property = PROPS_PREFIX"f32",
+		.offset = offsetof(plugstate_t, f32),
+		.type = LV2_ATOM__Float
+	},
+	[PROP_f64] = {
+		.property = PROPS_PREFIX"f64",
+		.offset = offsetof(plugstate_t, f64),
+		.type = LV2_ATOM__Double
+	},
+	[PROP_urid] = {
+		.property = PROPS_PREFIX"urid",
+		.offset = offsetof(plugstate_t, urid),
+		.type = LV2_ATOM__URID
+	},
+	[PROP_str] = {
+		.property = PROPS_PREFIX"str",
+		.offset = offsetof(plugstate_t, str),
+		.type = LV2_ATOM__String,
+		.max_size = STR_SIZE
+	},
+	[PROP_path] = {
+		.property = PROPS_PREFIX"path",
+		.offset = offsetof(plugstate_t, path),
+		.type = LV2_ATOM__Path,
+		.max_size = STR_SIZE
+	},
+	[PROP_chunk] = {
+		.property = PROPS_PREFIX"chunk",
+		.offset = offsetof(plugstate_t, chunk),
+		.type = LV2_ATOM__Chunk,
+		.max_size = CHUNK_SIZE
+	},
+	[PROP_lit] = {
+		.property = PROPS_PREFIX"lit",
+		.offset = offsetof(plugstate_t, lit),
+		.type = LV2_ATOM__Literal,
+		.max_size = sizeof(LV2_Atom_Literal_Body) + STR_SIZE
+	},
+	[PROP_vec] = {
+		.property = PROPS_PREFIX"vec",
+		.offset = offsetof(plugstate_t, vec),
+		.type = LV2_ATOM__Vector,
+		.max_size = sizeof(LV2_Atom_Vector_Body) + VEC_SIZE*sizeof(int32_t)
+	},
+	[PROP_obj] = {
+		.property = PROPS_PREFIX"obj",
+		.offset = offsetof(plugstate_t, obj),
+		.type = LV2_ATOM__Object,
+		.hidden = true
+	},
+	[PROP_arr] = {
+		.property = PROPS_PREFIX"arr",
+		.offset = offsetof(plugstate_t, arr[0].vel),
+		.type = LV2_ATOM__Float,
+		.count = ARR_SIZE,
+		.stride = sizeof(((plugstate_t *)0)->arr[0])
+	}
+};
+
+// input currently being processed, for the crash handler
+static const LV2_Atom *current = NULL;
+static uint64_t current_seed = 0;
+static unsigned current_iter = 0;
+
+static void
+_dump(void)
+{
+	if(!current)
+		return;
+
+	char path [64];
+	snprintf(path, sizeof(path), "crash-%"PRIu64"-%u.atom",
+		current_seed, current_iter);
+
+	FILE *f = fopen(path, "wb");
+	if(f)
+	{
+		fwrite(current, sizeof(LV2_Atom) + current->size, 1, f);
+		fclose(f);
+		fprintf(stderr, "crashing input written to %s\n", path);
+	}
+
+	current = NULL;
+}
+
+static void
+_sig(int sig)
+{
+	_dump();
+
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+// set by the sanitizer runtimes, if linked in
+extern void __sanitizer_set_death_callback(void (*cb)(void)) __attribute__((weak));
+
+static LV2_URID
+_map(LV2_URID_Map_Handle instance, const char *uri)
+{
+	handle_t *handle = instance;
+
+	urid_t *itm;
+	for(itm=handle->urids; itm->urid; itm++)
+	{
+		if(!strcmp(itm->uri, uri))
+			return itm->urid;
+	}
+
+	assert(handle->urid + 1 < MAX_URIDS);
+
+	// create new
+	itm->urid = ++handle->urid;
+	itm->uri = strdup(uri);
+
+	return itm->urid;
+}
+
+static uint32_t
+_rand(handle_t *handle)
+{
+	// xorshift64*
+	handle->rand ^= handle->rand >> 12;
+	handle->rand ^= handle->rand << 25;
+	handle->rand ^= handle->rand >> 27;
+
+	return (handle->rand * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+static LV2_URID
+_rand_urid(handle_t *handle)
+{
+	switch(_rand(handle) % 4)
+	{
+		case 0:
+			return handle->properties[_rand(handle) % MAX_NPROPS];
+		case 1:
+			return handle->types[_rand(handle) % MAX_NPROPS];
+		case 2:
+			return _rand(handle) % (handle->urid + 2);
+	}
+
+	return _rand(handle);
+}
+
+static LV2_Atom_Forge_Ref
+_forge_value(handle_t *handle, LV2_URID type)
+{
+	LV2_Atom_Forge *forge = &handle->forge;
+	uint8_t body [64];
+	uint32_t size = _rand(handle) % sizeof(body);
+
+	if(handle->seed_size && (_rand(handle) % 2))
+	{
+		const size_t offset = _rand(handle) % handle->seed_size;
+
+		if(size > handle->seed_size - offset)
+			size = handle->seed_size - offset;
+		memcpy(body, &handle->seed[offset], size);
+	}
+	else
+	{
+		for(uint32_t i = 0; i < size; i++)
+			body[i] = _rand(handle);
+	}
+
+	if(_rand(handle) % 2) // well-sized
+	{
+		const uint32_t type_size = _props_type_size(&handle->props, type);
+
+		if(type_size)
+			size = type_size;
+	}
+
+	if( (type == handle->props.urid.atom_vector) && (size >= 8) && (_rand(handle) % 2) )
+	{
+		// plausible element vectors for array properties
+		LV2_Atom_Vector_Body *vec = (LV2_Atom_Vector_Body *)body;
+
+		vec->child_size = sizeof(int32_t);
+		vec->child_type = (_rand(handle) % 2)
+			? handle->props.urid.atom_int
+			: handle->props.urid.atom_float;
+		size = 8 + (size - 8) / 4 * 4;
+	}
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_atom(forge, size, type);
+	if(ref)
+		ref = lv2_atom_forge_write(forge, body, size);
+
+	return ref;
+}
+
+static LV2_Atom_Forge_Ref
+_forge_msg(handle_t *handle)
+{
+	props_t *props = &handle->props;
+	LV2_Atom_Forge *forge = &handle->forge;
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Ref ref;
+
+	const unsigned idx = _rand(handle) % MAX_NPROPS;
+	const LV2_URID property = (_rand(handle) % 8)
+		? handle->properties[idx]
+		: _rand_urid(handle);
+	const LV2_URID type = (_rand(handle) % 8)
+		? handle->types[idx]
+		: _rand_urid(handle);
+	const LV2_URID otypes [5] = {
+		props->urid.patch_get,
+		props->urid.patch_set,
+		props->urid.patch_put,
+		props->urid.patch_ack,
+		props->urid.patch_error
+	};
+	const LV2_URID otype = otypes[_rand(handle) % 5];
+
+	lv2_atom_forge_set_buffer(forge, handle->msg, MSG_SIZE);
+
+	ref = lv2_atom_forge_object(forge, &obj_frame, 0, otype);
+
+	if(_rand(handle) % 2)
+	{
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_subject);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, (_rand(handle) % 4)
+				? props->urid.subject : _rand_urid(handle));
+	}
+
+	if(_rand(handle) % 2)
+	{
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_sequence);
+		if(ref) // small ones may match outstanding requests
+			ref = lv2_atom_forge_int(forge, (_rand(handle) % 2)
+				? (int32_t)_rand(handle) : (int32_t)(_rand(handle) % 64));
+	}
+
+	if(otype == props->urid.patch_put)
+	{
+		LV2_Atom_Forge_Frame body_frame;
+		const unsigned n = _rand(handle) % 5;
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_body);
+		if(ref)
+			ref = lv2_atom_forge_object(forge, &body_frame, 0, 0);
+		for(unsigned i = 0; i < n; i++)
+		{
+			const unsigned j = _rand(handle) % MAX_NPROPS;
+
+			if(ref)
+				ref = lv2_atom_forge_key(forge, handle->properties[j]);
+			if(ref)
+				ref = _forge_value(handle, (_rand(handle) % 8)
+					? handle->types[j] : _rand_urid(handle));
+		}
+		if(ref)
+			lv2_atom_forge_pop(forge, &body_frame);
+	}
+	else if((otype == props->urid.patch_set) && !(_rand(handle) % 16)) // subscription
+	{
+		LV2_URID properties [MAX_NPROPS];
+		const unsigned n = _rand(handle) % (MAX_NPROPS + 1);
+
+		for(unsigned i = 0; i < n; i++)
+			properties[i] = handle->properties[_rand(handle) % MAX_NPROPS];
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_property);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, props->urid.props_subscription);
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_value);
+		if(ref)
+		{
+			switch(_rand(handle) % 3)
+			{
+				case 0:
+					ref = lv2_atom_forge_vector(forge, sizeof(LV2_URID),
+						props->urid.atom_urid, n, properties);
+					break;
+				case 1:
+					ref = lv2_atom_forge_bool(forge, _rand(handle) % 2);
+					break;
+				default:
+					ref = _forge_value(handle, _rand_urid(handle));
+					break;
+			}
+		}
+	}
+	else if(!(_rand(handle) % 4)) // bulk
+	{
+		LV2_URID properties [5];
+		const unsigned n = _rand(handle) % 6;
+
+		for(unsigned i = 0; i < n; i++)
+		{
+			properties[i] = (_rand(handle) % 8)
+				? handle->properties[_rand(handle) % MAX_NPROPS]
+				: _rand_urid(handle);
+		}
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_property);
+		if(ref)
+			ref = lv2_atom_forge_vector(forge, sizeof(LV2_URID), props->urid.atom_urid,
+				n, properties);
+
+		if(otype == props->urid.patch_set)
+		{
+			LV2_Atom_Forge_Frame tup_frame;
+			const unsigned m = _rand(handle) % 6;
+
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_value);
+			if(_rand(handle) % 4)
+			{
+				if(ref)
+					ref = lv2_atom_forge_tuple(forge, &tup_frame);
+				for(unsigned i = 0; i < m; i++)
+				{
+					const unsigned j = _rand(handle) % MAX_NPROPS;
+
+					if(ref)
+						ref = _forge_value(handle, (_rand(handle) % 8)
+							? handle->types[j] : _rand_urid(handle));
+				}
+				if(ref)
+					lv2_atom_forge_pop(forge, &tup_frame);
+			}
+			else if(ref)
+			{
+				ref = _forge_value(handle, props->urid.atom_vector);
+			}
+		}
+	}
+	else if(_rand(handle) % 8) // patch:Get may have no property
+	{
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.patch_property);
+		if(ref)
+			ref = lv2_atom_forge_urid(forge, property);
+
+		if(_rand(handle) % 2)
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.props_index);
+			if(ref)
+				ref = (_rand(handle) % 2)
+					? lv2_atom_forge_int(forge, (int32_t)(_rand(handle) % (ARR_SIZE + 4)) - 2)
+					: _forge_value(handle, props->urid.atom_vector);
+		}
+
+		if(otype == props->urid.patch_set)
+		{
+			if(ref)
+				ref = lv2_atom_forge_key(forge, props->urid.patch_value);
+			if(ref)
+				ref = _forge_value(handle, (_rand(handle) % 4)
+					? type : props->urid.atom_vector);
+		}
+	}
+	else if(_rand(handle) % 2) // wildcard patch:Get relative to defaults
+	{
+		if(ref)
+			ref = lv2_atom_forge_key(forge, props->urid.props_defaults);
+		if(ref)
+			ref = (_rand(handle) % 8)
+				? lv2_atom_forge_bool(forge, _rand(handle) % 4)
+				: _forge_value(handle, _rand_urid(handle));
+	}
+
+	if(ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+	return ref;
+}
+
+static void
+_mutate(handle_t *handle, LV2_Atom *atom)
+{
+	uint8_t *body = LV2_ATOM_BODY(atom);
+	uint32_t *words = LV2_ATOM_BODY(atom);
+	const uint32_t size = atom->size;
+	const unsigned n = _rand(handle) % 4;
+
+	if(!size)
+		return;
+
+	for(unsigned i = 0; i < n; i++)
+	{
+		switch(_rand(handle) % 5)
+		{
+			case 0: // flip a bit
+			{
+				body[_rand(handle) % size] ^= 1 << (_rand(handle) % 8);
+			} break;
+			case 1: // random byte
+			{
+				body[_rand(handle) % size] = _rand(handle);
+			} break;
+			case 2: // interesting word, e.g. an atom size or type
+			{
+				static const uint32_t interesting [] = {
+					0, 1, 4, 8, 0x7f, 0x80, 0xff, 0x7fff, 0xffff,
+					0x7fffffff, 0x80000000, 0xfffffff8, 0xffffffff
+				};
+
+				if(size < sizeof(uint32_t))
+					break;
+
+				words[_rand(handle) % (size / sizeof(uint32_t))] = (_rand(handle) % 2)
+					? interesting[_rand(handle) % (sizeof(interesting) / sizeof(uint32_t))]
+					: _rand_urid(handle);
+			} break;
+			case 3: // truncate, the container stays consistent
+			{
+				atom->size = _rand(handle) % (size + 1);
+			} return;
+			case 4: // splice in raw seed bytes
+			{
+				if(handle->seed_size)
+				{
+					const uint32_t offset = _rand(handle) % size;
+					const size_t from = _rand(handle) % handle->seed_size;
+					size_t len = _rand(handle) % (size - offset + 1);
+
+					if(len > handle->seed_size - from)
+						len = handle->seed_size - from;
+					memcpy(&body[offset], &handle->seed[from], len);
+				}
+			} break;
+		}
+	}
+}
+
+static double
+_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// copy to a tightly sized heap block, so that sanitizers see over-reads
+static double
+_advance(handle_t *handle, const LV2_Atom *atom)
+{
+	props_t *props = &handle->props;
+	LV2_Atom_Forge *forge = &handle->forge;
+	LV2_Atom_Forge_Frame frame;
+	const size_t size = sizeof(LV2_Atom) + atom->size;
+
+	LV2_Atom *dup = malloc(size);
+	if(!dup)
+		return 0.0;
+	memcpy(dup, atom, size);
+	current = dup;
+
+	lv2_atom_forge_set_buffer(forge, handle->notify, NOTIFY_SIZE);
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+	const double t0 = _now();
+	props_idle(props, forge, 0, &ref);
+	props_request_get(props, forge, 0, handle->properties[_rand(handle) % MAX_NPROPS],
+		_rand(handle) % 256, NULL, NULL, &ref);
+	if(props_advance(props, forge, 0, (const LV2_Atom_Object *)dup, &ref))
+		handle->handled++;
+	switch(_rand(handle) % 8)
+	{
+		case 0:
+			props_undo(props, forge, 0, &ref);
+			break;
+		case 1:
+			props_redo(props, forge, 0, &ref);
+			break;
+		case 2:
+			props_bank_store(props, _rand(handle) % 2);
+			break;
+		case 3:
+			props_morph(props, 0, _rand(handle) % 2, _rand(handle) % 2,
+				(float)(_rand(handle) % 5) / 4.f);
+			break;
+	}
+	props_tick(props, 64);
+	const double t1 = _now();
+
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame);
+
+	// the same message and the answer to it as seen by a UI
+	props_client_advance(&handle->client, (const LV2_Atom_Object *)dup);
+	if(ref)
+	{
+		LV2_ATOM_SEQUENCE_FOREACH((const LV2_Atom_Sequence *)handle->notify, ev)
+		{
+			props_client_advance(&handle->client, (const LV2_Atom_Object *)&ev->body);
+		}
+	}
+	if(!(_rand(handle) % 4))
+	{
+		const unsigned j = _rand(handle) % MAX_NPROPS;
+		uint8_t body [32] = { 0 };
+
+		props_client_set(&handle->client, handle->properties[j], handle->types[j],
+			_rand(handle) % sizeof(body), body);
+		props_client_dirty(&handle->client, handle->properties[j], _rand(handle) % 10);
+
+		lv2_atom_forge_set_buffer(forge, handle->msg, MSG_SIZE);
+		ref = 1;
+		props_client_flush(&handle->client, forge, &ref);
+	}
+
+	current = NULL;
+	free(dup);
+
+	return t1 - t0;
+}
+
+static int
+_replay(handle_t *handle, int argc, char **argv)
+{
+	unsigned n = 0;
+
+	for(int i = 0; i < argc; i++)
+	{
+		FILE *f = fopen(argv[i], "rb");
+		if(!f)
+		{
+			fprintf(stderr, "cannot open %s\n", argv[i]);
+			return -1;
+		}
+
+		const size_t size = fread(handle->msg, 1, MSG_SIZE, f);
+		fclose(f);
+
+		if(size < sizeof(LV2_Atom))
+			continue;
+
+		LV2_Atom *atom = (LV2_Atom *)handle->msg;
+		if(atom->size > size - sizeof(LV2_Atom))
+			atom->size = size - sizeof(LV2_Atom);
+
+		_advance(handle, atom);
+		n++;
+	}
+
+	printf("replayed %u of %i inputs, %u handled\n", n, argc, handle->handled);
+
+	return 0;
+}
+
+static int
+_fuzz(handle_t *handle, uint64_t seed, unsigned iterations)
+{
+	double busy = 0.0;
+	const double t0 = _now();
+
+	handle->rand = seed ? seed : 1;
+	current_seed = seed;
+
+	for(unsigned i = 0; i < iterations; i++)
+	{
+		current_iter = i;
+
+		if(!_forge_msg(handle))
+			continue;
+
+		LV2_Atom *atom = (LV2_Atom *)handle->msg;
+		if(_rand(handle) % 4)
+			_mutate(handle, atom);
+
+		busy += _advance(handle, atom);
+	}
+
+	const double total = _now() - t0;
+
+	printf("seed %"PRIu64": %u messages, %u handled, %.0f msgs/s in props_advance, %.0f msgs/s overall\n",
+		seed, iterations, handle->handled, iterations / busy, iterations / total);
+
+	return 0;
+}
+
+static uint8_t *
+_load(const char *path, size_t *size)
+{
+	FILE *f = fopen(path, "rb");
+	if(!f)
+		return NULL;
+
+	uint8_t *buf = NULL;
+	if(!fseek(f, 0, SEEK_END))
+	{
+		const long len = ftell(f);
+
+		if( (len > 0) && !fseek(f, 0, SEEK_SET) && (buf = malloc(len)) )
+		{
+			*size = fread(buf, 1, len, f);
+		}
+	}
+
+	fclose(f);
+
+	return buf;
+}
+
+int
+main(int argc, char **argv)
+{
+	static handle_t handle;
+	unsigned iterations = 100000;
+	uint64_t seed = time(NULL);
+	bool replay = false;
+	uint8_t *chunk = NULL;
+
+	int c;
+	while((c = getopt(argc, argv, "n:s:c:rh")) != -1)
+	{
+		switch(c)
+		{
+			case 'n':
+				iterations = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 10);
+				break;
+			case 'c':
+				free(chunk);
+				chunk = _load(optarg, &handle.seed_size);
+				if(!chunk)
+				{
+					fprintf(stderr, "cannot load %s\n", optarg);
+					return -1;
+				}
+				break;
+			case 'r':
+				replay = true;
+				break;
+			case 'h':
+			default:
+				fprintf(stderr,
+					"usage: %s [-n ITERATIONS] [-s SEED] [-c SEED_FILE]\n"
+					"       %s -r FILE...\n", argv[0], argv[0]);
+				return (c == 'h') ? 0 : -1;
+		}
+	}
+
+	handle.seed = chunk;
+
+	handle.map.handle = &handle;
+	handle.map.map = _map;
+
+	lv2_atom_forge_init(&handle.forge, &handle.map);
+
+	if(props_init(&handle.props, PROPS_PREFIX"subj", defs, MAX_NPROPS,
+		&handle.state, &handle.stash, &handle.map, NULL) != 1)
+	{
+		fprintf(stderr, "props_init failed\n");
+		return -1;
+	}
+
+	if(props_client_init(&handle.client, PROPS_PREFIX"subj", defs, MAX_NPROPS,
+		&handle.mirror, &handle.map, NULL, NULL) != 1)
+	{
+		fprintf(stderr, "props_client_init failed\n");
+		return -1;
+	}
+
+	props_requests(&handle.props, handle.reqs, 4);
+	props_defaults(&handle.props, &handle.defaults);
+	props_history(&handle.props, handle.history, sizeof(handle.history));
+	for(unsigned s = 0; s < 2; s++)
+	{
+		handle.slots[s].base = &handle.presets[s];
+		handle.slots[s].sizes = handle.sizes[s];
+	}
+	props_bank(&handle.props, handle.slots, 2);
+
+	for(unsigned i = 0; i < MAX_NPROPS; i++)
+	{
+		handle.properties[i] = props_map(&handle.props, defs[i].property);
+		handle.types[i] = handle.map.map(handle.map.handle, defs[i].type);
+	}
+
+	if(__sanitizer_set_death_callback) // keep the sanitizers' own reports
+	{
+		__sanitizer_set_death_callback(_dump);
+	}
+	else
+	{
+		signal(SIGSEGV, _sig);
+		signal(SIGBUS, _sig);
+		signal(SIGFPE, _sig);
+		signal(SIGABRT, _sig);
+	}
+
+	const int ret = replay
+		? _replay(&handle, argc - optind, &argv[optind])
+		: _fuzz(&handle, seed, iterations);
+
+	free(chunk);
+
+	for(urid_t *itm=handle.urids; itm->urid; itm++)
+	{
+		free(itm->uri);
+	}
+
+	return ret;
+}
@@ -16,8 +16,13 @@
  */
 
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <props.h>
+#include <props_client.h>
+#include <props_library.h>
 
 #define MAX_URIDS 512
 #define STR_SIZE 32
@@ -376,8 +381,8 @@ _test_1(handle_t *handle)
 
 		assert(impl->def == def);
 
-		assert(atomic_load(&impl->state) == PROP_STATE_NONE);
-		assert(impl->stashing == false);
+		assert(atomic_load(&impl->sync->state) == PROP_STATE_NONE);
+		assert(!_props_impl_flag(props, impl, PROPS_FLAG_STASHING));
 
 		switch(i)
 		{
@@ -388,6 +393,8 @@ _test_1(handle_t *handle)
 
 				assert(impl->stash.size == sizeof(stash->b32));
 				assert(impl->stash.body == &stash->b32);
+
+				assert(_props_impl_shape(props, impl)->cls == PROP_CLASS_32);
 			} break;
 			case PROP_i32:
 			{
@@ -396,6 +403,8 @@ _test_1(handle_t *handle)
 
 				assert(impl->stash.size == sizeof(stash->i32));
 				assert(impl->stash.body == &stash->i32);
+
+				assert(_props_impl_shape(props, impl)->cls == PROP_CLASS_32);
 			} break;
 			case PROP_i64:
 			{
@@ -404,6 +413,8 @@ _test_1(handle_t *handle)
 
 				assert(impl->stash.size == sizeof(stash->i64));
 				assert(impl->stash.body == &stash->i64);
+
+				assert(_props_impl_shape(props, impl)->cls == PROP_CLASS_64);
 			} break;
 			case PROP_f32:
 			{
@@ -412,6 +423,8 @@ _test_1(handle_t *handle)
 
 				assert(impl->stash.size == sizeof(stash->f32));
 				assert(impl->stash.body == &stash->f32);
+
+				assert(_props_impl_shape(props, impl)->cls == PROP_CLASS_32);
 			} break;
 			case PROP_f64:
 			{
@@ -420,6 +433,8 @@ _test_1(handle_t *handle)
 
 				assert(impl->stash.size == sizeof(stash->f64));
 				assert(impl->stash.body == &stash->f64);
+
+				assert(_props_impl_shape(props, impl)->cls == PROP_CLASS_64);
 			} break;
 			case PROP_urid:
 			{
@@ -428,6 +443,8 @@ _test_1(handle_t *handle)
 
 				assert(impl->stash.size == sizeof(stash->urid));
 				assert(impl->stash.body == &stash->urid);
+
+				assert(_props_impl_shape(props, impl)->cls == PROP_CLASS_32);
 			} break;
 			case PROP_str:
 			{
@@ -436,6 +453,8 @@ _test_1(handle_t *handle)
 
 				assert(impl->stash.size == 0);
 				assert(impl->stash.body == &stash->str);
+
+				assert(_props_impl_shape(props, impl)->cls == PROP_CLASS_VAR);
 			} break;
 			case PROP_uri:
 			{
@@ -614,9 +633,2593 @@ _test_2(handle_t *handle)
 	assert(ser_atom_deinit(&ser) == 0);
 }
 
+static void
+_test_3(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	static props_cache_t cache;
+
+	char path [] = "/tmp/props_test_XXXXXX";
+	const int fd = mkstemp(path);
+	assert(fd != -1);
+	assert(write(fd, "sample", 6) == 6);
+	close(fd);
+
+	props_cache_init(&cache);
+	props_cache(props, &cache);
+
+	assert(props_cache_pending(props) == false);
+
+	// cache miss schedules a load
+	assert(props_cache_get(props, path) == NULL);
+	assert(props_cache_pending(props) == true);
+	assert(props_cache_get(props, path) == NULL); // still in flight
+
+	props_cache_work(&cache);
+
+	// cache hit
+	const props_cache_buf_t *buf = props_cache_get(props, path);
+	assert(buf);
+	assert(buf->size == 6);
+	assert(memcmp(buf->body, "sample", 6) == 0);
+	assert(props_cache_get(props, path) == buf);
+	assert(props_cache_pending(props) == false);
+
+	// setting a path property preloads its file
+	props_impl_t *impl = _props_impl_get(props, props_map(props, defs[PROP_path].property));
+	assert(impl);
+
+	unlink(path);
+	path[strlen(path) - 1] = '_';
+	const int fd2 = open(path, O_CREAT | O_WRONLY, 0600);
+	assert(fd2 != -1);
+	close(fd2);
+
+	_props_impl_set(props, impl, impl->type, strlen(path) + 1, path);
+	assert(props_cache_pending(props) == true);
+
+	props_cache_work(&cache);
+
+	buf = props_cache_get(props, path);
+	assert(buf);
+	assert(buf->size == 0);
+
+	props_cache(props, NULL); // detach before the cache goes away
+	assert(props_cache_get(props, path) == NULL);
+	assert(props_cache_pending(props) == false);
+
+	unlink(path);
+	props_cache_deinit(&cache);
+}
+
+typedef struct _saved_t saved_t;
+
+struct _saved_t {
+	handle_t *handle;
+	atomic_bool done;
+	int32_t i32;
+	int64_t i64;
+};
+
+static LV2_State_Status
+_store(LV2_State_Handle instance, uint32_t key, const void *value,
+	size_t size __attribute__((unused)), uint32_t type __attribute__((unused)),
+	uint32_t flags __attribute__((unused)))
+{
+	saved_t *saved = instance;
+	props_t *props = &saved->handle->props;
+
+	if(key == props_map(props, defs[PROP_i32].property))
+	{
+		memcpy(&saved->i32, value, sizeof(int32_t));
+	}
+	else if(key == props_map(props, defs[PROP_i64].property))
+	{
+		memcpy(&saved->i64, value, sizeof(int64_t));
+	}
+
+	return LV2_STATE_SUCCESS;
+}
+
+static void *
+_dsp(void *data)
+{
+	saved_t *saved = data;
+	handle_t *handle = saved->handle;
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+
+	const LV2_URID i32 = props_map(props, defs[PROP_i32].property);
+	const LV2_URID i64 = props_map(props, defs[PROP_i64].property);
+	LV2_Atom_Forge_Ref ref = 0;
+
+	for(int32_t i = 1; !atomic_load(&saved->done); i++)
+	{
+		props_idle(props, NULL, 0, &ref);
+
+		// related properties, always to be saved together
+		props_epoch_begin(props);
+		state->i32 = i;
+		props_stash(props, i32);
+		state->i64 = 2*i;
+		props_stash(props, i64);
+		props_epoch_end(props);
+	}
+
+	return NULL;
+}
+
+static void
+_test_4(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	const LV2_Feature *const features [] = { NULL };
+	saved_t saved = {
+		.handle = handle
+	};
+	pthread_t thread;
+
+	atomic_init(&saved.done, false);
+	assert(pthread_create(&thread, NULL, _dsp, &saved) == 0);
+
+	for(unsigned i = 0; i < 200; i++)
+	{
+		assert(props_save(props, _store, &saved, 0, features) == LV2_STATE_SUCCESS);
+		assert(saved.i64 == 2*saved.i32);
+	}
+
+	atomic_store(&saved.done, true);
+	assert(pthread_join(thread, NULL) == 0);
+
+	const LV2_URID i32 = props_map(props, defs[PROP_i32].property);
+	const LV2_URID i64 = props_map(props, defs[PROP_i64].property);
+	props_impl_t *impl = _props_impl_get(props, i32);
+	LV2_Atom_Forge_Ref ref = 0;
+
+	props_idle(props, NULL, 0, &ref); // catch up on what the dsp thread left
+
+	// a stash deferred behind the save thread's lock does not hold the epoch open
+	if(!props->stashless)
+	{
+		atomic_store(&impl->sync->state, PROP_STATE_LOCK);
+		handle->state.i32 = 3;
+		props_stash(props, i32);
+		atomic_store(&impl->sync->state, PROP_STATE_NONE);
+		assert(_props_impl_flag(props, impl, PROPS_FLAG_STASHING));
+		assert(!(atomic_load(&props->epoch) & 1));
+		props_idle(props, NULL, 0, &ref);
+		assert(!_props_impl_flag(props, impl, PROPS_FLAG_STASHING));
+		assert(!(atomic_load(&props->epoch) & 1));
+	}
+
+	// an epoch that is never closed falls back to the values stashed so far
+	props_epoch_begin(props);
+	handle->state.i32 = 5;
+	props_stash(props, i32);
+	assert(atomic_load(&props->epoch) & 1);
+	assert(props_save(props, _store, &saved, 0, features) == LV2_STATE_SUCCESS);
+	assert(saved.i32 == 5);
+	handle->state.i64 = 10;
+	props_stash(props, i64);
+	props_epoch_end(props);
+	assert(props_save(props, _store, &saved, 0, features) == LV2_STATE_SUCCESS);
+	assert(saved.i32 == 5);
+	assert(saved.i64 == 10);
+}
+
+static void
+_test_5(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	static plugstate_t bases [3];
+	props_gen_t gens [3] = {
+		[0] = { .base = &bases[0] },
+		[1] = { .base = &bases[1] },
+		[2] = { .base = &bases[2] }
+	};
+	props_gen_t *gen = NULL;
+	LV2_Atom_Forge_Ref ref = 0;
+
+	const LV2_URID i32 = props_map(props, defs[PROP_i32].property);
+	const LV2_URID f64 = props_map(props, defs[PROP_f64].property);
+
+	props_generations(props, gens, 3);
+	assert(props_acquire(props, &gen) == NULL);
+	assert(gen == NULL);
+
+	state->i32 = 1;
+	state->f64 = 1.0;
+	assert(props_publish(props) == true);
+
+	const plugstate_t *cur = props_acquire(props, &gen);
+	assert(cur);
+	assert(gen);
+	assert(cur->i32 == 1);
+	assert(cur->f64 == 1.0);
+
+	// published generations are immutable while being read
+	state->i32 = 2;
+	props_set(props, NULL, 0, i32, &ref);
+	assert(props_publish(props) == true);
+	state->f64 = 2.0;
+	props_set(props, NULL, 0, f64, &ref);
+	assert(props_publish(props) == true);
+
+	assert(cur->i32 == 1);
+	assert(cur->f64 == 1.0);
+
+	props_gen_t *gen2 = NULL;
+	const plugstate_t *cur2 = props_acquire(props, &gen2);
+	assert(cur2 && (cur2 != cur));
+	assert(cur2->i32 == 2);
+	assert(cur2->f64 == 2.0);
+
+	state->i32 = 3;
+	props_set(props, NULL, 0, i32, &ref);
+	assert(props_publish(props) == true);
+
+	props_gen_t *gen3 = NULL;
+	const plugstate_t *cur3 = props_acquire(props, &gen3);
+	assert(cur3 && (cur3 != cur) && (cur3 != cur2));
+	assert(cur3->i32 == 3);
+	assert(cur3->f64 == 2.0);
+
+	// no generation left to write to
+	state->i32 = 4;
+	props_set(props, NULL, 0, i32, &ref);
+	assert(props_publish(props) == false);
+
+	props_release(props, gen);
+	assert(props_publish(props) == true);
+	props_release(props, gen2);
+	props_release(props, gen3);
+
+	const plugstate_t *cur4 = props_acquire(props, &gen);
+	assert(cur4 == cur);
+	assert(cur4->i32 == 4);
+	assert(cur4->f64 == 2.0);
+	props_release(props, gen);
+}
+
+static const void *
+_retrieve(LV2_State_Handle instance, uint32_t key, size_t *size,
+	uint32_t *type, uint32_t *flags)
+{
+	saved_t *saved = instance;
+	props_t *props = &saved->handle->props;
+
+	*flags = LV2_STATE_IS_POD;
+
+	if(key == props_map(props, defs[PROP_i32].property))
+	{
+		*size = sizeof(int32_t);
+		*type = props->urid.atom_int;
+		return &saved->i32;
+	}
+	else if(key == props_map(props, defs[PROP_i64].property))
+	{
+		*size = sizeof(int64_t);
+		*type = props->urid.atom_long;
+		return &saved->i64;
+	}
+
+	return NULL;
+}
+
+static void
+_test_6(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	const LV2_Feature *const features [] = { NULL };
+	saved_t saved = {
+		.handle = handle
+	};
+	LV2_Atom_Forge_Ref ref = 0;
+
+	// re-initialize without a stash
+	assert(props_init(props, PROPS_PREFIX"subj", defs, MAX_NPROPS,
+		state, NULL, &handle->map, NULL) == 1);
+
+	props_impl_t *impl = _props_impl_get(props, props_map(props, defs[PROP_i32].property));
+	assert(impl);
+	assert(impl->stash.body == impl->value.body);
+
+	const int32_t i32 = 5;
+	_props_impl_set(props, impl, impl->type, sizeof(i32), &i32);
+	assert(state->i32 == 5);
+	assert(atomic_load(&impl->sync->version) % 2 == 0);
+
+	// save reads through the single versioned copy
+	assert(props_save(props, _store, &saved, 0, features) == LV2_STATE_SUCCESS);
+	assert(saved.i32 == 5);
+
+	// restore writes in place, idle notifies
+	saved.i32 = 7;
+	saved.i64 = 14;
+	assert(props_restore(props, _retrieve, &saved, 0, features) == LV2_STATE_SUCCESS);
+	assert(state->i32 == 7);
+	assert(state->i64 == 14);
+	assert(atomic_load(&impl->sync->state) == PROP_STATE_RESTORE);
+
+	props_idle(props, NULL, 0, &ref);
+	assert(atomic_load(&impl->sync->state) == PROP_STATE_NONE);
+	assert(state->i32 == 7);
+
+	// concurrent saves stay consistent without a stash, too
+	_test_4(handle);
+}
+
+typedef struct _poolstate_t poolstate_t;
+
+struct _poolstate_t {
+	int32_t i32;
+	props_ref_t str;
+	props_ref_t chunk;
+};
+
+enum {
+	POOL_i32 = 0,
+	POOL_str,
+	POOL_chunk,
+
+	MAX_NPOOLS
+};
+
+static const props_def_t pool_defs [MAX_NPOOLS] = {
+	[POOL_i32] = {
+		.property = PROPS_PREFIX"i32",
+		.offset = offsetof(poolstate_t, i32),
+		.type = LV2_ATOM__Int
+	},
+	[POOL_str] = {
+		.property = PROPS_PREFIX"str",
+		.offset = offsetof(poolstate_t, str),
+		.type = LV2_ATOM__String,
+		.pooled = true
+	},
+	[POOL_chunk] = {
+		.property = PROPS_PREFIX"chunk",
+		.offset = offsetof(poolstate_t, chunk),
+		.type = LV2_ATOM__Chunk,
+		.max_size = 64,
+		.pooled = true
+	}
+};
+
+static void
+_test_7(handle_t *handle)
+{
+	assert(handle);
+
+	static struct {
+		PROPS_T(props, MAX_NPOOLS);
+		poolstate_t state;
+		poolstate_t stash;
+	} pooled;
+	static uint64_t arena [64];
+	props_t *props = &pooled.props;
+	props_pool_t pool;
+	LV2_Atom_Forge_Ref ref = 0;
+
+	memset(&pooled, 0x0, sizeof(pooled));
+	assert(props_init(props, PROPS_PREFIX"subj", pool_defs, MAX_NPOOLS,
+		&pooled.state, &pooled.stash, &handle->map, NULL) == 1);
+
+	props_pool_init(&pool, arena, sizeof(arena));
+	assert(props_pool(props, &pool) == 1);
+
+	props_impl_t *str = _props_impl_get(props, props_map(props, pool_defs[POOL_str].property));
+	assert(str);
+	assert(str->value.body);
+	assert(str->value.body == pooled.state.str.body);
+	assert(str->stash.body == pooled.stash.str.body);
+	assert(str->value.size == 0);
+
+	// fits into smallest class
+	_props_impl_set(props, str, str->type, 6, "hello");
+	assert(pooled.state.str.size == 6);
+	assert(strcmp(pooled.state.str.body, "hello") == 0);
+	assert(pooled.stash.str.size == 6);
+	assert(strcmp(pooled.stash.str.body, "hello") == 0);
+
+	// grows into a bigger class, recycles the smaller block
+	void *small = str->value.body;
+	char big [100];
+	memset(big, 'x', sizeof(big) - 1);
+	big[sizeof(big) - 1] = '\0';
+	_props_impl_set(props, str, str->type, sizeof(big), big);
+	assert(str->value.body != small);
+	assert(atomic_load(&pool.heads[0]) & UINT32_MAX); // recycled
+	assert(pooled.state.str.size == sizeof(big));
+	assert(strcmp(pooled.state.str.body, big) == 0);
+
+	props_impl_t *chunk = _props_impl_get(props, props_map(props, pool_defs[POOL_chunk].property));
+	assert(chunk);
+	assert(chunk->value.body);
+
+	uint8_t *body = props_reserve(props, chunk->property, 16);
+	assert(body);
+	assert(body == chunk->value.body);
+	memset(body, 0xff, 16);
+	props_set(props, NULL, 0, chunk->property, &ref);
+	assert(pooled.state.chunk.size == 16);
+	assert(pooled.stash.chunk.size == 16);
+	assert(memcmp(pooled.stash.chunk.body, body, 16) == 0);
+
+	// exceeds max_size
+	assert(props_reserve(props, chunk->property, 65) == NULL);
+
+	// exhausts pool, value stays untouched
+	char huge [300];
+	memset(huge, 'y', sizeof(huge) - 1);
+	huge[sizeof(huge) - 1] = '\0';
+	_props_impl_set(props, str, str->type, sizeof(huge), huge);
+	assert(pooled.state.str.size == sizeof(big));
+	assert(strcmp(pooled.state.str.body, big) == 0);
+}
+
+static void
+_test_8(handle_t *handle)
+{
+	assert(handle);
+
+	plugstate_t *state = &handle->state;
+	plugstate_t *stash = &handle->stash;
+	LV2_Atom_Forge_Ref ref = 0;
+
+	// only the scalar properties, sized at runtime
+	const int nimpls = PROP_urid + 1;
+	const size_t size = props_size(nimpls);
+	assert(size < sizeof(handle->props) + sizeof(handle->_impls) + sizeof(handle->_index));
+
+	void *arena = malloc(size);
+	assert(arena);
+
+	assert(props_init_in(arena, size - 1, PROPS_PREFIX"subj", defs, nimpls,
+		state, stash, &handle->map, NULL) == NULL);
+
+	props_t *props = props_init_in(arena, size, PROPS_PREFIX"subj", defs, nimpls,
+		state, stash, &handle->map, NULL);
+	assert(props == arena);
+	assert(props->nimpls == (unsigned)nimpls);
+
+	for(int i = 0; i < nimpls; i++)
+	{
+		const LV2_URID property = props_map(props, defs[i].property);
+		props_impl_t *impl = _props_impl_get(props, property);
+
+		assert(impl);
+		assert(impl->def == &defs[i]);
+	}
+
+	assert(props_map(props, defs[PROP_str].property) == 0);
+
+	state->f64 = 3.0;
+	props_set(props, NULL, 0, props_map(props, defs[PROP_f64].property), &ref);
+	assert(stash->f64 == 3.0);
+
+	free(arena);
+}
+
+#define NVOICES 8
+
+typedef struct _voicestate_t voicestate_t;
+
+struct _voicestate_t {
+	float gain [NVOICES];
+	struct {
+		int32_t note;
+		float vel;
+	} voice [NVOICES];
+};
+
+enum {
+	VOICE_gain = 0,
+	VOICE_note,
+
+	MAX_NVOICES
+};
+
+static const props_def_t voice_defs [MAX_NVOICES] = {
+	[VOICE_gain] = {
+		.property = PROPS_PREFIX"gain",
+		.offset = offsetof(voicestate_t, gain),
+		.type = LV2_ATOM__Float,
+		.count = NVOICES
+	},
+	[VOICE_note] = {
+		.property = PROPS_PREFIX"note",
+		.offset = offsetof(voicestate_t, voice[0].note),
+		.type = LV2_ATOM__Int,
+		.count = NVOICES,
+		.stride = sizeof(((voicestate_t *)0)->voice[0])
+	}
+};
+
+typedef struct _vecstate_t vecstate_t;
+
+struct _vecstate_t {
+	LV2_Atom_Vector_Body env;
+	float elems [NVOICES];
+};
+
+static const props_def_t vec_defs [1] = {
+	{
+		.property = PROPS_PREFIX"env",
+		.offset = offsetof(vecstate_t, env),
+		.type = LV2_ATOM__Vector,
+		.max_size = sizeof(vecstate_t)
+	}
+};
+
+typedef struct _voice_saved_t voice_saved_t;
+
+struct _voice_saved_t {
+	props_t *props;
+	uint32_t type;
+	uint32_t size;
+	uint8_t body [sizeof(LV2_Atom_Vector_Body) + NVOICES*sizeof(int32_t)];
+};
+
+static LV2_State_Status
+_voice_store(LV2_State_Handle instance, uint32_t key, const void *value,
+	size_t size, uint32_t type, uint32_t flags __attribute__((unused)))
+{
+	voice_saved_t *saved = instance;
+
+	if(key == props_map(saved->props, voice_defs[VOICE_note].property))
+	{
+		assert(size <= sizeof(saved->body));
+		saved->type = type;
+		saved->size = size;
+		memcpy(saved->body, value, size);
+	}
+
+	return LV2_STATE_SUCCESS;
+}
+
+static const void *
+_voice_retrieve(LV2_State_Handle instance, uint32_t key, size_t *size,
+	uint32_t *type, uint32_t *flags)
+{
+	voice_saved_t *saved = instance;
+
+	*flags = LV2_STATE_IS_POD;
+
+	if(key == props_map(saved->props, voice_defs[VOICE_note].property))
+	{
+		*size = saved->size;
+		*type = saved->type;
+		return saved->body;
+	}
+
+	return NULL;
+}
+
+// returns the props:index and patch:value vectors of the last patch:Set
+static const LV2_Atom_Vector *
+_voice_notified(props_t *props, const LV2_Atom_Sequence *seq,
+	const LV2_Atom_Vector **value)
+{
+	const LV2_Atom_Vector *index = NULL;
+
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		if(obj->body.otype != props->urid.patch_set)
+			continue;
+
+		lv2_atom_object_get(obj,
+			props->urid.props_index, &index,
+			props->urid.patch_value, value,
+			0);
+	}
+
+	return index;
+}
+
+static void
+_test_9(handle_t *handle)
+{
+	assert(handle);
+
+	static struct {
+		PROPS_T(props, MAX_NVOICES);
+		voicestate_t state;
+		voicestate_t stash;
+	} voiced;
+	props_t *props = &voiced.props;
+	voicestate_t *state = &voiced.state;
+	voicestate_t *stash = &voiced.stash;
+	const LV2_Feature *const features [] = { NULL };
+	voice_saved_t saved = {
+		.props = props
+	};
+	uint8_t msg [256];
+	uint8_t notify [1024];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Ref ref;
+	const LV2_Atom_Vector *index = NULL;
+	const LV2_Atom_Vector *value = NULL;
+
+	memset(&voiced, 0x0, sizeof(voiced));
+	assert(props_init(props, PROPS_PREFIX"subj", voice_defs, MAX_NVOICES,
+		state, stash, &handle->map, NULL) == 1);
+	lv2_atom_forge_init(&forge, &handle->map);
+
+	const LV2_URID gain = props_map(props, voice_defs[VOICE_gain].property);
+	const LV2_URID note = props_map(props, voice_defs[VOICE_note].property);
+
+	props_impl_t *impl = _props_impl_get(props, note);
+	assert(impl);
+	assert(_props_impl_shape(props, impl)->count == NVOICES);
+	assert(_props_impl_shape(props, impl)->stride == sizeof(state->voice[0]));
+	assert(impl->value.size == sizeof(int32_t));
+
+	// O(1) element access
+	assert(props_element(props, note, 5) == &state->voice[5].note);
+	assert(props_element(props, gain, 7) == &state->gain[7]);
+	assert(props_element(props, gain, NVOICES) == NULL);
+
+	// single element via props:index
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_set);
+	lv2_atom_forge_key(&forge, props->urid.patch_property);
+	lv2_atom_forge_urid(&forge, gain);
+	lv2_atom_forge_key(&forge, props->urid.props_index);
+	lv2_atom_forge_int(&forge, 3);
+	lv2_atom_forge_key(&forge, props->urid.patch_value);
+	lv2_atom_forge_float(&forge, 0.5f);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(state->gain[3] == 0.5f);
+	assert(stash->gain[3] == 0.5f);
+	assert(state->gain[2] == 0.f);
+
+	// only the changed element is sent on
+	index = _voice_notified(props, (const LV2_Atom_Sequence *)notify, &value);
+	assert(index && value);
+	assert(index->atom.size == sizeof(LV2_Atom_Vector_Body) + sizeof(int32_t));
+	assert(((const int32_t *)&index[1])[0] == 3);
+	assert(value->body.child_type == props->urid.atom_float);
+	assert(((const float *)&value[1])[0] == 0.5f);
+
+	// bulk elements via a props:index vector, strided
+	const int32_t idxs [2] = { 1, 6 };
+	const int32_t notes [2] = { 60, 67 };
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_set);
+	lv2_atom_forge_key(&forge, props->urid.patch_property);
+	lv2_atom_forge_urid(&forge, note);
+	lv2_atom_forge_key(&forge, props->urid.props_index);
+	lv2_atom_forge_vector(&forge, sizeof(int32_t), props->urid.atom_int, 2, idxs);
+	lv2_atom_forge_key(&forge, props->urid.patch_value);
+	lv2_atom_forge_vector(&forge, sizeof(int32_t), props->urid.atom_int, 2, notes);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(state->voice[1].note == 60);
+	assert(state->voice[6].note == 67);
+	assert(stash->voice[6].note == 67);
+	assert(state->voice[1].vel == 0.f); // untouched in between
+
+	index = _voice_notified(props, (const LV2_Atom_Sequence *)notify, &value);
+	assert(index && value);
+	assert(value->atom.size == sizeof(LV2_Atom_Vector_Body) + 2*sizeof(int32_t));
+	assert(((const int32_t *)&value[1])[1] == 67);
+
+	// out-of-range index changes nothing
+	const int32_t bad [2] = { 2, NVOICES };
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_set);
+	lv2_atom_forge_key(&forge, props->urid.patch_property);
+	lv2_atom_forge_urid(&forge, note);
+	lv2_atom_forge_key(&forge, props->urid.props_index);
+	lv2_atom_forge_vector(&forge, sizeof(int32_t), props->urid.atom_int, 2, bad);
+	lv2_atom_forge_key(&forge, props->urid.patch_value);
+	lv2_atom_forge_vector(&forge, sizeof(int32_t), props->urid.atom_int, 2, notes);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+
+	ref = 0;
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(state->voice[2].note == 0);
+
+	// dsp-side changes, only marked elements are notified
+	state->voice[4].note = 72;
+	props_dirty(props, note, 4);
+	props_dirty(props, note, NVOICES); // ignored
+
+	// a patch:Get of another element in between keeps the mark
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_get);
+	lv2_atom_forge_key(&forge, props->urid.patch_property);
+	lv2_atom_forge_urid(&forge, note);
+	lv2_atom_forge_key(&forge, props->urid.props_index);
+	lv2_atom_forge_int(&forge, 6);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	index = _voice_notified(props, (const LV2_Atom_Sequence *)notify, &value);
+	assert(index && value);
+	assert(index->atom.size == sizeof(LV2_Atom_Vector_Body) + sizeof(int32_t));
+	assert(((const int32_t *)&index[1])[0] == 6);
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	props_set(props, &forge, 0, note, &ref);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(stash->voice[4].note == 72);
+
+	index = _voice_notified(props, (const LV2_Atom_Sequence *)notify, &value);
+	assert(index && value);
+	assert(index->atom.size == sizeof(LV2_Atom_Vector_Body) + sizeof(int32_t));
+	assert(((const int32_t *)&index[1])[0] == 4);
+	assert(((const int32_t *)&value[1])[0] == 72);
+
+	// save as dense atom:Vector, restore scatters back into the stride
+	assert(props_save(props, _voice_store, &saved, 0, features) == LV2_STATE_SUCCESS);
+	assert(saved.type == props->urid.atom_vector);
+	assert(saved.size == sizeof(LV2_Atom_Vector_Body) + NVOICES*sizeof(int32_t));
+
+	const int32_t *dense = (const int32_t *)&saved.body[sizeof(LV2_Atom_Vector_Body)];
+	assert(dense[1] == 60);
+	assert(dense[4] == 72);
+	assert(dense[6] == 67);
+
+	((int32_t *)&saved.body[sizeof(LV2_Atom_Vector_Body)])[0] = 48;
+	assert(props_restore(props, _voice_retrieve, &saved, 0, features) == LV2_STATE_SUCCESS);
+
+	ref = 0;
+	props_idle(props, NULL, 0, &ref);
+	assert(state->voice[0].note == 48);
+	assert(state->voice[6].note == 67);
+	assert(state->voice[0].vel == 0.f);
+}
+
+static void
+_test_10(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	plugstate_t *stash = &handle->stash;
+	uint8_t msg [512];
+	uint8_t notify [1024];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Frame tup_frame;
+	LV2_Atom_Forge_Ref ref;
+
+	lv2_atom_forge_init(&forge, &handle->map);
+
+	const LV2_URID properties [4] = {
+		props_map(props, defs[PROP_i32].property),
+		props_map(props, defs[PROP_f32].property),
+		handle->map.map(handle->map.handle, PROPS_PREFIX"unknown"),
+		props_map(props, defs[PROP_str].property)
+	};
+
+	// many properties with a tuple of values in one message
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_set);
+	lv2_atom_forge_key(&forge, props->urid.patch_sequence);
+	lv2_atom_forge_int(&forge, 13);
+	lv2_atom_forge_key(&forge, props->urid.patch_property);
+	lv2_atom_forge_vector(&forge, sizeof(LV2_URID), props->urid.atom_urid, 4, properties);
+	lv2_atom_forge_key(&forge, props->urid.patch_value);
+	lv2_atom_forge_tuple(&forge, &tup_frame);
+	lv2_atom_forge_int(&forge, 11);
+	lv2_atom_forge_float(&forge, 0.25f);
+	lv2_atom_forge_int(&forge, 0);
+	lv2_atom_forge_string(&forge, "bulk", 4);
+	lv2_atom_forge_pop(&forge, &tup_frame);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(state->i32 == 11);
+	assert(stash->i32 == 11);
+	assert(state->f32 == 0.25f);
+	assert(!strcmp(state->str, "bulk"));
+	assert(!strcmp(stash->str, "bulk"));
+
+	// answered with a single patch:Set of the known properties and an ack
+	unsigned nsets = 0;
+	unsigned nacks = 0;
+	LV2_ATOM_SEQUENCE_FOREACH((const LV2_Atom_Sequence *)notify, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		if(obj->body.otype == props->urid.patch_ack)
+		{
+			nacks++;
+		}
+		else if(obj->body.otype == props->urid.patch_set)
+		{
+			const LV2_Atom_Vector *property = NULL;
+			const LV2_Atom_Tuple *value = NULL;
+
+			lv2_atom_object_get(obj,
+				props->urid.patch_property, &property,
+				props->urid.patch_value, &value,
+				0);
+			assert(property && value);
+			assert(property->atom.type == props->urid.atom_vector);
+			assert(property->atom.size == sizeof(LV2_Atom_Vector_Body) + 3*sizeof(LV2_URID));
+			assert(((const LV2_URID *)&property[1])[2] == properties[3]);
+			assert(value->atom.type == props->urid.atom_tuple);
+
+			unsigned nitems = 0;
+			LV2_ATOM_TUPLE_FOREACH(value, item)
+			{
+				if(nitems == 1)
+					assert(((const LV2_Atom_Float *)item)->body == 0.25f);
+				nitems++;
+			}
+			assert(nitems == 3);
+
+			nsets++;
+		}
+	}
+	assert(nsets == 1);
+	assert(nacks == 1);
+
+	// same-typed values as a vector
+	const float f32s [2] = { 0.75f, 1.f };
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_set);
+	lv2_atom_forge_key(&forge, props->urid.patch_property);
+	lv2_atom_forge_vector(&forge, sizeof(LV2_URID), props->urid.atom_urid, 2, &properties[1]);
+	lv2_atom_forge_key(&forge, props->urid.patch_value);
+	lv2_atom_forge_vector(&forge, sizeof(float), props->urid.atom_float, 2, f32s);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	ref = 0;
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(state->f32 == 0.75f);
+	assert(stash->f32 == 0.75f);
+
+	// truncated tuples stop at the first item out of bounds
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_set);
+	lv2_atom_forge_key(&forge, props->urid.patch_property);
+	lv2_atom_forge_vector(&forge, sizeof(LV2_URID), props->urid.atom_urid, 2, properties);
+	lv2_atom_forge_key(&forge, props->urid.patch_value);
+	lv2_atom_forge_tuple(&forge, &tup_frame);
+	lv2_atom_forge_int(&forge, 12);
+	lv2_atom_forge_float(&forge, 0.5f);
+	lv2_atom_forge_pop(&forge, &tup_frame);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	LV2_Atom_Tuple *tup = NULL;
+	lv2_atom_object_get((const LV2_Atom_Object *)msg, props->urid.patch_value, &tup, 0);
+	assert(tup);
+	const uint32_t cut = tup->atom.size - sizeof(LV2_Atom_Int) - sizeof(LV2_Atom);
+	tup->atom.size -= cut; // header of the float without its body
+	((LV2_Atom *)msg)->size -= cut;
+
+	ref = 0;
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(state->i32 == 12);
+	assert(state->f32 == 0.75f);
+
+	// many properties requested and answered in one message each
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	props_get_bulk(props, &forge, 0, properties, 4, &ref);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)msg;
+	const LV2_Atom_Event *get = lv2_atom_sequence_begin(&seq->body);
+	assert(!lv2_atom_sequence_is_end(&seq->body, seq->atom.size, get));
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)&get->body, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	nsets = 0;
+	LV2_ATOM_SEQUENCE_FOREACH((const LV2_Atom_Sequence *)notify, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		if(obj->body.otype == props->urid.patch_set)
+			nsets++;
+	}
+	assert(nsets == 1);
+
+	// dsp-side changes of many properties
+	state->i32 = 14;
+	state->f32 = 2.f;
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	props_set_bulk(props, &forge, 0, properties, 2, &ref);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+	assert(stash->i32 == 14);
+	assert(stash->f32 == 2.f);
+}
+
+typedef struct _requested_t requested_t;
+
+struct _requested_t {
+	int32_t sequence_num;
+	LV2_URID property;
+	props_request_status_t status;
+	unsigned n;
+};
+
+static void
+_request_cb(void *data, int32_t sequence_num, LV2_URID property,
+	props_request_status_t status)
+{
+	requested_t *requested = data;
+
+	requested->sequence_num = sequence_num;
+	requested->property = property;
+	requested->status = status;
+	requested->n++;
+}
+
+// feeds all events of one side's output into the other side
+static void
+_request_pipe(props_t *props, const uint8_t *src, uint8_t *dst, size_t size)
+{
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+
+	lv2_atom_forge_init(&forge, &((handle_t *)props->data)->map);
+	lv2_atom_forge_set_buffer(&forge, dst, size);
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+
+	LV2_ATOM_SEQUENCE_FOREACH((const LV2_Atom_Sequence *)src, ev)
+	{
+		props_advance(props, &forge, ev->time.frames,
+			(const LV2_Atom_Object *)&ev->body, &ref);
+	}
+
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+}
+
+static void
+_test_11(handle_t *handle)
+{
+	assert(handle);
+
+	static struct {
+		PROPS_T(props, MAX_NPROPS);
+		plugstate_t state;
+		plugstate_t stash;
+	} server;
+	props_t *props = &handle->props;
+	props_t *remote = &server.props;
+	plugstate_t *state = &handle->state;
+	props_request_t reqs [2];
+	requested_t requested [3];
+	uint8_t out [1024];
+	uint8_t in [1024];
+	uint8_t back [1024];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+
+	memset(&server, 0x0, sizeof(server));
+	memset(requested, 0x0, sizeof(requested));
+
+	// the server knows the scalar properties only
+	assert(props_init(remote, PROPS_PREFIX"subj", defs, PROP_urid + 1,
+		&server.state, &server.stash, &handle->map, handle) == 1);
+	props->data = handle;
+
+	lv2_atom_forge_init(&forge, &handle->map);
+	props_requests(props, reqs, 2);
+
+	const LV2_URID i32 = props_map(props, defs[PROP_i32].property);
+	const LV2_URID f32 = props_map(props, defs[PROP_f32].property);
+	const LV2_URID str = props_map(props, defs[PROP_str].property);
+
+	// two requests in flight, the table is full
+	state->i32 = 42;
+	server.state.f32 = 0.5f;
+
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	const int32_t seq_set = props_request_set(props, &forge, 0, i32, 64,
+		_request_cb, &requested[0], &ref);
+	const int32_t seq_get = props_request_get(props, &forge, 1, f32, 64,
+		_request_cb, &requested[1], &ref);
+	assert(props_request_get(props, &forge, 2, str, 64,
+		_request_cb, &requested[2], &ref) == 0);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(seq_set < 0);
+	assert(seq_get < 0);
+	assert(seq_set != seq_get);
+
+	// a UI's patch:Set with a number of its own is acked, never taken as reply
+	uint8_t msg [128];
+	LV2_Atom_Forge_Frame obj_frame;
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_set);
+	lv2_atom_forge_key(&forge, props->urid.patch_sequence);
+	lv2_atom_forge_int(&forge, -seq_get);
+	lv2_atom_forge_key(&forge, props->urid.patch_property);
+	lv2_atom_forge_urid(&forge, f32);
+	lv2_atom_forge_key(&forge, props->urid.patch_value);
+	lv2_atom_forge_float(&forge, 0.25f);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+
+	lv2_atom_forge_set_buffer(&forge, back, sizeof(back));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	unsigned nacks = 0;
+	LV2_ATOM_SEQUENCE_FOREACH((const LV2_Atom_Sequence *)back, ev)
+	{
+		if(((const LV2_Atom_Object *)&ev->body)->body.otype == props->urid.patch_ack)
+			nacks++;
+	}
+	assert(nacks == 1);
+	assert(requested[1].n == 0);
+
+	// server answers, client matches the replies
+	_request_pipe(remote, out, in, sizeof(in));
+	assert(server.state.i32 == 42);
+
+	_request_pipe(props, in, back, sizeof(back));
+
+	assert(requested[0].n == 1);
+	assert(requested[0].sequence_num == seq_set);
+	assert(requested[0].property == i32);
+	assert(requested[0].status == PROPS_REQUEST_ACK);
+
+	assert(requested[1].n == 1);
+	assert(requested[1].sequence_num == seq_get);
+	assert(requested[1].status == PROPS_REQUEST_VALUE);
+	assert(state->f32 == 0.5f);
+
+	// the value reply is neither acked nor passed on with its sequence number
+	LV2_ATOM_SEQUENCE_FOREACH((const LV2_Atom_Sequence *)back, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+		const LV2_Atom_Int *sequence = NULL;
+
+		lv2_atom_object_get(obj, props->urid.patch_sequence, &sequence, 0);
+		assert(!sequence || (sequence->body != seq_get));
+	}
+
+	// unknown to the server
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	const int32_t seq_err = props_request_get(props, &forge, 0, str, 64,
+		_request_cb, &requested[2], &ref);
+	assert(seq_err < 0);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	_request_pipe(remote, out, in, sizeof(in));
+	_request_pipe(props, in, back, sizeof(back));
+
+	assert(requested[2].n == 1);
+	assert(requested[2].sequence_num == seq_err);
+	assert(requested[2].status == PROPS_REQUEST_ERROR);
+
+	// never answered
+	lv2_atom_forge_set_buffer(&forge, out, sizeof(out));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	const int32_t seq_lost = props_request_get(props, &forge, 16, f32, 64,
+		_request_cb, &requested[1], &ref);
+	assert(seq_lost < 0);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	props_tick(props, 64);
+	assert(requested[1].n == 1);
+	props_tick(props, 64);
+	assert(requested[1].n == 2);
+	assert(requested[1].sequence_num == seq_lost);
+	assert(requested[1].status == PROPS_REQUEST_TIMEOUT);
+
+	// late replies are ignored
+	assert(_props_request_complete(props, seq_lost, PROPS_REQUEST_VALUE) == 0);
+	assert(requested[1].n == 2);
+}
+
+static void
+_test_12(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	const LV2_Feature *const features [] = { NULL };
+	saved_t saved = {
+		.handle = handle,
+		.i32 = 3,
+		.i64 = 6
+	};
+	LV2_Atom_Forge_Ref ref = 0;
+
+	assert(props_idle_pending(props) == 0);
+	assert(props_idle_budget(props, NULL, 0, 1, 0, &ref) == true);
+
+	assert(props_restore(props, _retrieve, &saved, 0, features) == LV2_STATE_SUCCESS);
+	assert(props_idle_pending(props) == MAX_NPROPS);
+
+	// one property per cycle
+	assert(props_idle_budget(props, NULL, 0, 1, 0, &ref) == false);
+	assert( (state->i32 == 3) != (state->i64 == 6) );
+	assert(props_idle_pending(props) > 0);
+	assert(props_idle_pending(props) < MAX_NPROPS);
+
+	// a restore in between is picked up after the ongoing sweep
+	saved.i32 = 5;
+	assert(props_restore(props, _retrieve, &saved, 0, features) == LV2_STATE_SUCCESS);
+
+	unsigned ncycles = 0;
+	while(!props_idle_budget(props, NULL, 0, 1, 0, &ref))
+		ncycles++;
+	assert(ncycles <= 2);
+	assert(props_idle_pending(props) > 0); // the second sweep
+
+	assert(props_idle_budget(props, NULL, 0, 0, sizeof(int32_t), &ref) == false);
+	while(!props_idle_budget(props, NULL, 0, 0, sizeof(int32_t), &ref))
+		;
+	assert(props_idle_pending(props) == 0);
+	assert(state->i32 == 5);
+	assert(state->i64 == 6);
+
+	// unlimited budget equals props_idle
+	saved.i32 = 7;
+	assert(props_restore(props, _retrieve, &saved, 0, features) == LV2_STATE_SUCCESS);
+	assert(props_idle_budget(props, NULL, 0, 0, 0, &ref) == true);
+	assert(state->i32 == 7);
+	assert(props_idle_pending(props) == 0);
+}
+
+static unsigned
+_dumped(props_t *props, const LV2_Atom_Sequence *seq, int32_t sequence_num,
+	uint32_t *mask)
+{
+	unsigned n = 0;
+
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		if(obj->body.otype != props->urid.patch_set)
+			continue;
+
+		const LV2_Atom_URID *property = NULL;
+		const LV2_Atom_Int *sequence = NULL;
+		lv2_atom_object_get(obj,
+			props->urid.patch_property, &property,
+			props->urid.patch_sequence, &sequence,
+			0);
+		assert(property);
+		assert(sequence && (sequence->body == sequence_num));
+
+		for(unsigned i = 0; i < MAX_NPROPS; i++)
+		{
+			if(props_map(props, defs[i].property) == property->body)
+			{
+				assert(!(*mask & (1 << i))); // only once
+				*mask |= 1 << i;
+			}
+		}
+
+		n++;
+	}
+
+	return n;
+}
+
+static void
+_test_13(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	uint8_t msg [128];
+	uint8_t notify [192];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Ref ref;
+	uint32_t mask = 0;
+
+	lv2_atom_forge_init(&forge, &handle->map);
+
+	// wildcard patch:Get
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_get);
+	lv2_atom_forge_key(&forge, props->urid.patch_sequence);
+	lv2_atom_forge_int(&forge, 17);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	assert(props_dump_pending(props) == 0);
+
+	// the notify buffer only fits a few properties per cycle
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	unsigned n = _dumped(props, (const LV2_Atom_Sequence *)notify, 17, &mask);
+	assert(n > 0);
+	assert(props_dump_pending(props) > 0);
+	assert(props_dump_pending(props) < MAX_NPROPS);
+
+	// continued in props_idle
+	unsigned ncycles = 1;
+	while(props_dump_pending(props))
+	{
+		lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+		ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+		props_idle(props, &forge, 0, &ref);
+		assert(ref);
+		lv2_atom_forge_pop(&forge, &frame);
+
+		n += _dumped(props, (const LV2_Atom_Sequence *)notify, 17, &mask);
+		assert(++ncycles < 2*MAX_NPROPS);
+	}
+
+	assert(n == MAX_NPROPS);
+	assert(mask == (1 << MAX_NPROPS) - 1);
+	assert(ncycles > 2);
+
+	// nothing left to dump
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	props_idle(props, &forge, 0, &ref);
+	lv2_atom_forge_pop(&forge, &frame);
+	assert(((const LV2_Atom_Sequence *)notify)->atom.size == sizeof(LV2_Atom_Sequence_Body));
+
+	// properties that never fit are skipped instead of stalling the dump
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(LV2_Atom_Sequence) + 32);
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+	assert(((const LV2_Atom_Sequence *)notify)->atom.size == sizeof(LV2_Atom_Sequence_Body));
+	assert(props_dump_pending(props) == 0);
+}
+
+static void
+_test_14(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	static plugstate_t defaults;
+	uint8_t msg [128];
+	uint8_t notify [2048];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Ref ref;
+	uint32_t mask = 0;
+
+	lv2_atom_forge_init(&forge, &handle->map);
+
+	const LV2_URID i32 = props_map(props, defs[PROP_i32].property);
+
+	// everything but i32 and f64 sits at its default
+	defaults = *state;
+	defaults.i32 = 1;
+	defaults.f64 = 0.5;
+	props_defaults(props, &defaults);
+
+	assert(!props_default(props, i32));
+	assert(props_default(props, props_map(props, defs[PROP_f32].property)));
+	state->i32 = 1;
+	assert(props_default(props, i32));
+	state->i32 = 2;
+
+	// wildcard patch:Get relative to defaults
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_get);
+	lv2_atom_forge_key(&forge, props->urid.patch_sequence);
+	lv2_atom_forge_int(&forge, 19);
+	lv2_atom_forge_key(&forge, props->urid.props_defaults);
+	lv2_atom_forge_bool(&forge, true);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	// the marker comes first
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)notify;
+	const LV2_Atom_Event *ev = lv2_atom_sequence_begin(&seq->body);
+	const LV2_Atom_URID *property = NULL;
+	const LV2_Atom_Bool *value = NULL;
+	lv2_atom_object_get((const LV2_Atom_Object *)&ev->body,
+		props->urid.patch_property, &property,
+		props->urid.patch_value, &value,
+		0);
+	assert(property && (property->body == props->urid.props_defaults));
+	assert(value && value->body);
+
+	assert(_dumped(props, seq, 19, &mask) == 1 + 2);
+	assert(mask == ((1 << PROP_i32) | (1 << PROP_f64)));
+	assert(props_dump_pending(props) == 0);
+
+	// only what is sent on is pending
+	LV2_Atom_Forge_Ref nref = 0;
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &nref) == 1);
+	assert(props_dump_pending(props) == 2);
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	props_idle(props, &forge, 0, &ref);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+	assert(props_dump_pending(props) == 0);
+
+	// a plain wildcard patch:Get still sends everything
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_get);
+	lv2_atom_forge_key(&forge, props->urid.patch_sequence);
+	lv2_atom_forge_int(&forge, 19);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	mask = 0;
+	assert(_dumped(props, seq, 19, &mask) == MAX_NPROPS);
+}
+
+static unsigned
+_notified(props_t *props, const LV2_Atom_Sequence *seq, LV2_URID property)
+{
+	unsigned n = 0;
+
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+		const LV2_Atom_URID *prop = NULL;
+
+		if(obj->body.otype != props->urid.patch_set)
+			continue;
+
+		lv2_atom_object_get(obj, props->urid.patch_property, &prop, 0);
+		if(prop && (prop->body == property))
+			n++;
+	}
+
+	return n;
+}
+
+static void
+_test_15(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	uint8_t msg [256];
+	uint8_t notify [1024];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Ref ref;
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)notify;
+
+	lv2_atom_forge_init(&forge, &handle->map);
+
+	const LV2_URID i32 = props_map(props, defs[PROP_i32].property);
+	const LV2_URID f32 = props_map(props, defs[PROP_f32].property);
+
+	assert(props_subscribed(props, i32));
+	assert(props_subscribed(props, f32));
+
+	// subscribe to i32 only
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_set);
+	lv2_atom_forge_key(&forge, props->urid.patch_sequence);
+	lv2_atom_forge_int(&forge, 23);
+	lv2_atom_forge_key(&forge, props->urid.patch_property);
+	lv2_atom_forge_urid(&forge, props->urid.props_subscription);
+	lv2_atom_forge_key(&forge, props->urid.patch_value);
+	lv2_atom_forge_vector(&forge, sizeof(LV2_URID), props->urid.atom_urid, 1, &i32);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	const LV2_Atom_Event *ev = lv2_atom_sequence_begin(&seq->body);
+	assert(((const LV2_Atom_Object *)&ev->body)->body.otype == props->urid.patch_ack);
+
+	assert(props_subscribed(props, i32));
+	assert(!props_subscribed(props, f32));
+
+	// only subscribed changes are sent on
+	state->i32 = 3;
+	state->f32 = 3.f;
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	props_set(props, &forge, 0, i32, &ref);
+	props_set(props, &forge, 0, f32, &ref);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(_notified(props, seq, i32) == 1);
+	assert(_notified(props, seq, f32) == 0);
+
+	// unsubscribed ones still are refreshed on demand
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_get);
+	lv2_atom_forge_key(&forge, props->urid.patch_property);
+	lv2_atom_forge_urid(&forge, f32);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(_notified(props, seq, f32) == 1);
+
+	// subscribe to all again
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_set);
+	lv2_atom_forge_key(&forge, props->urid.patch_property);
+	lv2_atom_forge_urid(&forge, props->urid.props_subscription);
+	lv2_atom_forge_key(&forge, props->urid.patch_value);
+	lv2_atom_forge_bool(&forge, true);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	props_set(props, &forge, 0, f32, &ref);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(props_subscribed(props, f32));
+	assert(_notified(props, seq, f32) == 1);
+
+	props_subscribe(props, f32, false);
+	assert(!props_subscribed(props, f32));
+	assert(props_subscribed(props, i32));
+}
+
+typedef struct _ui_t ui_t;
+
+struct _ui_t {
+	PROPS_CLIENT_T(client, MAX_NPROPS);
+	plugstate_t mirror;
+	unsigned nchanged;
+};
+
+static void
+_ui_changed(void *data, LV2_URID property)
+{
+	ui_t *ui = data;
+
+	assert(property);
+	ui->nchanged++;
+}
+
+// feeds a notify sequence to the client
+static void
+_ui_port_event(ui_t *ui, const uint8_t *notify)
+{
+	LV2_ATOM_SEQUENCE_FOREACH((const LV2_Atom_Sequence *)notify, ev)
+	{
+		props_client_advance(&ui->client, (const LV2_Atom_Object *)&ev->body);
+	}
+}
+
+// runs a message of the client through the plugin
+static void
+_ui_write(handle_t *handle, const uint8_t *msg, uint8_t *notify, size_t size)
+{
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+
+	lv2_atom_forge_init(&forge, &handle->map);
+	lv2_atom_forge_set_buffer(&forge, notify, size);
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_advance(&handle->props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 1);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+}
+
+static void
+_test_16(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	static ui_t ui;
+	uint8_t msg [512];
+	uint8_t notify [4096];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Ref ref;
+
+	memset(&ui, 0x0, sizeof(ui));
+	lv2_atom_forge_init(&forge, &handle->map);
+
+	assert(props_client_init(&ui.client, PROPS_PREFIX"subj", defs, MAX_NPROPS,
+		&ui.mirror, &handle->map, _ui_changed, &ui) == 1);
+
+	const LV2_URID i32 = props_map(props, defs[PROP_i32].property);
+	const LV2_URID f32 = props_map(props, defs[PROP_f32].property);
+	const LV2_URID str = props_map(props, defs[PROP_str].property);
+
+	state->i32 = 7;
+	state->f32 = 0.75f;
+
+	// initial sync
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = 1;
+	props_client_sync(&ui.client, &forge, &ref);
+	assert(ref);
+	assert(!props_client_known(&ui.client, i32));
+
+	_ui_write(handle, msg, notify, sizeof(notify));
+	_ui_port_event(&ui, notify);
+
+	assert(ui.nchanged == MAX_NPROPS);
+	assert(props_client_known(&ui.client, i32));
+	assert(ui.mirror.i32 == 7);
+	assert(ui.mirror.f32 == 0.75f);
+
+	// known values need no round trip
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = 1;
+	assert(props_client_get(&ui.client, &forge, i32, &ref) == false);
+
+	// many changes coalesce into a single bulk patch:Set
+	const int32_t i32s [3] = { 1, 2, 3 };
+	for(unsigned i = 0; i < 3; i++)
+		assert(props_client_set(&ui.client, i32, forge.Int, sizeof(int32_t), &i32s[i]) == 1);
+	assert(props_client_set(&ui.client, str, forge.String, 6, "hello") == 1);
+	assert(props_client_set(&ui.client, f32, forge.Int, sizeof(int32_t), &i32s[0]) == 0);
+	assert(ui.mirror.i32 == 3);
+
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = 1;
+	assert(props_client_flush(&ui.client, &forge, &ref) == 2);
+	assert(ref);
+	assert(((const LV2_Atom_Object *)msg)->body.otype == props->urid.patch_set);
+
+	ui.nchanged = 0;
+	_ui_write(handle, msg, notify, sizeof(notify));
+	assert(state->i32 == 3);
+	assert(!strcmp(state->str, "hello"));
+
+	// the echo and ack come back
+	assert(ui.client.inflight);
+	_ui_port_event(&ui, notify);
+	assert(!ui.client.inflight);
+	assert(ui.nchanged == 2);
+
+	// nothing left to flush
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = 1;
+	assert(props_client_flush(&ui.client, &forge, &ref) == 0);
+
+	// a single change is sent as plain patch:Set
+	const float f = 0.5f;
+	assert(props_client_set(&ui.client, f32, forge.Float, sizeof(float), &f) == 1);
+
+	// incoming values don't overwrite pending local changes
+	state->f32 = 0.25f;
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	LV2_Atom_Forge_Frame frame;
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	props_set(props, &forge, 0, f32, &ref);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+	_ui_port_event(&ui, notify);
+	assert(ui.mirror.f32 == 0.5f);
+
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = 1;
+	assert(props_client_flush(&ui.client, &forge, &ref) == 1);
+	_ui_write(handle, msg, notify, sizeof(notify));
+	assert(state->f32 == 0.5f);
+
+	// bulk items too small for their type stop the bulk
+	const LV2_URID both [2] = { i32, f32 };
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Frame tup_frame;
+	const int32_t i32_before = ui.mirror.i32;
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_set);
+	lv2_atom_forge_key(&forge, props->urid.patch_property);
+	lv2_atom_forge_vector(&forge, sizeof(LV2_URID), props->urid.atom_urid, 2, both);
+	lv2_atom_forge_key(&forge, props->urid.patch_value);
+	lv2_atom_forge_tuple(&forge, &tup_frame);
+	lv2_atom_forge_atom(&forge, 0, forge.Int);
+	lv2_atom_forge_float(&forge, 0.125f);
+	lv2_atom_forge_pop(&forge, &tup_frame);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	assert(props_client_advance(&ui.client, (const LV2_Atom_Object *)notify) == 1);
+	assert(ui.mirror.i32 == i32_before);
+	assert(ui.mirror.f32 == 0.5f);
+}
+
+static void
+_test_17(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	plugstate_t *stash = &handle->stash;
+	static plugstate_t presets [2];
+	static uint32_t sizes [2][MAX_NPROPS];
+	props_slot_t slots [2] = {
+		{ .base = &presets[0], .sizes = sizes[0] },
+		{ .base = &presets[1], .sizes = sizes[1] }
+	};
+	uint8_t notify [1024];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)notify;
+
+	lv2_atom_forge_init(&forge, &handle->map);
+	props_bank(props, slots, 2);
+
+	const LV2_URID i32 = props_map(props, defs[PROP_i32].property);
+	const LV2_URID f64 = props_map(props, defs[PROP_f64].property);
+
+	// A
+	state->i32 = 1;
+	state->f64 = 1.0;
+	assert(props_bank_store(props, 0));
+
+	// B
+	state->i32 = 2;
+	state->f64 = 2.0;
+	assert(props_bank_store(props, 1));
+	assert(!props_bank_store(props, 2));
+
+	// only what differs is changed and sent on
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_bank_recall(props, &forge, 0, 0, &ref) == 2);
+	assert(props_bank_recall(props, &forge, 0, 0, &ref) == 0);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(state->i32 == 1);
+	assert(stash->i32 == 1);
+	assert(state->f64 == 1.0);
+	assert(stash->f64 == 1.0);
+	assert(_notified(props, seq, i32) == 1);
+	assert(_notified(props, seq, f64) == 1);
+
+	state->f64 = 2.0;
+
+	// switched from another thread, applied in props_idle
+	props_bank_select(props, 1);
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	props_idle(props, &forge, 0, &ref);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(state->i32 == 2);
+	assert(stash->i32 == 2);
+	assert(_notified(props, seq, i32) == 1);
+	assert(_notified(props, seq, f64) == 0);
+
+	// values the property refuses are neither counted nor sent on
+	const LV2_URID str = props_map(props, defs[PROP_str].property);
+	const unsigned istr = _props_impl_get(props, str) - props->impls;
+	strcpy(presets[0].str, "refused");
+	sizes[0][istr] = STR_SIZE + 1;
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_bank_recall(props, &forge, 0, 0, &ref) == 2);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(strcmp(state->str, "refused"));
+	assert(_notified(props, seq, str) == 0);
+
+	// empty slots are left alone
+	props_bank(props, slots, 2);
+	assert(props_bank_recall(props, &forge, 0, 0, &ref) == 0);
+}
+
+static void
+_test_18(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	static plugstate_t presets [2];
+	static uint32_t sizes [2][MAX_NPROPS];
+	props_slot_t slots [2] = {
+		{ .base = &presets[0], .sizes = sizes[0] },
+		{ .base = &presets[1], .sizes = sizes[1] }
+	};
+	const char *names [2] = { "soft", "loud" };
+	const LV2_Feature *const features [] = { NULL };
+	props_library_t lib;
+	LV2_Atom_Forge_Ref ref = 0;
+
+	props_bank(props, slots, 2);
+
+	state->i32 = 1;
+	state->f64 = 1.0;
+	_props_impl_set(props, _props_impl_get(props, props_map(props, defs[PROP_str].property)),
+		_props_impl_get(props, props_map(props, defs[PROP_str].property))->type, 5, "soft");
+	props_idle(props, NULL, 0, &ref);
+	assert(props_bank_store(props, 0));
+
+	state->i32 = 2;
+	state->f64 = 2.0;
+	_props_impl_set(props, _props_impl_get(props, props_map(props, defs[PROP_str].property)),
+		_props_impl_get(props, props_map(props, defs[PROP_str].property))->type, 5, "loud");
+	props_idle(props, NULL, 0, &ref);
+	assert(props_bank_store(props, 1));
+
+	char path [] = "/tmp/props_test_XXXXXX";
+	const int fd = mkstemp(path);
+	assert(fd != -1);
+	close(fd);
+
+	assert(props_library_save(props, path, names, slots, 2));
+	assert(props_library_open(&lib, path));
+
+	// presets are sorted by name
+	assert(props_library_count(&lib) == 2);
+	assert(strcmp(props_library_name(&lib, 0), "loud") == 0);
+	assert(strcmp(props_library_name(&lib, 1), "soft") == 0);
+	assert(props_library_name(&lib, 2) == NULL);
+	assert(props_library_find(&lib, "soft") == 1);
+	assert(props_library_find(&lib, "loud") == 0);
+	assert(props_library_find(&lib, "none") == -1);
+
+	// duplicate names are refused, a new save replaces the file, not the mapping
+	const char *dups [2] = { "soft", "soft" };
+	const char *swapped [2] = { "loud", "soft" };
+	assert(!props_library_save(props, path, dups, slots, 2));
+	assert(!props_library_save(props, "/nonexistent/props_test", names, slots, 2));
+	assert(props_library_save(props, path, swapped, slots, 2));
+
+	state->i32 = 3;
+	state->f64 = 3.0;
+
+	assert(props_library_restore(props, &lib, props_library_find(&lib, "soft"), features)
+		== LV2_STATE_SUCCESS);
+	props_idle(props, NULL, 0, &ref);
+	assert(state->i32 == 1);
+	assert(state->f64 == 1.0);
+	assert(strcmp(state->str, "soft") == 0);
+
+	assert(props_library_restore(props, &lib, 0, features) == LV2_STATE_SUCCESS);
+	props_idle(props, NULL, 0, &ref);
+	assert(state->i32 == 2);
+	assert(state->f64 == 2.0);
+	assert(strcmp(state->str, "loud") == 0);
+
+	assert(props_library_restore(props, &lib, 2, features) != LV2_STATE_SUCCESS);
+
+	props_library_close(&lib);
+	assert(props_library_count(&lib) == 0);
+
+	// anything else is refused
+	assert(!props_library_open(&lib, "/nonexistent"));
+	const int fd2 = open(path, O_WRONLY | O_TRUNC);
+	assert(fd2 != -1);
+	assert(write(fd2, "PRPS\x01\0\0\0garbage-garbage", 24) == 24);
+	close(fd2);
+	assert(!props_library_open(&lib, path));
+
+	unlink(path);
+}
+
+static void
+_test_19(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	static uint64_t history [64];
+	uint8_t notify [1024];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref = 0;
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)notify;
+
+	lv2_atom_forge_init(&forge, &handle->map);
+	props_history(props, history, sizeof(history));
+
+	const LV2_URID i32 = props_map(props, defs[PROP_i32].property);
+	const LV2_URID f64 = props_map(props, defs[PROP_f64].property);
+	props_impl_t *str = _props_impl_get(props, props_map(props, defs[PROP_str].property));
+
+	assert(props_undo(props, &forge, 0, &ref) == 0);
+	assert(props_redo(props, &forge, 0, &ref) == 0);
+
+	state->i32 = 1;
+	props_set(props, &forge, 0, i32, &ref);
+	state->i32 = 2;
+	props_set(props, &forge, 0, i32, &ref);
+	props_set(props, &forge, 0, i32, &ref); // unchanged, not logged
+
+	// changed together, undone together
+	props_epoch_begin(props);
+	state->i32 = 3;
+	state->f64 = 3.0;
+	props_set(props, &forge, 0, i32, &ref);
+	props_set(props, &forge, 0, f64, &ref);
+	props_epoch_end(props);
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_undo(props, &forge, 0, &ref) == 2);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(state->i32 == 2);
+	assert(state->f64 == 0.0);
+	assert(_notified(props, seq, i32) == 1);
+	assert(_notified(props, seq, f64) == 1);
+
+	ref = 0;
+	assert(props_undo(props, &forge, 0, &ref) == 1);
+	assert(state->i32 == 1);
+	assert(props_undo(props, &forge, 0, &ref) == 1);
+	assert(state->i32 == 0);
+	assert(props_undo(props, &forge, 0, &ref) == 0);
+
+	assert(props_redo(props, &forge, 0, &ref) == 1);
+	assert(state->i32 == 1);
+	assert(props_redo(props, &forge, 0, &ref) == 1);
+	assert(state->i32 == 2);
+
+	// a new change drops what could have been redone
+	state->i32 = 5;
+	props_set(props, &forge, 0, i32, &ref);
+	assert(props_redo(props, &forge, 0, &ref) == 0);
+	assert(props_undo(props, &forge, 0, &ref) == 1);
+	assert(state->i32 == 2);
+	assert(props_redo(props, &forge, 0, &ref) == 1);
+	assert(state->i32 == 5);
+
+	// variable-sized values through the regular set path
+	_props_impl_set(props, str, str->type, 4, "abc");
+	_props_impl_set(props, str, str->type, 7, "abcdef");
+	assert(props_undo(props, &forge, 0, &ref) == 1);
+	assert(str->value.size == 4);
+	assert(strcmp(state->str, "abc") == 0);
+	assert(props_redo(props, &forge, 0, &ref) == 1);
+	assert(strcmp(state->str, "abcdef") == 0);
+
+	// a full ring overwrites the oldest changes
+	props_history(props, history, 2*(sizeof(props_change_t) + 16));
+	for(int32_t i = 10; i < 15; i++)
+	{
+		state->i32 = i;
+		props_set(props, &forge, 0, i32, &ref);
+	}
+	assert(props_undo(props, &forge, 0, &ref) == 1);
+	assert(props_undo(props, &forge, 0, &ref) == 1);
+	assert(state->i32 == 12);
+	assert(props_undo(props, &forge, 0, &ref) == 0);
+	assert(props_redo(props, &forge, 0, &ref) == 1);
+	assert(props_redo(props, &forge, 0, &ref) == 1);
+	assert(state->i32 == 14);
+	assert(props_redo(props, &forge, 0, &ref) == 0);
+
+	// too large for the ring to be logged at all
+	props_history(props, history, sizeof(props_change_t) + 8);
+	_props_impl_set(props, str, str->type, 4, "xyz");
+	assert(props_undo(props, &forge, 0, &ref) == 0);
+	assert(strcmp(state->str, "xyz") == 0);
+
+	// a deferred stash is logged under the group current at set time
+	props_history(props, history, sizeof(history));
+	props_impl_t *impl = _props_impl_get(props, i32);
+	props_epoch_begin(props);
+	atomic_store(&impl->sync->state, PROP_STATE_LOCK); // held by the save thread
+	state->i32 = 20;
+	state->f64 = 20.0;
+	props_set(props, &forge, 0, i32, &ref);
+	props_set(props, &forge, 0, f64, &ref);
+	atomic_store(&impl->sync->state, PROP_STATE_NONE);
+	props_epoch_end(props);
+	assert(_props_impl_flag(props, impl, PROPS_FLAG_STASHING));
+	props_idle(props, &forge, 0, &ref); // catches up
+	assert(!_props_impl_flag(props, impl, PROPS_FLAG_STASHING));
+	assert(props_undo(props, &forge, 0, &ref) == 2);
+	assert(state->i32 == 14);
+	assert(state->f64 == 0.0);
+	assert(props_undo(props, &forge, 0, &ref) == 0);
+
+	// arrays are logged per element
+	static struct {
+		PROPS_T(props, MAX_NVOICES);
+		voicestate_t state;
+		voicestate_t stash;
+	} voiced;
+	props_t *vprops = &voiced.props;
+	voicestate_t *vstate = &voiced.state;
+
+	memset(&voiced, 0x0, sizeof(voiced));
+	assert(props_init(vprops, PROPS_PREFIX"subj", voice_defs, MAX_NVOICES,
+		vstate, &voiced.stash, &handle->map, NULL) == 1);
+	props_history(vprops, history, sizeof(history));
+
+	const LV2_URID note = props_map(vprops, voice_defs[VOICE_note].property);
+
+	vstate->voice[2].note = 60;
+	vstate->voice[5].note = 64;
+	props_set(vprops, &forge, 0, note, &ref);
+	assert(props_undo(vprops, &forge, 0, &ref) == 2);
+	assert(vstate->voice[2].note == 0);
+	assert(vstate->voice[5].note == 0);
+	assert(props_redo(vprops, &forge, 0, &ref) == 2);
+	assert(vstate->voice[2].note == 60);
+	assert(vstate->voice[5].note == 64);
+}
+
+static void
+_test_20(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	plugstate_t *state = &handle->state;
+	static plugstate_t presets [2];
+	static uint32_t sizes [2][MAX_NPROPS];
+	static uint64_t history [64];
+	props_slot_t slots [2] = {
+		{ .base = &presets[0], .sizes = sizes[0] },
+		{ .base = &presets[1], .sizes = sizes[1] }
+	};
+	uint8_t notify [1024];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref = 0;
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)notify;
+
+	lv2_atom_forge_init(&forge, &handle->map);
+	props_bank(props, slots, 2);
+	props_history(props, history, sizeof(history));
+
+	const LV2_URID i32 = props_map(props, defs[PROP_i32].property);
+	const LV2_URID f32 = props_map(props, defs[PROP_f32].property);
+	const LV2_URID b32 = props_map(props, defs[PROP_b32].property);
+	props_impl_t *str = _props_impl_get(props, props_map(props, defs[PROP_str].property));
+
+	assert(props_morph(props, 0, 0, 1, 0.5f) == 0); // nothing stored yet
+
+	_props_impl_set(props, str, str->type, 2, "a");
+	assert(props_bank_store(props, 0));
+
+	state->b32 = 1;
+	state->i32 = 10;
+	state->i64 = -10;
+	state->f32 = 1.f;
+	state->f64 = 2.0;
+	_props_impl_set(props, str, str->type, 2, "b");
+	assert(props_bank_store(props, 1));
+
+	assert(props_morph(props, 0, 0, 1, 0.f) == 6);
+	assert(state->b32 == 0);
+	assert(state->i32 == 0);
+	assert(state->f32 == 0.f);
+	assert(strcmp(state->str, "a") == 0);
+
+	// numeric properties are interpolated, others switch over
+	assert(props_morph(props, 0, 0, 1, 0.25f) == 4);
+	assert(state->b32 == 0);
+	assert(state->i32 == 3);
+	assert(state->i64 == -3);
+	assert(state->f32 == 0.25f);
+	assert(state->f64 == 0.5);
+	assert(strcmp(state->str, "a") == 0);
+	assert(props_morph(props, 0, 0, 1, 0.25f) == 0);
+
+	assert(props_morph(props, 0, 0, 1, 0.75f) == 6);
+	assert(state->b32 == 1);
+	assert(state->i32 == 8);
+	assert(state->f32 == 0.75f);
+	assert(strcmp(state->str, "b") == 0);
+
+	assert(props_morph(props, 0, 0, 1, 2.f) == 4); // clamped
+	assert(state->f64 == 2.0);
+
+	// sent on once per cycle
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	props_idle(props, &forge, 0, &ref);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(_notified(props, seq, i32) == 1);
+	assert(_notified(props, seq, f32) == 1);
+	assert(_notified(props, seq, b32) == 1);
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	props_idle(props, &forge, 0, &ref);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(_notified(props, seq, i32) == 0);
+
+	// a morph is no edit of its own, only the preset edits are logged
+	assert(props_undo(props, &forge, 0, &ref) == 1);
+	assert(strcmp(state->str, "a") == 0);
+	assert(props_undo(props, &forge, 0, &ref) == 1);
+	assert(props_undo(props, &forge, 0, &ref) == 0);
+	assert(state->i32 == 10);
+
+	// arrays of Float are interpolated as a whole
+	static struct {
+		PROPS_T(props, MAX_NVOICES);
+		voicestate_t state;
+		voicestate_t stash;
+	} voiced;
+	static voicestate_t vpresets [2];
+	props_slot_t vslots [2] = {
+		{ .base = &vpresets[0] },
+		{ .base = &vpresets[1] }
+	};
+	props_t *vprops = &voiced.props;
+	voicestate_t *vstate = &voiced.state;
+
+	memset(&voiced, 0x0, sizeof(voiced));
+	assert(props_init(vprops, PROPS_PREFIX"subj", voice_defs, MAX_NVOICES,
+		vstate, &voiced.stash, &handle->map, NULL) == 1);
+	props_bank(vprops, vslots, 2);
+
+	assert(props_bank_store(vprops, 0));
+	for(unsigned i = 0; i < NVOICES; i++)
+	{
+		vstate->gain[i] = i;
+		vstate->voice[i].note = 60 + i;
+	}
+	assert(props_bank_store(vprops, 1));
+
+	assert(props_morph(vprops, 0, 0, 1, 0.5f) == 1);
+	for(unsigned i = 0; i < NVOICES; i++)
+	{
+		assert(vstate->gain[i] == 0.5f*i);
+		assert(vstate->voice[i].note == (int32_t)(60 + i));
+	}
+	assert(props_morph(vprops, 0, 0, 1, 0.25f) == 2);
+	assert(vstate->gain[2] == 0.5f);
+	assert(vstate->voice[1].note == 0);
+
+	// atom:Vector of Float is interpolated between vectors of equal length
+	static struct {
+		PROPS_T(props, 1);
+		vecstate_t state;
+		vecstate_t stash;
+	} vecd;
+	static vecstate_t epresets [2];
+	static uint32_t esizes [2][1];
+	props_slot_t eslots [2] = {
+		{ .base = &epresets[0], .sizes = esizes[0] },
+		{ .base = &epresets[1], .sizes = esizes[1] }
+	};
+	props_t *eprops = &vecd.props;
+	vecstate_t *estate = &vecd.state;
+	const LV2_URID atom_float = handle->map.map(handle->map.handle, LV2_ATOM__Float);
+	const LV2_URID atom_int = handle->map.map(handle->map.handle, LV2_ATOM__Int);
+
+	memset(&vecd, 0x0, sizeof(vecd));
+	assert(props_init(eprops, PROPS_PREFIX"subj", vec_defs, 1,
+		estate, &vecd.stash, &handle->map, NULL) == 1);
+	props_bank(eprops, eslots, 2);
+
+	props_impl_t *env = &eprops->impls[0];
+	vecstate_t v = { .env = { sizeof(float), atom_float } };
+
+	_props_impl_set(eprops, env, env->type, sizeof(v), &v);
+	assert(props_bank_store(eprops, 0));
+	for(unsigned i = 0; i < NVOICES; i++)
+		v.elems[i] = i;
+	_props_impl_set(eprops, env, env->type, sizeof(v), &v);
+	assert(props_bank_store(eprops, 1));
+
+	assert(props_morph(eprops, 0, 0, 1, 0.5f) == 1);
+	for(unsigned i = 0; i < NVOICES; i++)
+		assert(estate->elems[i] == 0.5f*i);
+	assert(props_morph(eprops, 0, 0, 1, 0.5f) == 0);
+
+	// other vectors switch over
+	v.env.child_type = atom_int;
+	_props_impl_set(eprops, env, env->type, sizeof(v), &v);
+	assert(props_bank_store(eprops, 1));
+
+	assert(props_morph(eprops, 0, 0, 1, 0.25f) == 1);
+	assert(estate->env.child_type == atom_float);
+	assert(estate->elems[2] == 0.f);
+	assert(props_morph(eprops, 0, 0, 1, 0.75f) == 1);
+	assert(estate->env.child_type == atom_int);
+	assert(estate->elems[2] == 2.f);
+}
+
+typedef struct _graphstate_t graphstate_t;
+
+struct _graphstate_t {
+	int32_t a;
+	int32_t b;
+	int32_t sum;
+	int32_t twice;
+	unsigned nsum;
+	unsigned ntwice;
+};
+
+static void
+_derive_sum(void *data, props_impl_t *impl __attribute__((unused)))
+{
+	graphstate_t *state = data;
+
+	state->sum = state->a + state->b;
+	state->nsum++;
+}
+
+static void
+_derive_twice(void *data, props_impl_t *impl __attribute__((unused)))
+{
+	graphstate_t *state = data;
+
+	state->twice = 2*state->sum;
+	state->ntwice++;
+}
+
+static const char *const sum_depends [] = { PROPS_PREFIX"a", PROPS_PREFIX"b", NULL };
+static const char *const twice_depends [] = { PROPS_PREFIX"sum", NULL };
+static const char *const cycle_depends [] = { PROPS_PREFIX"twice", NULL };
+static const char *const unknown_depends [] = { PROPS_PREFIX"none", NULL };
+
+static void
+_test_21(handle_t *handle)
+{
+	assert(handle);
+
+	// declared in reverse, ordered topologically by props_graph
+	props_def_t graph_defs [4] = {
+		{
+			.property = PROPS_PREFIX"twice",
+			.offset = offsetof(graphstate_t, twice),
+			.type = LV2_ATOM__Int,
+			.access = LV2_PATCH__readable,
+			.derive = _derive_twice,
+			.depends = twice_depends
+		},
+		{
+			.property = PROPS_PREFIX"sum",
+			.offset = offsetof(graphstate_t, sum),
+			.type = LV2_ATOM__Int,
+			.access = LV2_PATCH__readable,
+			.derive = _derive_sum,
+			.depends = sum_depends
+		},
+		{
+			.property = PROPS_PREFIX"b",
+			.offset = offsetof(graphstate_t, b),
+			.type = LV2_ATOM__Int
+		},
+		{
+			.property = PROPS_PREFIX"a",
+			.offset = offsetof(graphstate_t, a),
+			.type = LV2_ATOM__Int
+		}
+	};
+	static struct {
+		PROPS_T(props, 4);
+		uint32_t graph [PROPS_GRAPH_SIZE(4, 3)/sizeof(uint32_t)]; // up to 3 derived
+		graphstate_t state;
+		graphstate_t stash;
+	} graph;
+	props_t *props = &graph.props;
+	graphstate_t *state = &graph.state;
+	uint8_t msg [256];
+	uint8_t notify [1024];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Ref ref = 0;
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)notify;
+
+	memset(&graph, 0x0, sizeof(graph));
+	assert(props_init(props, PROPS_PREFIX"subj", graph_defs, 4,
+		state, &graph.stash, &handle->map, state) == 1);
+	lv2_atom_forge_init(&forge, &handle->map);
+
+	// nothing is derived without a graph
+	assert(props_derive(props, &forge, 0, &ref) == 0);
+	assert(props_graph(props, graph.graph, PROPS_GRAPH_SIZE(4, 2) - 1) == 0);
+	assert(props_derive(props, &forge, 0, &ref) == 0);
+	assert(props_graph(props, graph.graph, PROPS_GRAPH_SIZE(4, 2)) == 1);
+
+	const LV2_URID a = props_map(props, PROPS_PREFIX"a");
+	const LV2_URID b = props_map(props, PROPS_PREFIX"b");
+	const LV2_URID sum = props_map(props, PROPS_PREFIX"sum");
+	const LV2_URID twice = props_map(props, PROPS_PREFIX"twice");
+
+	// all are stale at first
+	assert(props_derive(props, &forge, 0, &ref) == 2);
+	assert(state->nsum == 1);
+	assert(state->ntwice == 1);
+	assert(props_derive(props, &forge, 0, &ref) == 0);
+
+	// several events per block
+	for(int32_t i = 1; i <= 3; i++)
+	{
+		lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+		ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_set);
+		lv2_atom_forge_key(&forge, props->urid.patch_property);
+		lv2_atom_forge_urid(&forge, (i % 2) ? a : b);
+		lv2_atom_forge_key(&forge, props->urid.patch_value);
+		lv2_atom_forge_int(&forge, i);
+		lv2_atom_forge_pop(&forge, &obj_frame);
+		assert(ref);
+
+		LV2_Atom_Forge_Ref nref = 0;
+		assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &nref) == 1);
+	}
+
+	lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+	ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+	assert(props_derive(props, &forge, 0, &ref) == 2);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	// at most once per block, in order, and sent on once
+	assert(state->sum == 5);
+	assert(state->twice == 10); // not from a stale sum
+	assert(graph.stash.twice == 10);
+	assert(state->nsum == 2);
+	assert(state->ntwice == 2);
+	assert(_notified(props, seq, sum) == 1);
+	assert(_notified(props, seq, twice) == 1);
+
+	// only what depends on a change is recomputed
+	state->sum = 0;
+	props_set(props, &forge, 0, sum, &ref);
+	ref = 0;
+	assert(props_derive(props, &forge, 0, &ref) == 1);
+	assert(state->nsum == 2);
+	assert(state->ntwice == 3);
+	assert(state->twice == 0);
+
+	// cycles and unknown dependencies are refused
+	graph_defs[3].derive = _derive_sum;
+	graph_defs[3].depends = cycle_depends;
+	memset(&graph, 0x0, sizeof(graph));
+	assert(props_init(props, PROPS_PREFIX"subj", graph_defs, 4,
+		state, &graph.stash, &handle->map, state) == 1);
+	assert(props_graph(props, graph.graph, PROPS_GRAPH_SIZE(4, 2)) == 0); // too small for 3
+	assert(props_graph(props, graph.graph, sizeof(graph.graph)) == 0);
+	assert(props_derive(props, &forge, 0, &ref) == 0);
+
+	graph_defs[3].depends = unknown_depends;
+	memset(&graph, 0x0, sizeof(graph));
+	assert(props_init(props, PROPS_PREFIX"subj", graph_defs, 4,
+		state, &graph.stash, &handle->map, state) == 1);
+	assert(props_graph(props, graph.graph, sizeof(graph.graph)) == 0);
+}
+
+static void
+_test_22(handle_t *handle)
+{
+	assert(handle);
+
+	props_t *props = &handle->props;
+	uint8_t msg [256];
+	uint8_t notify [256];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Frame add_frame;
+	LV2_Atom_Forge_Ref ref;
+	const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)notify;
+
+	lv2_atom_forge_init(&forge, &handle->map);
+
+	const LV2_URID i32 = props_map(props, defs[PROP_i32].property);
+
+	// patch:Patch with a nested property that claims more than the message
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_patch);
+	lv2_atom_forge_key(&forge, props->urid.patch_sequence);
+	lv2_atom_forge_int(&forge, 23);
+	lv2_atom_forge_key(&forge, props->urid.patch_add);
+	lv2_atom_forge_object(&forge, &add_frame, 0, 0);
+	lv2_atom_forge_key(&forge, i32);
+	lv2_atom_forge_int(&forge, 1);
+	lv2_atom_forge_pop(&forge, &add_frame);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	for(unsigned malformed = 0; malformed < 2; malformed++)
+	{
+		const LV2_Atom_Object *add = NULL;
+		lv2_atom_object_get((const LV2_Atom_Object *)msg, props->urid.patch_add, &add, 0);
+		assert(add);
+
+		LV2_Atom_Property_Body *prop = (LV2_Atom_Property_Body *)lv2_atom_object_begin(&add->body);
+		prop->value.size = malformed ? sizeof(msg) : sizeof(int32_t);
+
+		lv2_atom_forge_set_buffer(&forge, notify, sizeof(notify));
+		ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+		assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == !malformed);
+		assert(ref);
+		lv2_atom_forge_pop(&forge, &frame);
+
+		const LV2_Atom_Event *ev = lv2_atom_sequence_begin(&seq->body);
+		assert(!lv2_atom_sequence_is_end(&seq->body, seq->atom.size, ev));
+		assert(((const LV2_Atom_Object *)&ev->body)->body.otype == (malformed
+			? props->urid.patch_error
+			: props->urid.patch_ack));
+	}
+
+	// a property header cut off by the object size
+	lv2_atom_forge_set_buffer(&forge, msg, sizeof(msg));
+	ref = lv2_atom_forge_object(&forge, &obj_frame, 0, props->urid.patch_set);
+	lv2_atom_forge_key(&forge, props->urid.patch_property);
+	lv2_atom_forge_urid(&forge, i32);
+	lv2_atom_forge_key(&forge, props->urid.patch_value);
+	lv2_atom_forge_int(&forge, 2);
+	lv2_atom_forge_pop(&forge, &obj_frame);
+	assert(ref);
+
+	((LV2_Atom *)msg)->size -= sizeof(LV2_Atom_Int) + sizeof(LV2_Atom); // key and context left
+	ref = 0;
+	assert(props_advance(props, &forge, 0, (const LV2_Atom_Object *)msg, &ref) == 0);
+	assert(handle->state.i32 != 2);
+}
+
+typedef struct _cxxstate_t cxxstate_t;
+
+struct _cxxstate_t {
+	float gain [NVOICES];
+	props_ref_t blob;
+};
+
+// positional, in the exact order props::property::def emits the fields
+static const props_def_t cxx_defs [2] = {
+	{
+		PROPS_PREFIX"gain",
+		LV2_ATOM__Float,
+		LV2_PATCH__writable,
+		offsetof(cxxstate_t, gain),
+		false,
+		0,
+		NULL,
+		false, // pooled
+		NVOICES, // count
+		0, // stride
+		NULL,
+		NULL
+	},
+	{
+		PROPS_PREFIX"blob",
+		LV2_ATOM__Chunk,
+		LV2_PATCH__writable,
+		offsetof(cxxstate_t, blob),
+		false,
+		0,
+		NULL,
+		true, // pooled
+		0, // count
+		0, // stride
+		NULL,
+		NULL
+	}
+};
+
+static void
+_test_23(handle_t *handle)
+{
+	assert(handle);
+
+	static struct {
+		PROPS_T(props, 2);
+		cxxstate_t state;
+		cxxstate_t stash;
+	} cxx;
+
+	props_t *props = &cxx.props;
+
+	memset(&cxx, 0x0, sizeof(cxx));
+	assert(props_init(props, PROPS_PREFIX"subj", cxx_defs, 2,
+		&cxx.state, &cxx.stash, &handle->map, NULL) == 1);
+
+	props_impl_t *gain = _props_impl_get(props, props_map(props, cxx_defs[0].property));
+	assert(gain);
+	assert(_props_impl_shape(props, gain)->count == NVOICES);
+	assert(_props_impl_shape(props, gain)->stride == sizeof(float));
+	assert(!_props_impl_flag(props, gain, PROPS_FLAG_POOLED));
+
+	props_impl_t *blob = _props_impl_get(props, props_map(props, cxx_defs[1].property));
+	assert(blob);
+	assert(_props_impl_shape(props, blob)->count == 0);
+	assert(_props_impl_shape(props, blob)->max_size == PROPS_POOL_MAX);
+	assert(_props_impl_flag(props, blob, PROPS_FLAG_POOLED));
+}
+
+typedef struct _badstate_t badstate_t;
+
+struct _badstate_t {
+	int32_t i32;
+	float gain [NVOICES];
+};
+
+static void
+_test_24(handle_t *handle)
+{
+	assert(handle);
+
+	static struct {
+		PROPS_T(props, 2);
+		badstate_t state;
+		badstate_t stash;
+	} bad;
+
+	props_t *props = &bad.props;
+	const props_def_t defs [2] = {
+		{
+			.property = PROPS_PREFIX"i32",
+			.offset = offsetof(badstate_t, i32),
+			.type = LV2_ATOM__Int
+		},
+		{
+			.property = NULL, // invalid
+			.offset = offsetof(badstate_t, gain),
+			.type = LV2_ATOM__Float
+		}
+	};
+
+	// an invalid def after a valid one fails cleanly
+	memset(&bad, 0x0, sizeof(bad));
+	assert(props_init(props, PROPS_PREFIX"subj", defs, 2,
+		&bad.state, &bad.stash, &handle->map, NULL) == 0);
+	assert(_props_impl_get(props, props_map(props, defs[0].property)) == NULL);
+
+	// arrays that do not fit, are not fixed-size or overlap are rejected
+	const props_def_t arrays [4] = {
+		{
+			.property = PROPS_PREFIX"gain",
+			.offset = offsetof(badstate_t, gain),
+			.type = LV2_ATOM__Float,
+			.count = PROPS_ARRAY_MAX + 36
+		},
+		{
+			.property = PROPS_PREFIX"gain",
+			.offset = offsetof(badstate_t, gain),
+			.type = LV2_ATOM__String,
+			.count = NVOICES
+		},
+		{
+			.property = PROPS_PREFIX"gain",
+			.offset = offsetof(badstate_t, gain),
+			.type = LV2_ATOM__Float,
+			.count = NVOICES,
+			.stride = sizeof(float) - 1
+		},
+		{
+			.property = PROPS_PREFIX"gain",
+			.offset = offsetof(badstate_t, gain),
+			.type = LV2_ATOM__Float,
+			.count = NVOICES,
+			.pooled = true
+		}
+	};
+
+	for(unsigned i = 0; i < 4; i++)
+	{
+		const props_def_t pair [2] = { defs[0], arrays[i] };
+
+		memset(&bad, 0x0, sizeof(bad));
+		assert(props_init(props, PROPS_PREFIX"subj", pair, 2,
+			&bad.state, &bad.stash, &handle->map, NULL) == 0);
+	}
+}
+
 static const test_t tests [] = {
 	_test_1,
 	_test_2,
+	_test_3,
+	_test_4,
+	_test_5,
+	_test_6,
+	_test_7,
+	_test_8,
+	_test_9,
+	_test_10,
+	_test_11,
+	_test_12,
+	_test_13,
+	_test_14,
+	_test_15,
+	_test_16,
+	_test_17,
+	_test_18,
+	_test_19,
+	_test_20,
+	_test_21,
+	_test_22,
+	_test_23,
+	_test_24,
 	NULL
 };
 
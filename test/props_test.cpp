@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include <string>
+
+#include <props.hpp>
+
+#define PROPS_PREFIX		"http://open-music-kontrollers.ch/lv2/props#"
+
+struct plugstate_t {
+	int32_t i32;
+	int64_t i64;
+	float f32;
+	double f64;
+	char str [32];
+	float vec [4];
+	props_ref_t blob;
+};
+
+static void
+_derive_i64(void *data, props_impl_t *)
+{
+	plugstate_t *state = static_cast<plugstate_t *>(data);
+
+	state->i64 = 2 * static_cast<int64_t>(state->i32);
+}
+
+constexpr const char *i64_depends [] = { PROPS_PREFIX"i32", nullptr };
+
+constexpr auto i32 = props::property<props::atom::Int,
+	PROPS_MEMBER(plugstate_t, i32)>(PROPS_PREFIX"i32");
+constexpr auto i64 = props::property<props::atom::Long,
+	PROPS_MEMBER(plugstate_t, i64)>(PROPS_PREFIX"i64").readable()
+		.derived(_derive_i64, i64_depends);
+constexpr auto f32 = props::property<props::atom::Float,
+	PROPS_MEMBER(plugstate_t, f32)>(PROPS_PREFIX"f32");
+constexpr auto f64 = props::property<props::atom::Double,
+	PROPS_MEMBER(plugstate_t, f64)>(PROPS_PREFIX"f64").hidden();
+constexpr auto str = props::property<props::atom::String,
+	PROPS_MEMBER(plugstate_t, str)>(PROPS_PREFIX"str");
+
+constexpr auto vec = props::property<props::atom::vector<props::atom::Float>,
+	PROPS_MEMBER(plugstate_t, vec)>(PROPS_PREFIX"vec");
+constexpr auto blob = props::property<props::atom::pool<props::atom::Chunk, 64>,
+	PROPS_MEMBER(plugstate_t, blob)>(PROPS_PREFIX"blob");
+
+constexpr auto defs = props::make_defs(i32, i64, f32, f64, str, vec, blob);
+
+// everything about the def table is known at compile time
+static_assert(defs.size() == 7, "");
+static_assert(defs[1].offset == offsetof(plugstate_t, i64), "");
+static_assert(defs[4].max_size == 32, "");
+static_assert(defs[3].hidden, "");
+static_assert(defs[1].derive == _derive_i64, "");
+static_assert(props::hash(PROPS_PREFIX"f32") == f32.hash(), "");
+static_assert(defs[5].count == 4 && defs[5].stride == 0 && !defs[5].pooled, "");
+static_assert(defs[6].pooled && defs[6].max_size == 64 && defs[6].count == 0, "");
+
+static std::vector<std::string> uris;
+
+static LV2_URID
+_map(LV2_URID_Map_Handle, const char *uri)
+{
+	for(size_t i = 0; i < uris.size(); i++)
+	{
+		if(uris[i] == uri)
+			return i + 1;
+	}
+
+	uris.emplace_back(uri);
+
+	return uris.size();
+}
+
+int
+main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
+{
+	static props::store<plugstate_t, defs> store;
+	LV2_URID_Map map = { nullptr, _map };
+
+	assert(store.init(PROPS_PREFIX"subj", &map, &store.state) == 1);
+
+	assert(store.urid<f32>() == map.map(map.handle, PROPS_PREFIX"f32"));
+	assert(store.urid<str>() == map.map(map.handle, PROPS_PREFIX"str"));
+
+	store.value<f32>() = 0.5f;
+	assert(store.state.f32 == 0.5f);
+	assert(f32(store.state) == 0.5f);
+
+	strcpy(store.value<str>(), "hello");
+	assert(!strcmp(store.state.str, "hello"));
+
+	store.value<vec>()[3] = 0.25f;
+	assert(store.state.vec[3] == 0.25f);
+	assert(store.value<blob>().size == 0);
+
+	// stash via the plain C API and get a patch:Set out
+	uint8_t buf [512];
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+
+	lv2_atom_forge_init(&forge, &map);
+	lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_sequence_head(&forge, &frame, 0);
+
+	store.set<f32>(&forge, 0, &ref);
+	assert(ref);
+	lv2_atom_forge_pop(&forge, &frame);
+
+	assert(store.stash.f32 == 0.5f);
+
+	const LV2_Atom_Sequence *seq = reinterpret_cast<const LV2_Atom_Sequence *>(buf);
+	const LV2_URID patch_set = map.map(map.handle, LV2_PATCH__Set);
+	unsigned n = 0;
+	LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+	{
+		const LV2_Atom_Object *obj = reinterpret_cast<const LV2_Atom_Object *>(&ev->body);
+
+		if(obj->body.otype == patch_set)
+			n++;
+	}
+	assert(n == 1);
+
+	// derived once per block, after all events
+	ref = 0;
+	store.value<i32>() = 21;
+	store.set<i32>(&forge, 0, &ref);
+	assert(store.derive(&forge, 0, &ref) == 1);
+	assert(store.state.i64 == 42);
+	assert(store.stash.i64 == 42);
+	assert(store.derive(&forge, 0, &ref) == 0);
+
+	return 0;
+}